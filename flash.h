@@ -43,6 +43,17 @@ typedef struct {
   unsigned int page_bytes;
   unsigned int sector_count;
   unsigned int sector_bytes;
+  unsigned int subsector_count;
+  unsigned int subsector_bytes;
+  unsigned int page_program_us;
+  unsigned int subsector_erase_ms;
+  unsigned int sector_erase_ms;
+  unsigned int bulk_erase_ms;
+  unsigned int release_us;
+  unsigned int page_program_max_us;
+  unsigned int subsector_erase_max_ms;
+  unsigned int sector_erase_max_ms;
+  unsigned int bulk_erase_max_ms;
 } flash_info_t;
 
 /**
@@ -73,6 +84,40 @@ int flash_info(flash_info_t *p);
  */
 int flash_sector_erase(unsigned int sector);
 
+/**
+ * @brief Erase subsector.
+ * @details
+ * The subsector_count of flash_info is 0 when the flash does not support it.
+ *
+ * @param subsector The target subsector number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_subsector_erase(unsigned int subsector);
+
+/**
+ * @brief Erase the whole flash.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_bulk_erase(void);
+
+/**
+ * @brief Check the protection of a sector.
+ * @details
+ * A sector is protected when it is covered by the block protect bits
+ * or when it is locked down until the next power-up.
+ *
+ * @param sector The target sector number.
+ *
+ * @retval 0 The sector can be programmed and erased.
+ * @retval 1 The sector is protected.
+ * @retval -1 Failure.
+ */
+int flash_sector_protected(unsigned int sector);
+
 /**
  * @brief Write data to the target flash.
  *
@@ -83,6 +128,123 @@ int flash_sector_erase(unsigned int sector);
  */
 int flash_page_write(unsigned int page, unsigned char *buf, unsigned int siz);
 
+/**
+ * @brief Program bytes in a page.
+ * @details
+ * The bytes can start at any offset in the page but must not cross the page boundary.
+ * The other bytes in the page are not affected.
+ *
+ * @param addr The target byte address.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_program(unsigned int addr, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Start programming bytes in a page.
+ * @details
+ * It returns without waiting for the end of the program cycle.
+ * Use flash_busy to check the completion.
+ * The other functions wait for the end of the cycle before their commands.
+ *
+ * @param addr The target byte address.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_program_start(unsigned int addr, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Start erasing a sector.
+ * @details
+ * It returns without waiting for the end of the erase cycle.
+ * Use flash_busy to check the completion.
+ * The other functions wait for the end of the cycle before their commands.
+ *
+ * @param sector The target sector number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sector_erase_start(unsigned int sector);
+
+/**
+ * @brief Start erasing a subsector.
+ * @details
+ * It returns without waiting for the end of the erase cycle.
+ * Use flash_busy to check the completion.
+ * The other functions wait for the end of the cycle before their commands.
+ *
+ * @param subsector The target subsector number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_subsector_erase_start(unsigned int subsector);
+
+/**
+ * @brief Check a program or erase cycle is in progress.
+ *
+ * @retval 0 The flash is ready.
+ * @retval 1 A cycle is in progress.
+ */
+int flash_busy(void);
+
+/**
+ * @brief Take the flash for a sequence of functions.
+ * @details
+ * The other threads wait in the flash functions until flash_release.
+ * The holder calls the flash functions as usual, e.g. a *_start function
+ * and flash_busy, and no other command gets in between.
+ * It can not be nested. It needs FLASH_THREAD_SELF with
+ * FLASH_CONFIG_THREAD_SAFE and fails without it. It does nothing without
+ * FLASH_CONFIG_THREAD_SAFE, where there are no other threads.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_acquire(void);
+
+/**
+ * @brief Take over the flash held by another thread.
+ * @details
+ * The calling thread becomes the holder. The previous holder must not
+ * call the flash functions after the hand-off.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure, e.g. the flash is not held.
+ */
+int flash_handoff(void);
+
+/**
+ * @brief Give the flash back to the other users.
+ * @details
+ * It is called by the holder. It fails in the other threads.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure, e.g. the caller is not the holder.
+ */
+int flash_release(void);
+
+/**
+ * @brief Read bytes from the target flash.
+ * @details
+ * The bytes can start at any address and cross the page boundaries.
+ *
+ * @param addr The target byte address.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_read(unsigned int addr, unsigned char *buf, unsigned int siz);
+
 /**
  * @brief Read data from the target flash.
  *
@@ -93,5 +255,37 @@ int flash_page_write(unsigned int page, unsigned char *buf, unsigned int siz);
  */
 int flash_page_read(unsigned int page, unsigned char *buf, unsigned int siz);
 
+/**
+ * @brief Enter the deep power-down mode.
+ * @details
+ * The next access to the flash releases it from the deep power-down mode
+ * and waits for the release time reported by flash_info.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure, e.g. a cycle is in progress.
+ */
+int flash_deep_power_down(void);
+
+/**
+ * @brief Release from the deep power-down mode.
+ * @details
+ * Nothing is done when the flash is not in the deep power-down mode.
+ * It is not counted as an access.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_release_from_deep_power_down(void);
+
+/**
+ * @brief Number of accesses to the flash.
+ * @details
+ * It is incremented by every command sequence.
+ * A power manager can compare it to detect the idle time.
+ *
+ * @return The number of accesses.
+ */
+unsigned int flash_access_count(void);
+
 #endif
 
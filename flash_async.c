@@ -0,0 +1,346 @@
+/**
+ * @file flash_async.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include "flash.h"
+#include "flash_dev.h"
+#include "flash_lock.h"
+#include "flash_async.h"
+
+/**
+ * @brief WIP polls per typical cycle time.
+ */
+#define POLL_DIVIDER    (8)
+
+#define QUEUE_COUNT     FLASH_ASYNC_QUEUE_COUNT
+
+/**
+ * @brief Queue index of the priority classes, highest first.
+ */
+static const int queue_of[QUEUE_COUNT] = {
+  1,  /* FLASH_ASYNC_NORMAL */
+  0,  /* FLASH_ASYNC_CRITICAL */
+  2,  /* FLASH_ASYNC_BACKGROUND */
+};
+
+/**
+ * @brief Start the next step of the current operation.
+ *
+ * @param p The queue context.
+ * @param delay The delay until the next poll.
+ *
+ * @retval 0 A cycle has been started.
+ * @retval 1 The operation has completed.
+ * @retval -1 Failure.
+ */
+static int step(flash_async_t *p, unsigned int *delay)
+{
+  const flash_dev_t *dev = p->dev;
+  flash_async_op_t *op = p->current;
+  unsigned int addr;
+  unsigned int len;
+
+  switch (op->type) {
+    case FLASH_ASYNC_READ:
+      return (dev->read(dev->arg, op->addr, op->buf, op->siz) == 0) ? 1 : -1;
+    case FLASH_ASYNC_PROGRAM:
+      if (op->done == op->siz) {
+        return 1;
+      }
+      addr = op->addr + op->done;
+      len = p->info.page_bytes - (addr % p->info.page_bytes);
+      if (op->siz - op->done < len) {
+        len = op->siz - op->done;
+      }
+      if (dev->program_start(dev->arg, addr, op->buf + op->done, len) != 0) {
+        return -1;
+      }
+      op->done += len;
+      *delay = p->info.page_program_us;
+      return 0;
+    case FLASH_ASYNC_SUBSECTOR_ERASE:
+    case FLASH_ASYNC_SECTOR_ERASE:
+      if (op->done) {
+        return 1;
+      }
+      if (op->type == FLASH_ASYNC_SUBSECTOR_ERASE) {
+        if ((dev->subsector_erase_start == 0)
+            || (dev->subsector_erase_start(dev->arg, op->addr) != 0)) {
+          return -1;
+        }
+        *delay = p->info.subsector_erase_ms * 1000;
+      } else {
+        if (dev->sector_erase_start(dev->arg, op->addr) != 0) {
+          return -1;
+        }
+        *delay = p->info.sector_erase_ms * 1000;
+      }
+      op->done = 1;
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+/**
+ * @brief Put an operation at the head of its queue.
+ *
+ * @param p The queue context.
+ * @param op The operation.
+ */
+static void push_front(flash_async_t *p, flash_async_op_t *op)
+{
+  int q = queue_of[op->priority];
+  op->next = p->head[q];
+  p->head[q] = op;
+  if (p->tail[q] == 0) {
+    p->tail[q] = op;
+  }
+}
+
+/**
+ * @brief Check a higher class operation is waiting.
+ *
+ * @param p The queue context.
+ * @param op The current operation.
+ *
+ * @retval 0 No.
+ * @retval 1 Yes.
+ */
+static int preempted(flash_async_t *p, flash_async_op_t *op)
+{
+  int q;
+  for (q = 0; q < queue_of[op->priority]; q++) {
+    if (p->head[q]) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Take the next operation.
+ * @details
+ * An aged operation goes first, then the highest class.
+ * The operations in lower classes get older by the dispatch.
+ *
+ * @param p The queue context.
+ *
+ * @return The operation or 0 when nothing is queued.
+ */
+static flash_async_op_t *pick(flash_async_t *p)
+{
+  flash_async_op_t *op;
+  int q = -1;
+  int i;
+
+  for (i = 0; i < QUEUE_COUNT; i++) {
+    if (p->head[i] && (FLASH_ASYNC_AGING_LIMIT <= p->head[i]->age)) {
+      q = i;
+      break;
+    }
+  }
+  if (q < 0) {
+    for (i = 0; i < QUEUE_COUNT; i++) {
+      if (p->head[i]) {
+        q = i;
+        break;
+      }
+    }
+  }
+  if (q < 0) {
+    return 0;
+  }
+
+  op = p->head[q];
+  p->head[q] = op->next;
+  if (p->head[q] == 0) {
+    p->tail[q] = 0;
+  }
+  for (i = q + 1; i < QUEUE_COUNT; i++) {
+    if (p->head[i]) {
+      p->head[i]->age++;
+    }
+  }
+  return op;
+}
+
+/**
+ * @brief Initialize an asynchronous operation queue.
+ *
+ * @param p The queue context.
+ * @param dev The device, e.g. &flash_dev_default.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_async_init(flash_async_t *p, const flash_dev_t *dev)
+{
+  int i;
+  for (i = 0; i < QUEUE_COUNT; i++) {
+    p->head[i] = 0;
+    p->tail[i] = 0;
+  }
+  p->dev = dev;
+  p->current = 0;
+  p->poll_us = 0;
+  p->burst = 0;
+  p->lock.next = 0;
+  p->lock.owner = 0;
+  return dev->info(dev->arg, &p->info);
+}
+
+/**
+ * @brief Queue an operation.
+ *
+ * @param p The queue context.
+ * @param op The operation.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_async_submit(flash_async_t *p, flash_async_op_t *op)
+{
+  int q;
+
+  if ((op->type < FLASH_ASYNC_READ) || (FLASH_ASYNC_SECTOR_ERASE < op->type)) {
+    return -1;
+  }
+  if ((op->priority < FLASH_ASYNC_NORMAL) || (FLASH_ASYNC_BACKGROUND < op->priority)) {
+    return -1;
+  }
+  op->done = 0;
+  op->age = 0;
+  op->next = 0;
+  q = queue_of[op->priority];
+
+  FLASH_LOCK(&p->lock);
+  if (p->tail[q]) {
+    p->tail[q]->next = op;
+  } else {
+    p->head[q] = op;
+  }
+  p->tail[q] = op;
+  FLASH_UNLOCK(&p->lock);
+
+  return 0;
+}
+
+/**
+ * @brief Drive the queued operations.
+ *
+ * @param p The queue context.
+ *
+ * @return The delay in microseconds until the next call,
+ *         or FLASH_ASYNC_IDLE when nothing is queued.
+ */
+unsigned int flash_async_run(flash_async_t *p)
+{
+  flash_async_op_t *finished = 0;
+  unsigned int delay = 0;
+  int result = 0;
+  int r;
+
+  FLASH_LOCK(&p->lock);
+
+  if (p->current) {
+    r = p->dev->busy(p->dev->arg);
+    if (r == 1) {
+      FLASH_UNLOCK(&p->lock);
+      return p->poll_us;
+    }
+    if (r != 0) {
+      finished = p->current;
+      p->current = 0;
+      FLASH_UNLOCK(&p->lock);
+      if (finished->callback) {
+        finished->callback(finished, -1);
+      }
+      return 0;
+    }
+  }
+
+  /*
+   * A program operation between two pages gives way to a higher class.
+   */
+  if (p->current && (p->current->type == FLASH_ASYNC_PROGRAM)
+      && (p->current->done < p->current->siz) && preempted(p, p->current)) {
+    push_front(p, p->current);
+    p->current = 0;
+  }
+
+  if (p->current == 0) {
+    p->current = pick(p);
+    if (p->current == 0) {
+      p->burst = 0;
+      FLASH_UNLOCK(&p->lock);
+      return FLASH_ASYNC_IDLE;
+    }
+    if (p->current->priority == FLASH_ASYNC_BACKGROUND) {
+      if (p->burst == FLASH_ASYNC_BACKGROUND_BURST) {
+        push_front(p, p->current);
+        p->current = 0;
+        p->burst = 0;
+        FLASH_UNLOCK(&p->lock);
+        return FLASH_ASYNC_BACKGROUND_GAP_US;
+      }
+      if (p->current->done == 0) {
+        p->burst++;
+      }
+    } else {
+      p->burst = 0;
+    }
+  }
+
+  r = step(p, &delay);
+  if (r == 0) {
+    /*
+     * The first poll is at the typical cycle time,
+     * and the following polls are at a fraction of it.
+     */
+    p->poll_us = delay / POLL_DIVIDER;
+  } else {
+    finished = p->current;
+    result = (r < 0) ? -1 : 0;
+    p->current = 0;
+    delay = 0;
+  }
+
+  FLASH_UNLOCK(&p->lock);
+
+  if (finished && finished->callback) {
+    finished->callback(finished, result);
+  }
+
+  return delay;
+}
@@ -0,0 +1,180 @@
+/**
+ * @file flash_async.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_ASYNC_H
+#define FLASH_ASYNC_H
+
+#include "flash.h"
+#include "flash_dev.h"
+#include "flash_lock.h"
+
+#define FLASH_ASYNC_READ            (0)
+#define FLASH_ASYNC_PROGRAM         (1)
+#define FLASH_ASYNC_SUBSECTOR_ERASE (2)
+#define FLASH_ASYNC_SECTOR_ERASE    (3)
+
+/**
+ * @brief Priority classes.
+ * @details
+ * A zero initialized operation is FLASH_ASYNC_NORMAL.
+ */
+#define FLASH_ASYNC_NORMAL          (0)
+#define FLASH_ASYNC_CRITICAL        (1)
+#define FLASH_ASYNC_BACKGROUND      (2)
+
+/**
+ * @brief Dispatches of higher classes before a waiting operation is taken anyway.
+ */
+#define FLASH_ASYNC_AGING_LIMIT     (16)
+
+/**
+ * @brief Background operations started back to back.
+ */
+#define FLASH_ASYNC_BACKGROUND_BURST    (4)
+
+/**
+ * @brief Idle gap after a background burst in microseconds.
+ * @details
+ * It leaves the device idle for the foreground operations arriving meanwhile.
+ */
+#define FLASH_ASYNC_BACKGROUND_GAP_US   (2000)
+
+/**
+ * @brief The return value of flash_async_run when nothing is queued.
+ */
+#define FLASH_ASYNC_IDLE            (0xFFFFFFFF)
+
+/**
+ * @brief Number of the priority queues.
+ */
+#define FLASH_ASYNC_QUEUE_COUNT     (3)
+
+typedef struct flash_async_op flash_async_op_t;
+
+/**
+ * @brief Completion callback.
+ *
+ * @param op The completed operation.
+ * @param result 0 for success, !0 for failure.
+ */
+typedef void (*flash_async_callback_t)(flash_async_op_t *op, int result);
+
+/**
+ * @brief Asynchronous operation.
+ * @details
+ * The caller owns the memory and keeps it until the callback is called.
+ *
+ * - FLASH_ASYNC_READ : Read siz bytes at the byte address addr into buf.
+ * - FLASH_ASYNC_PROGRAM : Program siz bytes from buf at the byte address addr.
+ *   It can cross the page boundaries.
+ * - FLASH_ASYNC_SUBSECTOR_ERASE : Erase the subsector number addr.
+ * - FLASH_ASYNC_SECTOR_ERASE : Erase the sector number addr.
+ *
+ * priority is one of FLASH_ASYNC_NORMAL, FLASH_ASYNC_CRITICAL and FLASH_ASYNC_BACKGROUND.
+ */
+struct flash_async_op {
+  int type;
+  unsigned int addr;
+  unsigned char *buf;
+  unsigned int siz;
+  flash_async_callback_t callback;
+  void *arg;
+  int priority;
+  unsigned int done;
+  unsigned int age;
+  flash_async_op_t *next;
+};
+
+/**
+ * @brief Queue context.
+ * @details
+ * A context drives one device. One thread can drive several devices,
+ * e.g. several chips, each with its own context, by calling flash_async_run
+ * for each of them; a cycle on one device does not hold the others.
+ * The lock is used only with FLASH_CONFIG_THREAD_SAFE.
+ */
+typedef struct {
+  const flash_dev_t *dev;
+  flash_info_t info;
+  flash_async_op_t *head[FLASH_ASYNC_QUEUE_COUNT];
+  flash_async_op_t *tail[FLASH_ASYNC_QUEUE_COUNT];
+  flash_async_op_t *current;
+  unsigned int poll_us;
+  unsigned int burst;
+  flash_lock_t lock;
+} flash_async_t;
+
+/**
+ * @brief Initialize an asynchronous operation queue.
+ *
+ * @param p The queue context.
+ * @param dev The device, e.g. &flash_dev_default.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_async_init(flash_async_t *p, const flash_dev_t *dev);
+
+/**
+ * @brief Queue an operation.
+ *
+ * @param p The queue context.
+ * @param op The operation.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_async_submit(flash_async_t *p, flash_async_op_t *op);
+/**
+ * @brief Drive the queued operations.
+ * @details
+ * It never waits for a program or erase cycle.
+ * The critical operations go first, then the normal ones, then the background ones.
+ * A waiting operation is taken after FLASH_ASYNC_AGING_LIMIT dispatches of higher classes.
+ * A program operation is preempted at a page boundary by a higher class operation.
+ * The background operations are started in bursts separated by an idle gap.
+ * It starts the next step of the operations, or calls the callback
+ * of the completed operation, and returns.
+ * The return value tells when it should be called again, so the caller
+ * can sleep or serve other work, e.g. on a timer, in the meantime.
+ * An operation fails when busy of the device fails.
+ *
+ * @param p The queue context.
+ *
+ * @return The delay in microseconds until the next call,
+ *         or FLASH_ASYNC_IDLE when nothing is queued.
+ */
+unsigned int flash_async_run(flash_async_t *p);
+
+#endif
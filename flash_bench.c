@@ -0,0 +1,469 @@
+/**
+ * @file flash_bench.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "flash.h"
+#include "flash_bench.h"
+
+/**
+ * @brief Clock in microseconds.
+ */
+#ifndef FLASH_BENCH_CLOCK_US
+#define FLASH_BENCH_CLOCK_US()      (0) /* Your codes */
+#endif
+
+/**
+ * @brief Number of bytes transferred on the bus so far.
+ */
+#ifndef FLASH_BENCH_BUS_BYTES
+#define FLASH_BENCH_BUS_BYTES()     (0) /* Your codes */
+#endif
+
+#define CMD_READ_STATUS_REGISTER    (0x05)
+#define CMD_PAGE_PROGRAM            (0x02)
+#define CMD_SUBSECTOR_ERASE         (0x20)
+#define CMD_SECTOR_ERASE            (0xD8)
+#define CMD_BULK_ERASE              (0xC7)
+
+#define IMAGE_SECTOR                (0)
+#define UPDATE_SECTOR               (8)
+#define UPDATE_SECTOR_COUNT         (8)
+#define LOG_SECTOR                  (16)
+#define LOG_SECTOR_COUNT            (2)
+
+static flash_bench_result_t counter;
+static flash_info_t info;
+static unsigned char page[256];
+static unsigned char block[FLASH_BENCH_BLOCK_BYTES];
+static unsigned long random_state;
+
+/**
+ * @brief Count an instruction.
+ *
+ * @param cmd The instruction code.
+ */
+void flash_bench_command(unsigned char cmd)
+{
+  counter.commands++;
+  switch (cmd) {
+    case CMD_PAGE_PROGRAM:
+      counter.programs++;
+      break;
+    case CMD_SUBSECTOR_ERASE:
+      counter.subsector_erases++;
+      break;
+    case CMD_SECTOR_ERASE:
+      counter.sector_erases++;
+      break;
+    case CMD_BULK_ERASE:
+      counter.bulk_erases++;
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief Count a status register read.
+ *
+ * @param sreg The status register.
+ */
+void flash_bench_status(unsigned char sreg)
+{
+  (void)sreg;
+  counter.polls++;
+}
+
+/**
+ * @brief Test pattern.
+ *
+ * @param addr The byte address.
+ * @param gen The generation of the data.
+ *
+ * @return The byte.
+ */
+static unsigned char pattern(unsigned long addr, unsigned long gen)
+{
+  unsigned long x = (addr ^ (gen << 24)) * 0x9E3779B1UL;
+  return (x >> 24) & 0xFF;
+}
+
+/**
+ * @brief Pseudo random number.
+ *
+ * @return The number.
+ */
+static unsigned long random_next(void)
+{
+  random_state = random_state * 1103515245UL + 12345UL;
+  return (random_state >> 16) & 0x7FFF;
+}
+
+/**
+ * @brief Fill a buffer with the test pattern.
+ *
+ * @param buf The buffer.
+ * @param addr The byte address of the first byte.
+ * @param siz The number of bytes.
+ * @param gen The generation of the data.
+ */
+static void fill(unsigned char *buf, unsigned long addr, unsigned int siz, unsigned long gen)
+{
+  unsigned int i;
+  for (i = 0; i < siz; i++) {
+    buf[i] = pattern(addr + i, gen);
+  }
+}
+
+/**
+ * @brief Check whether a buffer is blank.
+ *
+ * @param buf The buffer.
+ * @param siz The number of bytes.
+ *
+ * @return 1 if all bytes are 0xFF.
+ */
+static int blank(const unsigned char *buf, unsigned int siz)
+{
+  unsigned int i;
+  for (i = 0; i < siz; i++) {
+    if (buf[i] != 0xFF) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Copy a sector page by page.
+ * @details
+ * The destination must be erased. Blank pages and the pages
+ * in the excluded block are skipped.
+ *
+ * @param dst The destination sector.
+ * @param src The source sector.
+ * @param skip The byte offset of the excluded block in the sector.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int copy(unsigned int dst, unsigned int src, unsigned long skip)
+{
+  unsigned long ofs;
+  for (ofs = 0; ofs < info.sector_bytes; ofs += info.page_bytes) {
+    if ((skip <= ofs) && (ofs < skip + FLASH_BENCH_BLOCK_BYTES)) {
+      continue;
+    }
+    if (flash_read(src * info.sector_bytes + ofs, page, info.page_bytes) != 0) {
+      return -1;
+    }
+    if (blank(page, info.page_bytes)) {
+      continue;
+    }
+    if (flash_program(dst * info.sector_bytes + ofs, page, info.page_bytes) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Program a buffer page by page.
+ *
+ * @param addr The page aligned byte address.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int program(unsigned long addr, unsigned char *buf, unsigned int siz)
+{
+  unsigned int ofs;
+  for (ofs = 0; ofs < siz; ofs += info.page_bytes) {
+    if (flash_program(addr + ofs, buf + ofs, info.page_bytes) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief IMAGE workload.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int image(void)
+{
+  unsigned long addr;
+  unsigned int sector;
+
+  for (sector = 0; sector < FLASH_BENCH_IMAGE_BYTES / info.sector_bytes; sector++) {
+    if (flash_sector_erase(IMAGE_SECTOR + sector) != 0) {
+      return -1;
+    }
+  }
+  for (addr = 0; addr < FLASH_BENCH_IMAGE_BYTES; addr += info.page_bytes) {
+    fill(page, addr, info.page_bytes, 0);
+    if (flash_program(IMAGE_SECTOR * info.sector_bytes + addr, page, info.page_bytes) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief UPDATE workload.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int update(void)
+{
+  unsigned int scratch = info.sector_count - 1;
+  unsigned int i;
+  unsigned int j;
+
+  random_state = 1;
+  for (i = 0; i < FLASH_BENCH_UPDATE_COUNT; i++) {
+    unsigned long n = random_next() % (UPDATE_SECTOR_COUNT * info.sector_bytes / FLASH_BENCH_BLOCK_BYTES);
+    unsigned long addr = UPDATE_SECTOR * info.sector_bytes + n * FLASH_BENCH_BLOCK_BYTES;
+    unsigned int sector = addr / info.sector_bytes;
+
+    fill(block, addr, FLASH_BENCH_BLOCK_BYTES, i + 1);
+    if (flash_subsector_erase(addr / FLASH_BENCH_BLOCK_BYTES) != 0) {
+      unsigned long skip = addr % info.sector_bytes;
+      if (flash_sector_erase(scratch) != 0) {
+        return -1;
+      }
+      if (copy(scratch, sector, skip) != 0) {
+        return -1;
+      }
+      if (flash_sector_erase(sector) != 0) {
+        return -1;
+      }
+      if (copy(sector, scratch, skip) != 0) {
+        return -1;
+      }
+    }
+    if (program(addr, block, FLASH_BENCH_BLOCK_BYTES) != 0) {
+      return -1;
+    }
+    if (flash_read(addr, block, FLASH_BENCH_BLOCK_BYTES) != 0) {
+      return -1;
+    }
+    for (j = 0; j < FLASH_BENCH_BLOCK_BYTES; j++) {
+      if (block[j] != pattern(addr + j, i + 1)) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief LOG workload.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int log_append(void)
+{
+  unsigned long ring = LOG_SECTOR_COUNT * info.sector_bytes;
+  unsigned long i;
+
+  for (i = 0; i < FLASH_BENCH_LOG_RECORDS; i++) {
+    unsigned long ofs = (i * FLASH_BENCH_LOG_RECORD_BYTES) % ring;
+    unsigned long addr = LOG_SECTOR * info.sector_bytes + ofs;
+    if ((ofs % info.sector_bytes) == 0) {
+      if (flash_sector_erase(addr / info.sector_bytes) != 0) {
+        return -1;
+      }
+    }
+    fill(page, i, FLASH_BENCH_LOG_RECORD_BYTES, 0);
+    if (flash_program(addr, page, FLASH_BENCH_LOG_RECORD_BYTES) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief BOOT workload.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int boot(void)
+{
+  unsigned long addr;
+  unsigned int i;
+
+  for (addr = 0; addr < FLASH_BENCH_IMAGE_BYTES; addr += FLASH_BENCH_BLOCK_BYTES) {
+    if (flash_read(IMAGE_SECTOR * info.sector_bytes + addr, block, FLASH_BENCH_BLOCK_BYTES) != 0) {
+      return -1;
+    }
+    for (i = 0; i < FLASH_BENCH_BLOCK_BYTES; i++) {
+      if (block[i] != pattern(addr + i, 0)) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Workload name.
+ *
+ * @param workload The workload.
+ *
+ * @return The name.
+ */
+const char *flash_bench_name(int workload)
+{
+  static const char *name[FLASH_BENCH_COUNT] = { "image", "update", "log", "boot" };
+  if ((workload < 0) || (FLASH_BENCH_COUNT <= workload)) {
+    return "";
+  }
+  return name[workload];
+}
+
+/**
+ * @brief Run a workload.
+ *
+ * @param workload The workload.
+ * @param r The result.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_bench_run(int workload, flash_bench_result_t *r)
+{
+  unsigned long time_us;
+  unsigned long bus_bytes;
+  int ret;
+
+  if (flash_info(&info) != 0) {
+    return -1;
+  }
+  if ((info.sector_count <= LOG_SECTOR + LOG_SECTOR_COUNT) || (sizeof(page) < info.page_bytes)) {
+    return -1;
+  }
+
+  memset(&counter, 0, sizeof(counter));
+  time_us = FLASH_BENCH_CLOCK_US();
+  bus_bytes = FLASH_BENCH_BUS_BYTES();
+  switch (workload) {
+    case FLASH_BENCH_IMAGE:
+      ret = image();
+      break;
+    case FLASH_BENCH_UPDATE:
+      ret = update();
+      break;
+    case FLASH_BENCH_LOG:
+      ret = log_append();
+      break;
+    case FLASH_BENCH_BOOT:
+      ret = boot();
+      break;
+    default:
+      ret = -1;
+      break;
+  }
+  *r = counter;
+  r->time_us = FLASH_BENCH_CLOCK_US() - time_us;
+  r->bus_bytes = FLASH_BENCH_BUS_BYTES() - bus_bytes;
+  return ret;
+}
+
+/**
+ * @brief Write an unsigned number.
+ *
+ * @param n The number.
+ * @param put The output function.
+ * @param arg The argument for the output function.
+ */
+static void put_number(unsigned long n, void (*put)(const char *s, void *arg), void *arg)
+{
+  char buf[24];
+  int i = sizeof(buf) - 1;
+  buf[i] = '\0';
+  do {
+    buf[--i] = '0' + (n % 10);
+    n /= 10;
+  } while (n);
+  put(&buf[i], arg);
+}
+
+/**
+ * @brief Write the results in JSON.
+ *
+ * @param label The label of the run, e.g. the backend and the chip.
+ * @param r The results of all workloads.
+ * @param put The output function.
+ * @param arg The argument for the output function.
+ */
+void flash_bench_json(
+    const char *label, const flash_bench_result_t r[FLASH_BENCH_COUNT],
+    void (*put)(const char *s, void *arg), void *arg)
+{
+  int i;
+
+  put("{\"label\":\"", arg);
+  put(label, arg);
+  put("\",\"workloads\":[", arg);
+  for (i = 0; i < FLASH_BENCH_COUNT; i++) {
+    put(i ? ",{\"name\":\"" : "{\"name\":\"", arg);
+    put(flash_bench_name(i), arg);
+    put("\",\"time_us\":", arg);
+    put_number(r[i].time_us, put, arg);
+    put(",\"bus_bytes\":", arg);
+    put_number(r[i].bus_bytes, put, arg);
+    put(",\"commands\":", arg);
+    put_number(r[i].commands, put, arg);
+    put(",\"polls\":", arg);
+    put_number(r[i].polls, put, arg);
+    put(",\"programs\":", arg);
+    put_number(r[i].programs, put, arg);
+    put(",\"subsector_erases\":", arg);
+    put_number(r[i].subsector_erases, put, arg);
+    put(",\"sector_erases\":", arg);
+    put_number(r[i].sector_erases, put, arg);
+    put(",\"bulk_erases\":", arg);
+    put_number(r[i].bulk_erases, put, arg);
+    put("}", arg);
+  }
+  put("]}\n", arg);
+}
@@ -0,0 +1,129 @@
+/**
+ * @file flash_bench.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_BENCH_H
+#define FLASH_BENCH_H
+
+#include "flash.h"
+
+/**
+ * @brief Workloads.
+ * @details
+ * - IMAGE : Erase and program an image of FLASH_BENCH_IMAGE_BYTES.
+ * - UPDATE : Rewrite and verify FLASH_BENCH_UPDATE_COUNT random 4KB blocks.
+ *            A block is copied through a scratch sector if subsector erase is not available.
+ * - LOG : Append FLASH_BENCH_LOG_RECORDS records to a ring of two sectors.
+ * - BOOT : Read and verify the image in 4KB chunks.
+ */
+#define FLASH_BENCH_IMAGE           (0)
+#define FLASH_BENCH_UPDATE          (1)
+#define FLASH_BENCH_LOG             (2)
+#define FLASH_BENCH_BOOT            (3)
+#define FLASH_BENCH_COUNT           (4)
+
+#define FLASH_BENCH_IMAGE_BYTES     (512 * 1024)
+#define FLASH_BENCH_BLOCK_BYTES     (4096)
+#define FLASH_BENCH_UPDATE_COUNT    (32)
+#define FLASH_BENCH_LOG_RECORDS     (6144)
+#define FLASH_BENCH_LOG_RECORD_BYTES (32)
+
+/**
+ * @brief Result of a workload.
+ */
+typedef struct {
+  unsigned long time_us;
+  unsigned long bus_bytes;
+  unsigned long commands;
+  unsigned long polls;
+  unsigned long programs;
+  unsigned long subsector_erases;
+  unsigned long sector_erases;
+  unsigned long bulk_erases;
+} flash_bench_result_t;
+
+/**
+ * @brief Count an instruction.
+ * @details
+ * Call it from the COMMAND hook of the driver.
+ *
+ * @param cmd The instruction code.
+ */
+void flash_bench_command(unsigned char cmd);
+
+/**
+ * @brief Count a status register read.
+ * @details
+ * Call it from the STATUS hook of the driver.
+ *
+ * @param sreg The status register.
+ */
+void flash_bench_status(unsigned char sreg);
+
+/**
+ * @brief Workload name.
+ *
+ * @param workload The workload.
+ *
+ * @return The name.
+ */
+const char *flash_bench_name(int workload);
+
+/**
+ * @brief Run a workload.
+ * @details
+ * The workloads use the first 18 sectors and the last sector.
+ * The contents of them are destroyed.
+ * BOOT verifies the image written by IMAGE.
+ *
+ * @param workload The workload.
+ * @param r The result.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_bench_run(int workload, flash_bench_result_t *r);
+
+/**
+ * @brief Write the results in JSON.
+ *
+ * @param label The label of the run, e.g. the backend and the chip.
+ * @param r The results of all workloads.
+ * @param put The output function.
+ * @param arg The argument for the output function.
+ */
+void flash_bench_json(
+    const char *label, const flash_bench_result_t r[FLASH_BENCH_COUNT],
+    void (*put)(const char *s, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ * @file flash_bus.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_BUS_H
+#define FLASH_BUS_H
+
+/**
+ * @brief Bus arbiter.
+ * @details
+ * The flash layer calls acquire before driving the chip select and release after it,
+ * at every point where another device on the same bus can take a turn:
+ * - between the WIP polls of a program or erase cycle,
+ * - between the chunks of a long read, each of them with a fresh address header.
+ *
+ * chunk_bytes is the largest number of data bytes read with one chip select.
+ * 0 means no limit.
+ */
+typedef struct {
+  void (*acquire)(void *arg);
+  void (*release)(void *arg);
+  void *arg;
+  unsigned int chunk_bytes;
+} flash_bus_t;
+
+/**
+ * @brief Set the bus arbiter.
+ *
+ * @param bus The bus arbiter or 0 for the exclusive bus.
+ */
+void flash_bus_set(const flash_bus_t *bus);
+
+/**
+ * @brief Acquire the bus.
+ */
+void flash_bus_acquire(void);
+
+/**
+ * @brief Release the bus.
+ */
+void flash_bus_release(void);
+
+/**
+ * @brief Give the other bus users a turn.
+ * @details
+ * It releases and acquires the bus again.
+ */
+void flash_bus_yield(void);
+
+/**
+ * @brief Number of bytes for the next chunk.
+ *
+ * @param siz The number of bytes remaining.
+ *
+ * @return The number of bytes to transfer with this chip select.
+ */
+unsigned int flash_bus_chunk(unsigned int siz);
+
+#endif
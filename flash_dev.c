@@ -0,0 +1,91 @@
+/**
+ * @file flash_dev.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include "flash.h"
+#include "flash_dev.h"
+
+/*
+ * The functions of the default device call the flash layer.
+ */
+
+static int dev_info(void *arg, flash_info_t *p)
+{
+  (void)arg;
+  return flash_info(p);
+}
+
+static int dev_read(void *arg, unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  (void)arg;
+  return flash_read(addr, buf, siz);
+}
+
+static int dev_program_start(void *arg, unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  (void)arg;
+  return flash_program_start(addr, buf, siz);
+}
+
+static int dev_sector_erase_start(void *arg, unsigned int sector)
+{
+  (void)arg;
+  return flash_sector_erase_start(sector);
+}
+
+static int dev_subsector_erase_start(void *arg, unsigned int subsector)
+{
+  (void)arg;
+  return flash_subsector_erase_start(subsector);
+}
+
+static int dev_busy(void *arg)
+{
+  (void)arg;
+  return flash_busy();
+}
+
+/**
+ * @brief The device of the flash layer.
+ */
+const flash_dev_t flash_dev_default = {
+  dev_info,
+  dev_read,
+  dev_program_start,
+  dev_sector_erase_start,
+  dev_subsector_erase_start,
+  dev_busy,
+  0,
+  0,
+  0
+};
@@ -0,0 +1,71 @@
+/**
+ * @file flash_dev.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_DEV_H
+#define FLASH_DEV_H
+
+#include "flash.h"
+
+/**
+ * @brief Flash device handle.
+ * @details
+ * A set of functions for a flash device with the semantics of the flash layer.
+ * arg is given to each function, e.g. to pick the chip select or the transport.
+ * The program and erase functions only start the cycle and busy tells the end of it.
+ * subsector_erase_start may be 0 if the device has no subsector erase.
+ *
+ * read_start starts a read which goes on without the CPU, e.g. by DMA on a
+ * bus of its own, and read_done tells the end of it: 1 when the bytes are
+ * in the buffer, 0 while the read is in progress and -1 on failure.
+ * A device has one such read at a time, and none during a program or erase
+ * cycle. Both may be 0 if the device only has read.
+ */
+typedef struct {
+  int (*info)(void *arg, flash_info_t *p);
+  int (*read)(void *arg, unsigned int addr, unsigned char *buf, unsigned int siz);
+  int (*program_start)(void *arg, unsigned int addr, unsigned char *buf, unsigned int siz);
+  int (*sector_erase_start)(void *arg, unsigned int sector);
+  int (*subsector_erase_start)(void *arg, unsigned int subsector);
+  int (*busy)(void *arg);
+  int (*read_start)(void *arg, unsigned int addr, unsigned char *buf, unsigned int siz);
+  int (*read_done)(void *arg);
+  void *arg;
+} flash_dev_t;
+
+/**
+ * @brief The device of the flash layer.
+ */
+extern const flash_dev_t flash_dev_default;
+
+#endif
@@ -0,0 +1,744 @@
+/**
+ * @file flash_ecc.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "flash.h"
+#include "flash_ecc.h"
+#include "flash_lock.h"
+
+/*
+ * Parity subsector of a sector
+ *
+ *   generation 0 : a code for each page of the sector
+ *   ...
+ *   generation GENERATIONS - 1
+ *   commit marks : a byte for each generation, 0x00 when it is complete
+ *
+ * The current generation is the last complete one. An erased code
+ * matches an erased page, so a data erase only needs a new generation
+ * with the codes of the erased pages left erased.
+ */
+
+#define GENERATIONS     (5)
+#define GEN_NONE        (0xFE)
+#define GEN_UNKNOWN     (0xFF)
+#define PAGE_BYTES      FLASH_ECC_DATA_BYTES
+#define CODE_BYTES      FLASH_ECC_CODE_BYTES
+#define SLOT_ERASE      (0)
+#define SLOT_SET        (1)
+#define PAGES_PER_SECTOR_MAX  (256)
+
+/**
+ * @brief Column parities and parity of a byte.
+ * @details
+ * Bit 2k is the parity of the bits whose position has bit k clear,
+ * bit 2k+1 the parity of the bits whose position has bit k set,
+ * and bit 6 the parity of the byte.
+ */
+static const unsigned char table[256] = {
+  0x00, 0x55, 0x56, 0x03, 0x59, 0x0C, 0x0F, 0x5A,
+  0x5A, 0x0F, 0x0C, 0x59, 0x03, 0x56, 0x55, 0x00,
+  0x65, 0x30, 0x33, 0x66, 0x3C, 0x69, 0x6A, 0x3F,
+  0x3F, 0x6A, 0x69, 0x3C, 0x66, 0x33, 0x30, 0x65,
+  0x66, 0x33, 0x30, 0x65, 0x3F, 0x6A, 0x69, 0x3C,
+  0x3C, 0x69, 0x6A, 0x3F, 0x65, 0x30, 0x33, 0x66,
+  0x03, 0x56, 0x55, 0x00, 0x5A, 0x0F, 0x0C, 0x59,
+  0x59, 0x0C, 0x0F, 0x5A, 0x00, 0x55, 0x56, 0x03,
+  0x69, 0x3C, 0x3F, 0x6A, 0x30, 0x65, 0x66, 0x33,
+  0x33, 0x66, 0x65, 0x30, 0x6A, 0x3F, 0x3C, 0x69,
+  0x0C, 0x59, 0x5A, 0x0F, 0x55, 0x00, 0x03, 0x56,
+  0x56, 0x03, 0x00, 0x55, 0x0F, 0x5A, 0x59, 0x0C,
+  0x0F, 0x5A, 0x59, 0x0C, 0x56, 0x03, 0x00, 0x55,
+  0x55, 0x00, 0x03, 0x56, 0x0C, 0x59, 0x5A, 0x0F,
+  0x6A, 0x3F, 0x3C, 0x69, 0x33, 0x66, 0x65, 0x30,
+  0x30, 0x65, 0x66, 0x33, 0x69, 0x3C, 0x3F, 0x6A,
+  0x6A, 0x3F, 0x3C, 0x69, 0x33, 0x66, 0x65, 0x30,
+  0x30, 0x65, 0x66, 0x33, 0x69, 0x3C, 0x3F, 0x6A,
+  0x0F, 0x5A, 0x59, 0x0C, 0x56, 0x03, 0x00, 0x55,
+  0x55, 0x00, 0x03, 0x56, 0x0C, 0x59, 0x5A, 0x0F,
+  0x0C, 0x59, 0x5A, 0x0F, 0x55, 0x00, 0x03, 0x56,
+  0x56, 0x03, 0x00, 0x55, 0x0F, 0x5A, 0x59, 0x0C,
+  0x69, 0x3C, 0x3F, 0x6A, 0x30, 0x65, 0x66, 0x33,
+  0x33, 0x66, 0x65, 0x30, 0x6A, 0x3F, 0x3C, 0x69,
+  0x03, 0x56, 0x55, 0x00, 0x5A, 0x0F, 0x0C, 0x59,
+  0x59, 0x0C, 0x0F, 0x5A, 0x00, 0x55, 0x56, 0x03,
+  0x66, 0x33, 0x30, 0x65, 0x3F, 0x6A, 0x69, 0x3C,
+  0x3C, 0x69, 0x6A, 0x3F, 0x65, 0x30, 0x33, 0x66,
+  0x65, 0x30, 0x33, 0x66, 0x3C, 0x69, 0x6A, 0x3F,
+  0x3F, 0x6A, 0x69, 0x3C, 0x66, 0x33, 0x30, 0x65,
+  0x00, 0x55, 0x56, 0x03, 0x59, 0x0C, 0x0F, 0x5A,
+  0x5A, 0x0F, 0x0C, 0x59, 0x03, 0x56, 0x55, 0x00
+};
+
+static flash_info_t info;
+static unsigned int sector_count;
+static unsigned int pages_per_sector;
+static unsigned int area_bytes;
+static unsigned int parity_subsector;
+static unsigned char gen[FLASH_ECC_SECTOR_COUNT_MAX];
+static unsigned char parity[PAGES_PER_SECTOR_MAX * CODE_BYTES];
+static unsigned char page_buf[PAGE_BYTES];
+static flash_ecc_stats_t stats;
+#ifdef FLASH_CONFIG_THREAD_SAFE
+static flash_lock_t ecc_lock = FLASH_LOCK_INITIALIZER;
+#endif
+
+/**
+ * @brief Calculate the code of a page.
+ *
+ * @param data FLASH_ECC_DATA_BYTES bytes.
+ * @param code FLASH_ECC_CODE_BYTES bytes.
+ */
+void flash_ecc_calculate(const unsigned char *data, unsigned char *code)
+{
+  unsigned int column = 0;
+  unsigned int line0 = 0;
+  unsigned int line1 = 0;
+  unsigned int i;
+  unsigned char t;
+
+  for (i = 0; i < PAGE_BYTES; i++) {
+    t = table[data[i]];
+    column ^= t;
+    if (t & 0x40) {
+      line1 ^= i;
+      line0 ^= ~i;
+    }
+  }
+  code[0] = ~line1 & 0xFF;
+  code[1] = ~line0 & 0xFF;
+  code[2] = ~((column & 0x3F) << 2) & 0xFF;
+}
+
+/**
+ * @brief Count the one bits of a byte.
+ */
+static unsigned int bits(unsigned int x)
+{
+  unsigned int n = 0;
+  while (x) {
+    x &= x - 1;
+    n++;
+  }
+  return n;
+}
+
+/**
+ * @brief Correct a page.
+ * @details
+ * A single bit error at byte j and bit b flips one line parity
+ * of each pair, so the syndrome of the line parities is j and ~j,
+ * and one column parity of each pair, whose set members give b.
+ *
+ * @param data FLASH_ECC_DATA_BYTES bytes.
+ * @param stored The stored code.
+ * @param calc The code calculated from the data.
+ *
+ * @retval 0 No error.
+ * @retval 1 A bit error in the data was corrected.
+ * @retval 2 A bit error in the stored code was found. The data is good.
+ * @retval -1 Uncorrectable.
+ */
+int flash_ecc_correct(unsigned char *data, const unsigned char *stored, const unsigned char *calc)
+{
+  unsigned int s0 = stored[0] ^ calc[0];
+  unsigned int s1 = stored[1] ^ calc[1];
+  unsigned int s2 = ((stored[2] ^ calc[2]) >> 2) & 0x3F;
+  unsigned int bit;
+
+  if ((s0 | s1 | s2) == 0) {
+    return 0;
+  }
+  if (((s0 ^ s1) == 0xFF) && (((s2 ^ (s2 >> 1)) & 0x15) == 0x15)) {
+    bit = ((s2 >> 1) & 1) | ((s2 >> 2) & 2) | ((s2 >> 3) & 4);
+    data[s0] ^= 1 << bit;
+    return 1;
+  }
+  if (bits(s0) + bits(s1) + bits(s2) == 1) {
+    return 2;
+  }
+  return -1;
+}
+
+/**
+ * @brief Address of a code.
+ *
+ * @param sector The sector.
+ * @param g The generation.
+ * @param slot The page in the sector.
+ */
+static unsigned int code_addr(unsigned int sector, unsigned int g, unsigned int slot)
+{
+  return (parity_subsector + sector) * info.subsector_bytes + g * area_bytes + slot * CODE_BYTES;
+}
+
+/**
+ * @brief Address of a commit mark.
+ */
+static unsigned int mark_addr(unsigned int sector, unsigned int g)
+{
+  return (parity_subsector + sector) * info.subsector_bytes + GENERATIONS * area_bytes + g;
+}
+
+/**
+ * @brief Program bytes which can cross page boundaries.
+ */
+static int program(unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  unsigned int n;
+
+  while (siz > 0) {
+    n = info.page_bytes - (addr % info.page_bytes);
+    if (n > siz) {
+      n = siz;
+    }
+    if (flash_program(addr, buf, n) != 0) {
+      return -1;
+    }
+    addr += n;
+    buf += n;
+    siz -= n;
+  }
+  return 0;
+}
+
+/**
+ * @brief Check that bytes are erased.
+ */
+static int erased(const unsigned char *buf, unsigned int siz)
+{
+  unsigned int i;
+  for (i = 0; i < siz; i++) {
+    if (buf[i] != 0xFF) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Find the current generation of a sector.
+ *
+ * @param sector The sector.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int gen_find(unsigned int sector)
+{
+  unsigned char m[GENERATIONS];
+  unsigned int g;
+
+  if (flash_read(mark_addr(sector, 0), m, GENERATIONS) != 0) {
+    return -1;
+  }
+  gen[sector] = GEN_NONE;
+  for (g = 0; g < GENERATIONS; g++) {
+    if (m[g] == 0x00) {
+      gen[sector] = g;
+    } else if (m[g] != 0xFF) {
+      gen[sector] = GEN_NONE;
+      break;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Write the parity buffer as the next generation.
+ * @details
+ * A generation with programmed bytes, left by a power loss, is skipped.
+ * The parity subsector is erased when no generation is left.
+ *
+ * @param sector The sector.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int gen_write(unsigned int sector)
+{
+  unsigned char zero = 0x00;
+  unsigned int g = (gen[sector] < GENERATIONS) ? gen[sector] + 1 : 0;
+  unsigned int i;
+
+  for (; g < GENERATIONS; g++) {
+    for (i = 0; i < area_bytes; i += PAGE_BYTES) {
+      if ((flash_read(code_addr(sector, g, 0) + i, page_buf, PAGE_BYTES) != 0)) {
+        return -1;
+      }
+      if (!erased(page_buf, PAGE_BYTES)) {
+        break;
+      }
+    }
+    if (i >= area_bytes) {
+      break;
+    }
+  }
+  if (g == GENERATIONS) {
+    if (flash_subsector_erase(parity_subsector + sector) != 0) {
+      return -1;
+    }
+    g = 0;
+  }
+  for (i = 0; i < area_bytes; i += PAGE_BYTES) {
+    if (!erased(parity + i, PAGE_BYTES) && (program(code_addr(sector, g, 0) + i, parity + i, PAGE_BYTES) != 0)) {
+      return -1;
+    }
+  }
+  if (program(mark_addr(sector, g), &zero, 1) != 0) {
+    return -1;
+  }
+  gen[sector] = g;
+  stats.generations++;
+  return 0;
+}
+
+/**
+ * @brief Compute the parity of a sector from the data.
+ * @details
+ * Used when the sector has no complete generation,
+ * e.g. on the first use or after a power loss during a parity erase.
+ *
+ * @param sector The sector.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int rebuild(unsigned int sector)
+{
+  unsigned int i;
+
+  for (i = 0; i < pages_per_sector; i++) {
+    if (flash_page_read(sector * pages_per_sector + i, page_buf, PAGE_BYTES) != 0) {
+      return -1;
+    }
+    flash_ecc_calculate(page_buf, parity + i * CODE_BYTES);
+  }
+  stats.rebuilds++;
+  return gen_write(sector);
+}
+
+/**
+ * @brief Make the current generation of a sector available.
+ *
+ * @param sector The sector.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int gen_ready(unsigned int sector)
+{
+  if (sector >= sector_count) {
+    return -1;
+  }
+  if ((gen[sector] == GEN_UNKNOWN) && (gen_find(sector) != 0)) {
+    return -1;
+  }
+  if (gen[sector] == GEN_NONE) {
+    return rebuild(sector);
+  }
+  return 0;
+}
+
+/**
+ * @brief Change codes of a sector through a new generation.
+ *
+ * @param sector The sector.
+ * @param slot The first page in the sector.
+ * @param count The number of pages.
+ * @param code The new code for SLOT_SET.
+ * @param op SLOT_SET or SLOT_ERASE.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int gen_update(unsigned int sector, unsigned int slot, unsigned int count, const unsigned char *code, int op)
+{
+  if (flash_read(code_addr(sector, gen[sector], 0), parity, area_bytes) != 0) {
+    return -1;
+  }
+  if (op == SLOT_SET) {
+    memcpy(parity + slot * CODE_BYTES, code, CODE_BYTES);
+  } else {
+    memset(parity + slot * CODE_BYTES, 0xFF, count * CODE_BYTES);
+  }
+  return gen_write(sector);
+}
+
+/**
+ * @brief Store the code of a page.
+ * @details
+ * The code is programmed in place if it only clears bits.
+ *
+ * @param page The page number.
+ * @param code The new code.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int code_store(unsigned int page, const unsigned char *code)
+{
+  unsigned int sector = page / pages_per_sector;
+  unsigned int slot = page % pages_per_sector;
+  unsigned int addr = code_addr(sector, gen[sector], slot);
+  unsigned char curr[CODE_BYTES];
+  unsigned int i;
+
+  if (flash_read(addr, curr, CODE_BYTES) != 0) {
+    return -1;
+  }
+  if (memcmp(code, curr, CODE_BYTES) == 0) {
+    return 0;
+  }
+  for (i = 0; i < CODE_BYTES; i++) {
+    if (code[i] & ~curr[i]) {
+      return gen_update(sector, slot, 1, code, SLOT_SET);
+    }
+  }
+  memcpy(curr, code, CODE_BYTES);
+  return program(addr, curr, CODE_BYTES);
+}
+
+/**
+ * @brief Initialize the ECC layer.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_ecc_init(void)
+{
+  int r = -1;
+
+  FLASH_LOCK(&ecc_lock);
+  if ((flash_info(&info) == 0) && (info.subsector_count != 0)
+      && (info.page_bytes == PAGE_BYTES)
+      && (info.sector_count <= FLASH_ECC_SECTOR_COUNT_MAX)
+      && (info.sector_count > FLASH_ECC_PARITY_SECTORS)) {
+    sector_count = info.sector_count - FLASH_ECC_PARITY_SECTORS;
+    pages_per_sector = info.sector_bytes / info.page_bytes;
+    area_bytes = pages_per_sector * CODE_BYTES;
+    parity_subsector = sector_count * (info.sector_bytes / info.subsector_bytes);
+    if ((pages_per_sector <= PAGES_PER_SECTOR_MAX)
+        && (GENERATIONS * area_bytes + GENERATIONS <= info.subsector_bytes)
+        && (parity_subsector + sector_count <= info.subsector_count)) {
+      memset(gen, GEN_UNKNOWN, sizeof(gen));
+      memset(&stats, 0, sizeof(stats));
+      r = 0;
+    }
+  }
+  FLASH_UNLOCK(&ecc_lock);
+  return r;
+}
+
+/**
+ * @brief Check a page in page_buf.
+ *
+ * @param page The page number.
+ *
+ * @retval 0 No error.
+ * @retval 1 Corrected.
+ * @retval 2 The stored code has a bit error.
+ * @retval -1 Uncorrectable or failure.
+ */
+static int check(unsigned int page)
+{
+  unsigned int sector = page / pages_per_sector;
+  unsigned char stored[CODE_BYTES];
+  unsigned char calc[CODE_BYTES];
+  int r;
+
+  if ((gen_ready(sector) != 0)
+      || (flash_page_read(page, page_buf, PAGE_BYTES) != 0)
+      || (flash_read(code_addr(sector, gen[sector], page % pages_per_sector), stored, CODE_BYTES) != 0)) {
+    return -1;
+  }
+  stats.pages++;
+  flash_ecc_calculate(page_buf, calc);
+  if (memcmp(stored, calc, CODE_BYTES) == 0) {
+    return 0;
+  }
+  r = flash_ecc_correct(page_buf, stored, calc);
+  switch (r) {
+    case 1:
+      stats.corrected++;
+      break;
+    case 2:
+      stats.code_errors++;
+      break;
+    default:
+      if (erased(page_buf, PAGE_BYTES)) {
+        /* A power loss between the data and the code. */
+        stats.stale++;
+        return 0;
+      }
+      stats.uncorrectable++;
+      break;
+  }
+  return r;
+}
+
+/**
+ * @brief Program bytes in a page with its code.
+ * @details
+ * The page is checked first, and the new code is computed from the
+ * corrected data, so a bit error already on the page does not get into
+ * the code. A page with a corrected error is programmed as a whole, which
+ * clears a bit read as 1 by mistake; a bit read as 0 by mistake stays an
+ * error which the new code corrects. An uncorrectable page is not written.
+ *
+ * The code of an erased page is stored before the data. A power loss
+ * between them leaves an erased page with a code, which check treats
+ * as erased. Otherwise the data is programmed first, and a power loss
+ * between them leaves the new data with the old code. Either order has
+ * such a window on a page with data, without a commit record.
+ *
+ * @param addr The byte address.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int update(unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  unsigned int page = addr / PAGE_BYTES;
+  unsigned int offset = addr % PAGE_BYTES;
+  unsigned char code[CODE_BYTES];
+  unsigned int i;
+  int blank;
+  int r;
+
+  if (offset + siz > PAGE_BYTES) {
+    return -1;
+  }
+  r = check(page);
+  if (r < 0) {
+    return -1;
+  }
+  blank = erased(page_buf, PAGE_BYTES);
+  for (i = 0; i < siz; i++) {
+    page_buf[offset + i] &= buf[i];
+  }
+  flash_ecc_calculate(page_buf, code);
+  if (r == 1) {
+    addr = page * PAGE_BYTES;
+    offset = 0;
+    siz = PAGE_BYTES;
+  }
+  if (blank) {
+    return ((code_store(page, code) == 0) && (flash_program(addr, page_buf + offset, siz) == 0)) ? 0 : -1;
+  }
+  return ((flash_program(addr, page_buf + offset, siz) == 0) && (code_store(page, code) == 0)) ? 0 : -1;
+}
+
+/**
+ * @brief Read and check a page.
+ *
+ * @param page The page number.
+ * @param buf The destination of FLASH_ECC_DATA_BYTES bytes with the corrected data.
+ *
+ * @retval 0 No error.
+ * @retval 1 Corrected. The page on the flash still has the error.
+ * @retval 2 The stored code of the page has a bit error.
+ * @retval -1 Uncorrectable or failure.
+ */
+int flash_ecc_page_check(unsigned int page, unsigned char *buf)
+{
+  int r;
+
+  FLASH_LOCK(&ecc_lock);
+  r = check(page);
+  memcpy(buf, page_buf, PAGE_BYTES);
+  FLASH_UNLOCK(&ecc_lock);
+  return r;
+}
+
+/**
+ * @brief Read data with correction.
+ *
+ * @param addr The byte address.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure or an uncorrectable page.
+ */
+int flash_ecc_read(unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  unsigned int offset, n;
+  int r = 0;
+
+  if ((addr + siz < addr) || (addr + siz > sector_count * info.sector_bytes)) {
+    return -1;
+  }
+  FLASH_LOCK(&ecc_lock);
+  while (siz > 0) {
+    offset = addr % PAGE_BYTES;
+    n = PAGE_BYTES - offset;
+    if (n > siz) {
+      n = siz;
+    }
+    if (check(addr / PAGE_BYTES) < 0) {
+      /* Go on with the rest and give the best data of the page. */
+      r = -1;
+    }
+    memcpy(buf, page_buf + offset, n);
+    addr += n;
+    buf += n;
+    siz -= n;
+  }
+  FLASH_UNLOCK(&ecc_lock);
+  return r;
+}
+
+/**
+ * @brief Read a page with correction.
+ *
+ * @param page The page number.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure or an uncorrectable page.
+ */
+int flash_ecc_page_read(unsigned int page, unsigned char *buf, unsigned int siz)
+{
+  if (siz > PAGE_BYTES) {
+    return -1;
+  }
+  return flash_ecc_read(page * PAGE_BYTES, buf, siz);
+}
+
+/**
+ * @brief Write a page and its code.
+ *
+ * @param page The page number.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_ecc_page_write(unsigned int page, unsigned char *buf, unsigned int siz)
+{
+  int r;
+
+  FLASH_LOCK(&ecc_lock);
+  r = update(page * PAGE_BYTES, buf, siz);
+  FLASH_UNLOCK(&ecc_lock);
+  return r;
+}
+
+/**
+ * @brief Program bytes in a page and update its code.
+ *
+ * @param addr The byte address.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_ecc_program(unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  int r;
+
+  FLASH_LOCK(&ecc_lock);
+  r = update(addr, buf, siz);
+  FLASH_UNLOCK(&ecc_lock);
+  return r;
+}
+
+/**
+ * @brief Erase a sector and its codes.
+ * @details
+ * The data is erased first. A power loss before the new generation
+ * leaves erased pages with old codes, which check treats as erased.
+ *
+ * @param sector The sector number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_ecc_sector_erase(unsigned int sector)
+{
+  int r = -1;
+
+  FLASH_LOCK(&ecc_lock);
+  if (sector < sector_count) {
+    if (gen[sector] == GEN_UNKNOWN) {
+      gen_find(sector);
+    }
+    if (flash_sector_erase(sector) == 0) {
+      memset(parity, 0xFF, area_bytes);
+      r = gen_write(sector);
+    }
+  }
+  FLASH_UNLOCK(&ecc_lock);
+  return r;
+}
+
+/**
+ * @brief Erase a subsector and its codes.
+ *
+ * @param subsector The subsector number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_ecc_subsector_erase(unsigned int subsector)
+{
+  unsigned int pages = info.subsector_bytes / PAGE_BYTES;
+  unsigned int sector = subsector * pages / pages_per_sector;
+  int r = -1;
+
+  FLASH_LOCK(&ecc_lock);
+  if ((gen_ready(sector) == 0) && (flash_subsector_erase(subsector) == 0)) {
+    r = gen_update(sector, subsector * pages % pages_per_sector, pages, 0, SLOT_ERASE);
+  }
+  FLASH_UNLOCK(&ecc_lock);
+  return r;
+}
+
+/**
+ * @brief Get the correction statistics.
+ *
+ * @param p The destination.
+ */
+void flash_ecc_stats(flash_ecc_stats_t *p)
+{
+  FLASH_LOCK(&ecc_lock);
+  *p = stats;
+  FLASH_UNLOCK(&ecc_lock);
+}
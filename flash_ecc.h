@@ -0,0 +1,227 @@
+/**
+ * @file flash_ecc.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_ECC_H
+#define FLASH_ECC_H
+
+/**
+ * @brief Number of data bytes covered by a code.
+ */
+#define FLASH_ECC_DATA_BYTES      (256)
+
+/**
+ * @brief Number of bytes of a code.
+ */
+#define FLASH_ECC_CODE_BYTES      (3)
+
+/**
+ * @brief Number of sectors at the end of the flash holding the parity.
+ * @details
+ * They are not available for data.
+ */
+#define FLASH_ECC_PARITY_SECTORS  (2)
+
+/**
+ * @brief Maximum number of sectors of the flash.
+ */
+#define FLASH_ECC_SECTOR_COUNT_MAX  (32)
+
+/**
+ * @brief Correction statistics.
+ */
+typedef struct {
+  unsigned long pages;          /**< Pages checked. */
+  unsigned long corrected;      /**< Single bit errors corrected in data. */
+  unsigned long code_errors;    /**< Single bit errors in the stored code. */
+  unsigned long uncorrectable;  /**< Pages with more than one bit error. */
+  unsigned long stale;          /**< Erased pages with the code of old data. */
+  unsigned long generations;    /**< Parity rewrites to a new generation. */
+  unsigned long rebuilds;       /**< Parity computed again from the data. */
+} flash_ecc_stats_t;
+
+/**
+ * @brief Calculate the code of a page.
+ * @details
+ * It is a Hamming code of 22 bits in the SmartMedia style:
+ * 16 line parities over the byte address and 6 column parities
+ * over the bit position, stored inverted so an erased page has
+ * an erased code. It corrects one bit and detects two.
+ *
+ * @param data FLASH_ECC_DATA_BYTES bytes.
+ * @param code FLASH_ECC_CODE_BYTES bytes.
+ */
+void flash_ecc_calculate(const unsigned char *data, unsigned char *code);
+
+/**
+ * @brief Correct a page.
+ *
+ * @param data FLASH_ECC_DATA_BYTES bytes.
+ * @param stored The stored code.
+ * @param calc The code calculated from the data.
+ *
+ * @retval 0 No error.
+ * @retval 1 A bit error in the data was corrected.
+ * @retval 2 A bit error in the stored code was found. The data is good.
+ * @retval -1 Uncorrectable.
+ */
+int flash_ecc_correct(unsigned char *data, const unsigned char *stored, const unsigned char *calc);
+
+/**
+ * @brief Initialize the ECC layer.
+ * @details
+ * The parity of a sector is kept in a subsector of the parity sectors
+ * as generations. A generation is a code for each page of the sector.
+ * A change of a code which sets bits, and an erase of data, write
+ * the codes to the next generation. When all generations are used,
+ * the parity subsector is erased. The parity of a sector without
+ * a generation is computed from the data on the first access.
+ *
+ * It fails on a flash without the subsector erase.
+ *
+ * Only the writes through the flash_ecc functions keep the codes.
+ * It is a layer beside flash.h, not under it: flash_page_write and
+ * flash_program, and the modules on them such as flash_fs, flash_loader
+ * and flash_shadow, are not protected, and their writes into the data
+ * sectors make the codes wrong. Give such a module its own area outside
+ * the ECC layer.
+ *
+ * The functions share a page buffer and the parity of a sector in static
+ * memory, guarded by a lock with FLASH_CONFIG_THREAD_SAFE and not reentrant
+ * without it. They call the flash functions under that lock, so a holder of
+ * flash_acquire must not call them while other threads use the layer.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_ecc_init(void);
+
+/**
+ * @brief Read and check a page.
+ *
+ * @param page The page number.
+ * @param buf The destination of FLASH_ECC_DATA_BYTES bytes with the corrected data.
+ *
+ * @retval 0 No error.
+ * @retval 1 Corrected. The page on the flash still has the error.
+ * @retval 2 The stored code of the page has a bit error.
+ * @retval -1 Uncorrectable or failure.
+ */
+int flash_ecc_page_check(unsigned int page, unsigned char *buf);
+
+/**
+ * @brief Read data with correction.
+ *
+ * @param addr The byte address.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure or an uncorrectable page.
+ */
+int flash_ecc_read(unsigned int addr, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Read a page with correction.
+ *
+ * @param page The page number.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure or an uncorrectable page.
+ */
+int flash_ecc_page_read(unsigned int page, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Write a page and its code.
+ * @details
+ * It has the power loss window of flash_ecc_program.
+ *
+ * @param page The page number.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_ecc_page_write(unsigned int page, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Program bytes in a page and update its code.
+ * @details
+ * The bytes must not cross the page boundary.
+ *
+ * On a page with data, the bytes are programmed before the code.
+ * A power loss between them leaves the new data with the old code.
+ * Then the page reads as uncorrectable, or, when the change is a single
+ * bit, it is corrected back to the old data. Rewrite such a page after
+ * the restart if the write was not known to be complete.
+ *
+ * @param addr The byte address.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_ecc_program(unsigned int addr, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Erase a sector and its codes.
+ *
+ * @param sector The sector number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_ecc_sector_erase(unsigned int sector);
+
+/**
+ * @brief Erase a subsector and its codes.
+ *
+ * @param subsector The subsector number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_ecc_subsector_erase(unsigned int subsector);
+
+/**
+ * @brief Get the correction statistics.
+ *
+ * @param p The destination.
+ */
+void flash_ecc_stats(flash_ecc_stats_t *p);
+
+#endif
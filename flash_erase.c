@@ -0,0 +1,186 @@
+/**
+ * @file flash_erase.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "flash.h"
+#include "flash_erase.h"
+
+/**
+ * @brief Make an erase plan.
+ *
+ * @param ranges The address ranges.
+ * @param count The number of the address ranges.
+ * @param plan The erase plan.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure or a range touches a protected sector.
+ */
+int flash_erase_plan(const flash_erase_range_t *ranges, unsigned int count, flash_erase_plan_t *plan)
+{
+  flash_info_t info;
+  unsigned int unit;
+  unsigned int per;
+  unsigned int full;
+  unsigned int limit;
+  unsigned int sector;
+  unsigned int i;
+  int all = 1;
+  int r;
+
+  if (flash_info(&info) != 0) {
+    return -1;
+  }
+  if (FLASH_ERASE_SECTOR_COUNT_MAX < info.sector_count) {
+    return -1;
+  }
+
+  /*
+   * Without the subsector erase the smallest unit is a sector,
+   * and the whole sector is in the mask.
+   */
+  if (info.subsector_count != 0) {
+    unit = info.subsector_bytes;
+    per = info.sector_bytes / info.subsector_bytes;
+  } else {
+    unit = info.sector_bytes;
+    per = 1;
+  }
+  if (FLASH_ERASE_SUBSECTOR_PER_SECTOR_MAX < per) {
+    return -1;
+  }
+  full = (1 << per) - 1;
+  limit = info.sector_count * info.sector_bytes;
+
+  memset(plan, 0, sizeof(*plan));
+  for (i = 0; i < count; i++) {
+    unsigned int n;
+    if (ranges[i].siz == 0) {
+      continue;
+    }
+    if ((limit < ranges[i].addr + ranges[i].siz) || (ranges[i].addr + ranges[i].siz < ranges[i].addr)) {
+      return -1;
+    }
+    for (n = ranges[i].addr / unit; n <= (ranges[i].addr + ranges[i].siz - 1) / unit; n++) {
+      plan->subsector[n / per] |= 1 << (n % per);
+    }
+  }
+
+  for (sector = 0; sector < info.sector_count; sector++) {
+    unsigned int mask = plan->subsector[sector];
+    unsigned int n = 0;
+
+    if (mask != full) {
+      all = 0;
+    }
+    if (mask == 0) {
+      continue;
+    }
+    r = flash_sector_protected(sector);
+    if (r != 0) {
+      return -1;
+    }
+
+    for (i = 0; i < per; i++) {
+      if (mask & (1 << i)) {
+        n++;
+      }
+    }
+    if ((mask == full) && ((per == 1) || (info.sector_erase_ms <= n * info.subsector_erase_ms))) {
+      plan->sector[sector] = FLASH_ERASE_SECTOR;
+      plan->time_ms += info.sector_erase_ms;
+    } else {
+      plan->sector[sector] = FLASH_ERASE_SUBSECTOR;
+      plan->time_ms += n * info.subsector_erase_ms;
+    }
+  }
+
+  /*
+   * The bulk erase is a candidate only when the whole flash is in the ranges.
+   * All sectors have been checked against the protection above.
+   */
+  if (all && (info.bulk_erase_ms < plan->time_ms)) {
+    plan->bulk = 1;
+    plan->time_ms = info.bulk_erase_ms;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Execute an erase plan.
+ *
+ * @param plan The erase plan.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_erase_execute(const flash_erase_plan_t *plan)
+{
+  flash_info_t info;
+  unsigned int sector;
+  unsigned int per;
+  unsigned int i;
+
+  if (plan->bulk) {
+    return flash_bulk_erase();
+  }
+
+  if (flash_info(&info) != 0) {
+    return -1;
+  }
+  per = (info.subsector_count != 0) ? (info.sector_bytes / info.subsector_bytes) : 1;
+
+  for (sector = 0; sector < info.sector_count; sector++) {
+    switch (plan->sector[sector]) {
+      case FLASH_ERASE_SECTOR:
+        if (flash_sector_erase(sector) != 0) {
+          return -1;
+        }
+        break;
+      case FLASH_ERASE_SUBSECTOR:
+        for (i = 0; i < per; i++) {
+          if (plan->subsector[sector] & (1 << i)) {
+            if (flash_subsector_erase(sector * per + i) != 0) {
+              return -1;
+            }
+          }
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file flash_erase.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_ERASE_H
+#define FLASH_ERASE_H
+
+/**
+ * @brief Maximum number of sectors the planner can handle.
+ */
+#define FLASH_ERASE_SECTOR_COUNT_MAX    (32)
+
+/**
+ * @brief Maximum number of subsectors in a sector.
+ */
+#define FLASH_ERASE_SUBSECTOR_PER_SECTOR_MAX  (16)
+
+#define FLASH_ERASE_NONE                (0)
+#define FLASH_ERASE_SUBSECTOR           (1)
+#define FLASH_ERASE_SECTOR              (2)
+
+/**
+ * @brief Address range to erase.
+ */
+typedef struct {
+  unsigned int addr;
+  unsigned int siz;
+} flash_erase_range_t;
+
+/**
+ * @brief Erase plan.
+ * @details
+ * With bulk set, the whole flash is erased by one bulk erase.
+ * Otherwise each sector is erased by FLASH_ERASE_SECTOR,
+ * by FLASH_ERASE_SUBSECTOR for the subsectors in the mask, or not at all.
+ */
+typedef struct {
+  int bulk;
+  unsigned int time_ms;
+  unsigned char sector[FLASH_ERASE_SECTOR_COUNT_MAX];
+  unsigned short subsector[FLASH_ERASE_SECTOR_COUNT_MAX];
+} flash_erase_plan_t;
+
+/**
+ * @brief Make an erase plan.
+ * @details
+ * The ranges are rounded out to the smallest erase unit of the flash.
+ * The plan never erases outside the rounded ranges, and among those
+ * plans it takes the one with the lowest typical erase time of flash_info.
+ * The bulk erase is taken only if no sector is protected.
+ *
+ * @param ranges The address ranges.
+ * @param count The number of the address ranges.
+ * @param plan The erase plan.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure or a range touches a protected sector.
+ */
+int flash_erase_plan(const flash_erase_range_t *ranges, unsigned int count, flash_erase_plan_t *plan);
+
+/**
+ * @brief Execute an erase plan.
+ *
+ * @param plan The erase plan.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_erase_execute(const flash_erase_plan_t *plan);
+
+#endif
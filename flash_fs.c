@@ -0,0 +1,1346 @@
+/**
+ * @file flash_fs.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "flash.h"
+#include "flash_fs.h"
+#include "flash_lock.h"
+#include "flash_util.h"
+
+/*
+ * Layout
+ *
+ * Blocks 0 and 1 are the anchor pair. Each of them holds a header and
+ * the blocks of the metadata pair. The block with the higher revision
+ * and a valid CRC is taken.
+ *
+ * Each block of the metadata pair starts with a header followed by a log
+ * of commits. A commit carries entry records and a CRC. On mount the block
+ * with the higher revision and a valid first commit is replayed up to the
+ * first invalid commit. When the log is full, all entries are written to
+ * the other block with the next revision. After FLASH_FS_META_MOVES of
+ * these compactions the entries are written to two free blocks, which
+ * become the metadata pair when the other anchor block points to them.
+ *
+ * A file is a CTZ skip-list: block i of a file starts with ctz(i) + 1
+ * pointers, to the blocks i - 1, i - 2, i - 4, ..., i - 2^ctz(i).
+ * Block 0 has no pointers. An entry refers to the last block only.
+ * Appending copies the partial last block, so the committed blocks
+ * are never modified.
+ *
+ * A block is free if neither an entry nor an open file reaches it
+ * and it is not in the anchor or the metadata pair.
+ * The allocator marks the used blocks in a window of FLASH_FS_LOOKAHEAD
+ * blocks and moves the window around the whole region.
+ */
+
+#define MAGIC               (0x31534654UL)
+#define ANCHOR_MAGIC        (0x41534654UL)
+#define HEADER_BYTES        (16)
+#define ANCHOR_BYTES        (HEADER_BYTES + 10)
+#define COMMIT_BYTES        (4)
+#define RECORD_BYTES        (12 + FLASH_FS_NAME_MAX)
+#define COMMIT_EMPTY        (0xFFFF)
+#define BLOCK_NONE          (0xFFFFFFFFUL)
+#define TYPE_NONE           (0)
+#define CHUNK_BYTES         (64)
+
+typedef struct {
+  int type;
+  unsigned int size;
+  unsigned int head;
+  char name[FLASH_FS_NAME_MAX];
+} entry_t;
+
+static flash_info_t info;
+static unsigned int base;
+static unsigned int block_count;
+static unsigned int block_bytes;
+static entry_t entry[FLASH_FS_FILE_MAX];
+static struct {
+  unsigned int block;
+  unsigned int rev;
+} anchor;
+static struct {
+  unsigned int pair[2];
+  unsigned int block;
+  unsigned int rev;
+  unsigned int offset;
+  int compact;
+} meta;
+static struct {
+  unsigned char map[FLASH_FS_LOOKAHEAD / 8];
+  unsigned int start;
+  unsigned int size;
+  unsigned int next;
+  unsigned int scanned;
+} lookahead;
+static flash_fs_file_t *files;
+static unsigned char chunk[CHUNK_BYTES];
+#ifdef FLASH_CONFIG_THREAD_SAFE
+static flash_lock_t fs_lock = FLASH_LOCK_INITIALIZER;
+#endif
+
+/**
+ * @brief Count the trailing zero bits.
+ *
+ * @param x The value, not 0.
+ */
+static unsigned int ctz(unsigned int x)
+{
+  unsigned int n = 0;
+  while ((x & 1) == 0) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+}
+
+/**
+ * @brief Count the one bits.
+ */
+static unsigned int popc(unsigned int x)
+{
+  unsigned int n = 0;
+  while (x) {
+    x &= x - 1;
+    n++;
+  }
+  return n;
+}
+
+/**
+ * @brief Find the block of a file position.
+ * @details
+ * Block i holds block_bytes - 4 * (ctz(i) + 1) data bytes, which sum up
+ * to a closed form with popc, so no loop over the blocks is needed.
+ *
+ * @param pos The byte position in the file.
+ * @param offset The byte offset in the block including the pointers.
+ *
+ * @return The block index in the file.
+ */
+static unsigned int ctz_index(unsigned int pos, unsigned int *offset)
+{
+  unsigned int b = block_bytes - 8;
+  unsigned int i = pos / b;
+
+  if (i == 0) {
+    *offset = pos;
+    return 0;
+  }
+  i = (pos - 4 * (popc(i - 1) + 2)) / b;
+  *offset = pos - b * i - 4 * popc(i);
+  return i;
+}
+
+/**
+ * @brief Read bytes from a block.
+ */
+static int block_read(unsigned int block, unsigned int offset, unsigned char *buf, unsigned int siz)
+{
+  return flash_read((base + block) * block_bytes + offset, buf, siz);
+}
+
+/**
+ * @brief Program bytes to a block.
+ * @details
+ * The bytes can cross page boundaries.
+ */
+static int block_program(unsigned int block, unsigned int offset, unsigned char *buf, unsigned int siz)
+{
+  unsigned int addr = (base + block) * block_bytes + offset;
+  unsigned int n;
+
+  while (siz > 0) {
+    n = info.page_bytes - (addr % info.page_bytes);
+    if (n > siz) {
+      n = siz;
+    }
+    if (flash_program(addr, buf, n) != 0) {
+      return -1;
+    }
+    addr += n;
+    buf += n;
+    siz -= n;
+  }
+  return 0;
+}
+
+/**
+ * @brief Erase a block.
+ */
+static int block_erase(unsigned int block)
+{
+  if (info.subsector_count != 0) {
+    return flash_subsector_erase(base + block);
+  }
+  return flash_sector_erase(base + block);
+}
+
+/**
+ * @brief Read a skip-list pointer.
+ *
+ * @param block The block.
+ * @param n The pointer number.
+ * @param p The pointed block.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int pointer(unsigned int block, unsigned int n, unsigned int *p)
+{
+  unsigned char b[4];
+
+  if (block_read(block, 4 * n, b, 4) != 0) {
+    return -1;
+  }
+  *p = flash_util_get32(b);
+  return (*p < block_count) ? 0 : -1;
+}
+
+/**
+ * @brief Find a block of a file.
+ * @details
+ * It takes the longest jump not beyond the target on each step.
+ *
+ * @param head The last block of the file.
+ * @param index The index of the last block.
+ * @param target The index of the block to find.
+ * @param block The found block.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int find(unsigned int head, unsigned int index, unsigned int target, unsigned int *block)
+{
+  unsigned int n, d;
+
+  while (index > target) {
+    d = index - target;
+    for (n = 0; (2u << n) <= d; n++) {
+    }
+    if (n > ctz(index)) {
+      n = ctz(index);
+    }
+    if (pointer(head, n, &head) != 0) {
+      return -1;
+    }
+    index -= 1u << n;
+  }
+  *block = head;
+  return 0;
+}
+
+/**
+ * @brief Mark a block used in the lookahead window.
+ */
+static void mark(unsigned int block)
+{
+  unsigned int i = (block + block_count - lookahead.start) % block_count;
+  if (i < lookahead.size) {
+    lookahead.map[i / 8] |= 1 << (i % 8);
+  }
+}
+
+/**
+ * @brief Mark all blocks of a file.
+ *
+ * @param head The last block.
+ * @param size The file size, which gives the index of the last block.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int mark_file(unsigned int head, unsigned int size)
+{
+  unsigned int offset;
+  unsigned int i;
+
+  if ((head == BLOCK_NONE) || (size == 0)) {
+    return 0;
+  }
+  for (i = ctz_index(size - 1, &offset); ; i--) {
+    mark(head);
+    if (i == 0) {
+      break;
+    }
+    if (pointer(head, 0, &head) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Fill the lookahead window.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int scan(void)
+{
+  flash_fs_file_t *f;
+  unsigned int i;
+
+  memset(lookahead.map, 0, sizeof(lookahead.map));
+  lookahead.next = 0;
+  mark(0);
+  mark(1);
+  mark(meta.pair[0]);
+  mark(meta.pair[1]);
+  for (i = 0; i < FLASH_FS_FILE_MAX; i++) {
+    if ((entry[i].type == FLASH_FS_TYPE_FILE) && (mark_file(entry[i].head, entry[i].size) != 0)) {
+      return -1;
+    }
+  }
+  for (f = files; f; f = f->next) {
+    if (f->fresh) {
+      /* The last block can be empty yet. */
+      mark(f->head);
+    }
+    if (mark_file(f->head, f->size) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Allocate an erased block.
+ *
+ * @param block The block.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure or no free block.
+ */
+static int alloc(unsigned int *block)
+{
+  unsigned int i;
+
+  for (;;) {
+    while (lookahead.next < lookahead.size) {
+      i = lookahead.next++;
+      if ((lookahead.map[i / 8] & (1 << (i % 8))) == 0) {
+        lookahead.map[i / 8] |= 1 << (i % 8);
+        lookahead.scanned = 0;
+        *block = (lookahead.start + i) % block_count;
+        return block_erase(*block);
+      }
+    }
+    if (lookahead.scanned >= block_count) {
+      /* A full turn found nothing. The next call takes another turn. */
+      lookahead.scanned = 0;
+      return -1;
+    }
+    lookahead.start = (lookahead.start + lookahead.size) % block_count;
+    lookahead.scanned += lookahead.size;
+    if (scan() != 0) {
+      return -1;
+    }
+  }
+}
+
+/**
+ * @brief Encode an entry record.
+ */
+static void record_encode(unsigned char *p, unsigned int slot, const entry_t *e)
+{
+  p[0] = slot;
+  p[1] = e->type;
+  p[2] = 0;
+  p[3] = 0;
+  flash_util_put32(p + 4, e->size);
+  flash_util_put32(p + 8, e->head);
+  memset(p + 12, 0, FLASH_FS_NAME_MAX);
+  if (e->type != TYPE_NONE) {
+    strcpy((char *)p + 12, e->name);
+  }
+}
+
+/**
+ * @brief Apply an entry record.
+ *
+ * @retval 0 Success.
+ * @retval !0 Malformed record.
+ */
+static int record_apply(const unsigned char *p)
+{
+  entry_t *e;
+
+  if ((p[0] >= FLASH_FS_FILE_MAX) || (p[1] > FLASH_FS_TYPE_DIR) || (p[12 + FLASH_FS_NAME_MAX - 1] != 0)) {
+    return -1;
+  }
+  e = &entry[p[0]];
+  e->type = p[1];
+  e->size = flash_util_get32(p + 4);
+  e->head = flash_util_get32(p + 8);
+  memcpy(e->name, p + 12, FLASH_FS_NAME_MAX);
+  return 0;
+}
+
+/**
+ * @brief Check a commit.
+ *
+ * @param block The metadata block.
+ * @param offset The offset of the commit.
+ * @param count The number of records.
+ *
+ * @retval 0 Valid.
+ * @retval 1 No more commits.
+ * @retval -1 Failure.
+ */
+static int commit_check(unsigned int block, unsigned int offset, unsigned int *count)
+{
+  unsigned char b[RECORD_BYTES];
+  unsigned int crc, expected;
+  unsigned int i;
+
+  if (offset + COMMIT_BYTES > block_bytes) {
+    return 1;
+  }
+  if (block_read(block, offset, b, COMMIT_BYTES) != 0) {
+    return -1;
+  }
+  *count = b[0] | (b[1] << 8);
+  expected = b[2] | (b[3] << 8);
+  if ((*count == COMMIT_EMPTY) || (*count > FLASH_FS_FILE_MAX)
+      || (offset + COMMIT_BYTES + *count * RECORD_BYTES > block_bytes)) {
+    return 1;
+  }
+  crc = flash_util_crc16(0xFFFF, b, 2);
+  for (i = 0; i < *count; i++) {
+    if (block_read(block, offset + COMMIT_BYTES + i * RECORD_BYTES, b, RECORD_BYTES) != 0) {
+      return -1;
+    }
+    crc = flash_util_crc16(crc, b, RECORD_BYTES);
+  }
+  return (crc == expected) ? 0 : 1;
+}
+
+/**
+ * @brief Replay the log of a metadata block.
+ *
+ * @param block The metadata block.
+ * @param apply Apply the records to the entries.
+ * @param offset The end of the log.
+ *
+ * @return The number of valid commits or -1 on failure.
+ */
+static int replay(unsigned int block, int apply, unsigned int *offset)
+{
+  unsigned char b[RECORD_BYTES];
+  unsigned int count;
+  unsigned int i;
+  int commits = 0;
+  int r;
+
+  *offset = HEADER_BYTES;
+  while ((r = commit_check(block, *offset, &count)) == 0) {
+    for (i = 0; apply && (i < count); i++) {
+      if ((block_read(block, *offset + COMMIT_BYTES + i * RECORD_BYTES, b, RECORD_BYTES) != 0)
+          || (record_apply(b) != 0)) {
+        return -1;
+      }
+    }
+    *offset += COMMIT_BYTES + count * RECORD_BYTES;
+    commits++;
+  }
+  return (r < 0) ? -1 : commits;
+}
+
+/**
+ * @brief Write a commit at the end of the log.
+ *
+ * @param slot The slots of the records.
+ * @param count The number of records.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int commit_write(const unsigned int *slot, unsigned int count)
+{
+  unsigned char b[RECORD_BYTES];
+  unsigned int crc;
+  unsigned int i;
+
+  b[0] = count & 0xFF;
+  b[1] = (count >> 8) & 0xFF;
+  crc = flash_util_crc16(0xFFFF, b, 2);
+  for (i = 0; i < count; i++) {
+    record_encode(b, slot[i], &entry[slot[i]]);
+    crc = flash_util_crc16(crc, b, RECORD_BYTES);
+    if (block_program(meta.block, meta.offset + COMMIT_BYTES + i * RECORD_BYTES, b, RECORD_BYTES) != 0) {
+      return -1;
+    }
+  }
+  b[0] = count & 0xFF;
+  b[1] = (count >> 8) & 0xFF;
+  b[2] = crc & 0xFF;
+  b[3] = (crc >> 8) & 0xFF;
+  if (block_program(meta.block, meta.offset, b, COMMIT_BYTES) != 0) {
+    return -1;
+  }
+  meta.offset += COMMIT_BYTES + count * RECORD_BYTES;
+  return 0;
+}
+
+/**
+ * @brief Write a header to a block.
+ *
+ * @param block The erased block.
+ * @param magic MAGIC or ANCHOR_MAGIC.
+ * @param rev The revision.
+ * @param pair The metadata pair for an anchor block, 0 otherwise.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int header_write(unsigned int block, unsigned long magic, unsigned int rev, const unsigned int *pair)
+{
+  unsigned char b[ANCHOR_BYTES];
+  unsigned int n = HEADER_BYTES;
+
+  flash_util_put32(b + 0, magic);
+  flash_util_put32(b + 4, rev);
+  flash_util_put32(b + 8, block_bytes);
+  flash_util_put32(b + 12, block_count);
+  if (pair) {
+    flash_util_put32(b + 16, pair[0]);
+    flash_util_put32(b + 20, pair[1]);
+    flash_util_put16(b + 24, flash_util_crc16(0xFFFF, b, 24));
+    n = ANCHOR_BYTES;
+  }
+  return block_program(block, 0, b, n);
+}
+
+/**
+ * @brief Write all entries to an erased block.
+ * @details
+ * It starts a new log with the next revision there.
+ *
+ * @param block The block.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int rewrite(unsigned int block)
+{
+  unsigned int slot[FLASH_FS_FILE_MAX];
+  unsigned int count = 0;
+  unsigned int i;
+
+  for (i = 0; i < FLASH_FS_FILE_MAX; i++) {
+    if (entry[i].type != TYPE_NONE) {
+      slot[count++] = i;
+    }
+  }
+  meta.block = block;
+  meta.rev++;
+  meta.offset = HEADER_BYTES;
+  meta.compact = 0;
+  if (header_write(block, MAGIC, meta.rev, 0) != 0) {
+    return -1;
+  }
+  return commit_write(slot, count);
+}
+
+/**
+ * @brief Write all entries to the other metadata block.
+ * @details
+ * The current block stays valid until the new one is complete.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int compact(void)
+{
+  unsigned int block = (meta.block == meta.pair[0]) ? meta.pair[1] : meta.pair[0];
+
+  if (block_erase(block) != 0) {
+    return -1;
+  }
+  return rewrite(block);
+}
+
+/**
+ * @brief Move the metadata pair to two free blocks.
+ * @details
+ * It runs after a compaction, when the entries in RAM are committed,
+ * so the allocator does not hand out a block the flash still refers to.
+ * The current pair stays valid until the other anchor block is complete.
+ * Without two free blocks the pair stays where it is.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int relocate(void)
+{
+  unsigned int pair[2];
+
+  /* A new window of the allocator does not know the first block. */
+  if ((alloc(&pair[0]) != 0) || (alloc(&pair[1]) != 0) || (pair[0] == pair[1])) {
+    return 0;
+  }
+  if (rewrite(pair[0]) != 0) {
+    return -1;
+  }
+  anchor.block ^= 1;
+  anchor.rev++;
+  if ((block_erase(anchor.block) != 0) || (header_write(anchor.block, ANCHOR_MAGIC, anchor.rev, pair) != 0)) {
+    return -1;
+  }
+  meta.pair[0] = pair[0];
+  meta.pair[1] = pair[1];
+  return 0;
+}
+
+/**
+ * @brief Load the anchor.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int anchor_load(void)
+{
+  unsigned char b[ANCHOR_BYTES];
+  unsigned int rev[2];
+  unsigned int pair[2][2];
+  unsigned int i;
+  int valid[2];
+
+  for (i = 0; i < 2; i++) {
+    valid[i] = 0;
+    if (block_read(i, 0, b, ANCHOR_BYTES) != 0) {
+      return -1;
+    }
+    rev[i] = flash_util_get32(b + 4);
+    pair[i][0] = flash_util_get32(b + 16);
+    pair[i][1] = flash_util_get32(b + 20);
+    valid[i] = (flash_util_get32(b) == ANCHOR_MAGIC)
+      && (flash_util_get32(b + 8) == block_bytes) && (flash_util_get32(b + 12) == block_count)
+      && (flash_util_get16(b + 24) == flash_util_crc16(0xFFFF, b, 24))
+      && (2 <= pair[i][0]) && (pair[i][0] < block_count)
+      && (2 <= pair[i][1]) && (pair[i][1] < block_count) && (pair[i][0] != pair[i][1]);
+  }
+  if (!valid[0] && !valid[1]) {
+    return -1;
+  }
+  if (valid[0] && valid[1]) {
+    anchor.block = ((int)(rev[1] - rev[0]) > 0) ? 1 : 0;
+  } else {
+    anchor.block = valid[1] ? 1 : 0;
+  }
+  anchor.rev = rev[anchor.block];
+  meta.pair[0] = pair[anchor.block][0];
+  meta.pair[1] = pair[anchor.block][1];
+  return 0;
+}
+
+/**
+ * @brief Load the metadata.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int load(void)
+{
+  unsigned char b[HEADER_BYTES];
+  unsigned int rev[2];
+  unsigned int offset;
+  unsigned int i, n;
+  int valid[2];
+
+  if (anchor_load() != 0) {
+    return -1;
+  }
+  for (i = 0; i < 2; i++) {
+    valid[i] = 0;
+    if (block_read(meta.pair[i], 0, b, HEADER_BYTES) != 0) {
+      return -1;
+    }
+    rev[i] = flash_util_get32(b + 4);
+    if ((flash_util_get32(b) == MAGIC) && (flash_util_get32(b + 8) == block_bytes) && (flash_util_get32(b + 12) == block_count)) {
+      valid[i] = replay(meta.pair[i], 0, &offset) > 0;
+    }
+  }
+  if (!valid[0] && !valid[1]) {
+    return -1;
+  }
+  if (valid[0] && valid[1]) {
+    i = ((int)(rev[1] - rev[0]) > 0) ? 1 : 0;
+  } else {
+    i = valid[1] ? 1 : 0;
+  }
+  meta.block = meta.pair[i];
+  meta.rev = rev[i];
+
+  memset(entry, 0, sizeof(entry));
+  if (replay(meta.block, 1, &meta.offset) <= 0) {
+    return -1;
+  }
+
+  /* An interrupted commit leaves programmed bytes after the log. */
+  meta.compact = 0;
+  for (offset = meta.offset; (offset < block_bytes) && !meta.compact; offset += n) {
+    n = ((block_bytes - offset) < CHUNK_BYTES) ? (block_bytes - offset) : CHUNK_BYTES;
+    if (block_read(meta.block, offset, chunk, n) != 0) {
+      return -1;
+    }
+    for (i = 0; i < n; i++) {
+      meta.compact |= (chunk[i] != 0xFF);
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Commit entries.
+ * @details
+ * The entries are changed in RAM already. They are loaded again on failure.
+ *
+ * @param slot The slots.
+ * @param count The number of slots.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int commit(const unsigned int *slot, unsigned int count)
+{
+  int r;
+
+  if (meta.compact || (meta.offset + COMMIT_BYTES + count * RECORD_BYTES > block_bytes)) {
+    r = compact();
+    if ((r == 0) && ((meta.rev % FLASH_FS_META_MOVES) == 0)) {
+      r = relocate();
+    }
+  } else {
+    r = commit_write(slot, count);
+  }
+  if (r != 0) {
+    load();
+  }
+  return r;
+}
+
+/**
+ * @brief Check a path.
+ *
+ * @retval 0 Valid.
+ * @retval !0 Invalid.
+ */
+static int name_check(const char *name)
+{
+  unsigned int n = strlen(name);
+
+  if ((n == 0) || (n >= FLASH_FS_NAME_MAX) || (name[0] == '/') || (name[n - 1] == '/')) {
+    return -1;
+  }
+  return strstr(name, "//") ? -1 : 0;
+}
+
+/**
+ * @brief Check whether the parent of a path is the directory.
+ *
+ * @param name The path.
+ * @param dir The directory or "" for the root.
+ */
+static int name_in(const char *name, const char *dir)
+{
+  const char *p = strrchr(name, '/');
+  unsigned int n = p ? (unsigned int)(p - name) : 0;
+
+  return (strlen(dir) == n) && (strncmp(name, dir, n) == 0);
+}
+
+/**
+ * @brief Find an entry.
+ *
+ * @return The slot or -1 if not found.
+ */
+static int lookup(const char *name)
+{
+  unsigned int i;
+
+  for (i = 0; i < FLASH_FS_FILE_MAX; i++) {
+    if ((entry[i].type != TYPE_NONE) && (strcmp(entry[i].name, name) == 0)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Find a free slot.
+ *
+ * @return The slot or -1 if the table is full.
+ */
+static int slot_free(void)
+{
+  unsigned int i;
+
+  for (i = 0; i < FLASH_FS_FILE_MAX; i++) {
+    if (entry[i].type == TYPE_NONE) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Check that the parent directory of a path exists.
+ *
+ * @retval 0 It exists.
+ * @retval !0 It does not exist.
+ */
+static int parent_check(const char *name)
+{
+  char dir[FLASH_FS_NAME_MAX];
+  const char *p = strrchr(name, '/');
+  int i;
+
+  if (p == 0) {
+    return 0;
+  }
+  memcpy(dir, name, p - name);
+  dir[p - name] = 0;
+  i = lookup(dir);
+  return ((i >= 0) && (entry[i].type == FLASH_FS_TYPE_DIR)) ? 0 : -1;
+}
+
+/**
+ * @brief Check whether a path is open.
+ */
+static int opened(const char *name)
+{
+  flash_fs_file_t *f;
+
+  for (f = files; f; f = f->next) {
+    if (strcmp(f->name, name) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Check whether a directory has entries.
+ */
+static int dir_used(const char *name)
+{
+  unsigned int i;
+
+  for (i = 0; i < FLASH_FS_FILE_MAX; i++) {
+    if ((entry[i].type != TYPE_NONE) && name_in(entry[i].name, name)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Make an empty file system.
+ *
+ * @param first The first block.
+ * @param count The number of blocks.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_format(unsigned int first, unsigned int count)
+{
+  int r;
+
+  FLASH_LOCK(&fs_lock);
+  r = -1;
+  if (flash_info(&info) == 0) {
+    block_bytes = info.subsector_count ? info.subsector_bytes : info.sector_bytes;
+    base = first;
+    block_count = count;
+    memset(entry, 0, sizeof(entry));
+    files = 0;
+    meta.pair[0] = 2;
+    meta.pair[1] = 3;
+    meta.block = 3;
+    meta.rev = 0;
+    anchor.block = 0;
+    anchor.rev = 1;
+    if ((count >= 5) && (block_bytes >= HEADER_BYTES + COMMIT_BYTES + FLASH_FS_FILE_MAX * RECORD_BYTES)
+        && ((first + count) * block_bytes <= info.sector_count * info.sector_bytes)
+        && (block_erase(1) == 0) && (block_erase(3) == 0) && (compact() == 0)
+        && (block_erase(0) == 0)) {
+      r = header_write(0, ANCHOR_MAGIC, anchor.rev, meta.pair);
+    }
+  }
+  FLASH_UNLOCK(&fs_lock);
+  if (r != 0) {
+    return -1;
+  }
+  return flash_fs_mount(first, count);
+}
+
+/**
+ * @brief Mount the file system.
+ *
+ * @param first The first block.
+ * @param count The number of blocks.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_mount(unsigned int first, unsigned int count)
+{
+  int r = -1;
+
+  FLASH_LOCK(&fs_lock);
+  if (flash_info(&info) == 0) {
+    block_bytes = info.subsector_count ? info.subsector_bytes : info.sector_bytes;
+    base = first;
+    block_count = count;
+    files = 0;
+    if ((count >= 5) && ((first + count) * block_bytes <= info.sector_count * info.sector_bytes)
+        && (load() == 0)) {
+      /*
+       * Start the allocator at a place which changes with the metadata,
+       * so the new blocks spread over the region across mounts.
+       */
+      lookahead.size = (count < FLASH_FS_LOOKAHEAD) ? count : FLASH_FS_LOOKAHEAD;
+      lookahead.start = (meta.rev * 7 + meta.offset) % count;
+      lookahead.scanned = 0;
+      r = scan();
+    }
+  }
+  FLASH_UNLOCK(&fs_lock);
+  return r;
+}
+
+/**
+ * @brief Open a file.
+ *
+ * @param f The file.
+ * @param name The path.
+ * @param mode FLASH_FS_READ, FLASH_FS_WRITE or FLASH_FS_APPEND.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_open(flash_fs_file_t *f, const char *name, int mode)
+{
+  flash_fs_file_t *p;
+  int i;
+  int r = -1;
+
+  if (name_check(name) != 0) {
+    return -1;
+  }
+  FLASH_LOCK(&fs_lock);
+  i = lookup(name);
+  for (p = files; p; p = p->next) {
+    if ((strcmp(p->name, name) == 0) && ((p->mode != FLASH_FS_READ) || (mode != FLASH_FS_READ))) {
+      break;
+    }
+  }
+  if ((p != 0) || ((i >= 0) && (entry[i].type != FLASH_FS_TYPE_FILE))) {
+    goto out;
+  }
+  if ((i < 0) && ((mode == FLASH_FS_READ) || (parent_check(name) != 0) || (slot_free() < 0))) {
+    goto out;
+  }
+  memset(f, 0, sizeof(*f));
+  strcpy(f->name, name);
+  f->mode = mode;
+  f->head = BLOCK_NONE;
+  f->block_index = BLOCK_NONE;
+  if ((i >= 0) && (mode != FLASH_FS_WRITE)) {
+    f->size = entry[i].size;
+    f->head = entry[i].head;
+  }
+  if (f->size != 0) {
+    unsigned int offset;
+    f->index = ctz_index(f->size - 1, &offset);
+  }
+  f->next = files;
+  files = f;
+  r = 0;
+out:
+  FLASH_UNLOCK(&fs_lock);
+  return r;
+}
+
+/**
+ * @brief Close a file.
+ *
+ * @param f The file.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_close(flash_fs_file_t *f)
+{
+  flash_fs_file_t **p;
+  unsigned int slot;
+  int i;
+  int r = 0;
+
+  FLASH_LOCK(&fs_lock);
+  for (p = &files; *p && (*p != f); p = &(*p)->next) {
+  }
+  if (*p == 0) {
+    FLASH_UNLOCK(&fs_lock);
+    return -1;
+  }
+  *p = f->next;
+  if (f->mode != FLASH_FS_READ) {
+    i = lookup(f->name);
+    if (i < 0) {
+      i = slot_free();
+    }
+    if (i < 0) {
+      r = -1;
+    } else {
+      slot = i;
+      entry[slot].type = FLASH_FS_TYPE_FILE;
+      entry[slot].size = f->size;
+      entry[slot].head = (f->size != 0) ? f->head : BLOCK_NONE;
+      strcpy(entry[slot].name, f->name);
+      r = commit(&slot, 1);
+    }
+  }
+  FLASH_UNLOCK(&fs_lock);
+  return r;
+}
+
+/**
+ * @brief Read from a file.
+ *
+ * @param f The file.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @return The number of bytes read, 0 at the end of the file or -1 on failure.
+ */
+int flash_fs_read(flash_fs_file_t *f, unsigned char *buf, unsigned int siz)
+{
+  unsigned int done = 0;
+  unsigned int index, offset, n;
+
+  FLASH_LOCK(&fs_lock);
+  while ((done < siz) && (f->pos < f->size)) {
+    index = ctz_index(f->pos, &offset);
+    if (index != f->block_index) {
+      if (find(f->head, f->index, index, &f->block) != 0) {
+        f->block_index = BLOCK_NONE;
+        FLASH_UNLOCK(&fs_lock);
+        return -1;
+      }
+      f->block_index = index;
+    }
+    n = block_bytes - offset;
+    if (n > siz - done) {
+      n = siz - done;
+    }
+    if (n > f->size - f->pos) {
+      n = f->size - f->pos;
+    }
+    if (block_read(f->block, offset, buf + done, n) != 0) {
+      FLASH_UNLOCK(&fs_lock);
+      return -1;
+    }
+    done += n;
+    f->pos += n;
+  }
+  FLASH_UNLOCK(&fs_lock);
+  return done;
+}
+
+/**
+ * @brief Start a new block for the position at the end of the file.
+ * @details
+ * A new block at the next index gets the skip-list pointers.
+ * A partial committed block is copied, since it must not be modified.
+ *
+ * @param f The file.
+ * @param index The block index of the end of the file.
+ * @param offset The offset in the block.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int extend(flash_fs_file_t *f, unsigned int index, unsigned int offset)
+{
+  unsigned char b[4];
+  unsigned int block, p, n, i;
+
+  if (alloc(&block) != 0) {
+    return -1;
+  }
+  if ((f->size == 0) || (index != f->index)) {
+    p = f->head;
+    for (i = 0; (f->size != 0) && (i <= ctz(index)); i++) {
+      flash_util_put32(b, p);
+      if (block_program(block, 4 * i, b, 4) != 0) {
+        return -1;
+      }
+      if ((i < ctz(index)) && (pointer(p, i, &p) != 0)) {
+        return -1;
+      }
+    }
+  } else {
+    for (i = 0; i < offset; i += n) {
+      n = ((offset - i) < CHUNK_BYTES) ? (offset - i) : CHUNK_BYTES;
+      if ((block_read(f->head, i, chunk, n) != 0) || (block_program(block, i, chunk, n) != 0)) {
+        return -1;
+      }
+    }
+  }
+  f->head = block;
+  f->index = index;
+  f->fresh = 1;
+  f->block_index = BLOCK_NONE;
+  return 0;
+}
+
+/**
+ * @brief Write to the end of a file.
+ *
+ * @param f The file.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_write(flash_fs_file_t *f, unsigned char *buf, unsigned int siz)
+{
+  unsigned int index, offset, n;
+  int r = 0;
+
+  if (f->mode == FLASH_FS_READ) {
+    return -1;
+  }
+  FLASH_LOCK(&fs_lock);
+  while (siz > 0) {
+    index = ctz_index(f->size, &offset);
+    if ((f->size == 0) || (index != f->index) || !f->fresh) {
+      if (extend(f, index, offset) != 0) {
+        r = -1;
+        break;
+      }
+    }
+    n = block_bytes - offset;
+    if (n > siz) {
+      n = siz;
+    }
+    if (block_program(f->head, offset, buf, n) != 0) {
+      r = -1;
+      break;
+    }
+    f->size += n;
+    buf += n;
+    siz -= n;
+  }
+  FLASH_UNLOCK(&fs_lock);
+  return r;
+}
+
+/**
+ * @brief Set the read position.
+ *
+ * @param f The file.
+ * @param pos The byte position.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_seek(flash_fs_file_t *f, unsigned int pos)
+{
+  if (pos > f->size) {
+    return -1;
+  }
+  f->pos = pos;
+  return 0;
+}
+
+/**
+ * @brief Make a directory.
+ *
+ * @param name The path.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_mkdir(const char *name)
+{
+  unsigned int slot;
+  int i;
+  int r = -1;
+
+  if (name_check(name) != 0) {
+    return -1;
+  }
+  FLASH_LOCK(&fs_lock);
+  i = slot_free();
+  if ((lookup(name) < 0) && (parent_check(name) == 0) && (i >= 0)) {
+    slot = i;
+    entry[slot].type = FLASH_FS_TYPE_DIR;
+    entry[slot].size = 0;
+    entry[slot].head = BLOCK_NONE;
+    strcpy(entry[slot].name, name);
+    r = commit(&slot, 1);
+  }
+  FLASH_UNLOCK(&fs_lock);
+  return r;
+}
+
+/**
+ * @brief Remove a file or an empty directory.
+ *
+ * @param name The path.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_remove(const char *name)
+{
+  unsigned int slot;
+  int i;
+  int r = -1;
+
+  FLASH_LOCK(&fs_lock);
+  i = lookup(name);
+  if ((i >= 0) && !opened(name) && ((entry[i].type != FLASH_FS_TYPE_DIR) || !dir_used(name))) {
+    slot = i;
+    entry[slot].type = TYPE_NONE;
+    r = commit(&slot, 1);
+  }
+  FLASH_UNLOCK(&fs_lock);
+  return r;
+}
+
+/**
+ * @brief Rename a file or an empty directory.
+ * @details
+ * Both changes are in one commit, so a power loss leaves either name.
+ *
+ * @param from The current path.
+ * @param to The new path.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_rename(const char *from, const char *to)
+{
+  unsigned int slot[2];
+  unsigned int count = 1;
+  int i, j;
+  int r = -1;
+
+  if (name_check(to) != 0) {
+    return -1;
+  }
+  FLASH_LOCK(&fs_lock);
+  i = lookup(from);
+  j = lookup(to);
+  if ((i < 0) || (i == j) || opened(from) || opened(to) || (parent_check(to) != 0)) {
+    goto out;
+  }
+  if ((entry[i].type == FLASH_FS_TYPE_DIR) && dir_used(from)) {
+    goto out;
+  }
+  if ((j >= 0) && ((entry[i].type != FLASH_FS_TYPE_FILE) || (entry[j].type != FLASH_FS_TYPE_FILE))) {
+    goto out;
+  }
+  slot[0] = i;
+  strcpy(entry[i].name, to);
+  if (j >= 0) {
+    slot[count++] = j;
+    entry[j].type = TYPE_NONE;
+  }
+  r = commit(slot, count);
+out:
+  FLASH_UNLOCK(&fs_lock);
+  return r;
+}
+
+/**
+ * @brief Get the information of a file or a directory.
+ *
+ * @param name The path.
+ * @param st The information.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_stat(const char *name, flash_fs_stat_t *st)
+{
+  int i;
+
+  FLASH_LOCK(&fs_lock);
+  i = lookup(name);
+  if (i >= 0) {
+    strcpy(st->name, entry[i].name);
+    st->type = entry[i].type;
+    st->size = entry[i].size;
+  }
+  FLASH_UNLOCK(&fs_lock);
+  return (i >= 0) ? 0 : -1;
+}
+
+/**
+ * @brief Read a directory.
+ *
+ * @param name The path of the directory or "" for the root.
+ * @param pos The position.
+ * @param st The information of the entry.
+ *
+ * @retval 0 An entry is returned.
+ * @retval 1 No more entries.
+ * @retval -1 Failure.
+ */
+int flash_fs_dir(const char *name, unsigned int *pos, flash_fs_stat_t *st)
+{
+  int r = 1;
+
+  FLASH_LOCK(&fs_lock);
+  for (; (*pos < FLASH_FS_FILE_MAX) && (r == 1); (*pos)++) {
+    if ((entry[*pos].type != TYPE_NONE) && name_in(entry[*pos].name, name)) {
+      strcpy(st->name, entry[*pos].name);
+      st->type = entry[*pos].type;
+      st->size = entry[*pos].size;
+      r = 0;
+    }
+  }
+  FLASH_UNLOCK(&fs_lock);
+  return r;
+}
@@ -0,0 +1,258 @@
+/**
+ * @file flash_fs.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_FS_H
+#define FLASH_FS_H
+
+/**
+ * @brief Maximum length of a path including the terminating null.
+ */
+#define FLASH_FS_NAME_MAX       (36)
+
+/**
+ * @brief Maximum number of files and directories.
+ */
+#define FLASH_FS_FILE_MAX       (32)
+
+/**
+ * @brief Number of blocks the allocator looks at once.
+ * @details
+ * It takes FLASH_FS_LOOKAHEAD / 8 bytes of RAM.
+ */
+#define FLASH_FS_LOOKAHEAD      (128)
+
+/**
+ * @brief Number of compactions of the metadata before it moves.
+ * @details
+ * The two metadata blocks are erased in turn each time their log is full.
+ * After this number of compactions the metadata moves to two free blocks,
+ * so the erases spread over the region. The anchor blocks which point to
+ * the metadata are erased once per move.
+ */
+#define FLASH_FS_META_MOVES     (16)
+
+#define FLASH_FS_TYPE_FILE      (1)
+#define FLASH_FS_TYPE_DIR       (2)
+
+#define FLASH_FS_READ           (0)
+#define FLASH_FS_WRITE          (1)
+#define FLASH_FS_APPEND         (2)
+
+/**
+ * @brief Open file.
+ * @details
+ * The caller owns the memory. The members are private.
+ */
+typedef struct flash_fs_file {
+  struct flash_fs_file *next;
+  char name[FLASH_FS_NAME_MAX];
+  int mode;
+  unsigned int size;
+  unsigned int head;
+  unsigned int index;
+  int fresh;
+  unsigned int pos;
+  unsigned int block;
+  unsigned int block_index;
+} flash_fs_file_t;
+
+/**
+ * @brief File or directory information.
+ */
+typedef struct {
+  char name[FLASH_FS_NAME_MAX];
+  int type;
+  unsigned int size;
+} flash_fs_stat_t;
+
+/**
+ * @brief Make an empty file system.
+ * @details
+ * The file system takes count blocks from the block first.
+ * A block is a subsector, or a sector if the flash has no subsector erase.
+ * The first two blocks are the anchor, which points to the two blocks of
+ * the metadata. count must be 5 or more.
+ *
+ * @param first The first block.
+ * @param count The number of blocks.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_format(unsigned int first, unsigned int count);
+
+/**
+ * @brief Mount the file system.
+ * @details
+ * The state after the last complete update is taken.
+ * An update interrupted by a power loss is discarded.
+ *
+ * @param first The first block.
+ * @param count The number of blocks.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_mount(unsigned int first, unsigned int count);
+
+/**
+ * @brief Open a file.
+ * @details
+ * The path is relative to the root and the components are separated by '/'.
+ * The parent directory must exist.
+ *
+ * FLASH_FS_WRITE makes a new empty file and FLASH_FS_APPEND continues
+ * the existing one. The written data appear at flash_fs_close.
+ * Until then the readers and a power loss see the previous contents.
+ *
+ * @param f The file.
+ * @param name The path.
+ * @param mode FLASH_FS_READ, FLASH_FS_WRITE or FLASH_FS_APPEND.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_open(flash_fs_file_t *f, const char *name, int mode);
+
+/**
+ * @brief Close a file.
+ * @details
+ * A file opened for writing is committed.
+ *
+ * @param f The file.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_close(flash_fs_file_t *f);
+
+/**
+ * @brief Read from a file.
+ *
+ * @param f The file.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @return The number of bytes read, 0 at the end of the file or -1 on failure.
+ */
+int flash_fs_read(flash_fs_file_t *f, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Write to the end of a file.
+ *
+ * @param f The file.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_write(flash_fs_file_t *f, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Set the read position.
+ * @details
+ * The block of the position is found in O(log n) block reads.
+ *
+ * @param f The file.
+ * @param pos The byte position.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_seek(flash_fs_file_t *f, unsigned int pos);
+
+/**
+ * @brief Make a directory.
+ *
+ * @param name The path.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_mkdir(const char *name);
+
+/**
+ * @brief Remove a file or an empty directory.
+ * @details
+ * It fails while the file is open.
+ *
+ * @param name The path.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_remove(const char *name);
+
+/**
+ * @brief Rename a file or an empty directory.
+ * @details
+ * An existing file with the new name is replaced.
+ * It fails while either file is open.
+ *
+ * @param from The current path.
+ * @param to The new path.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_rename(const char *from, const char *to);
+
+/**
+ * @brief Get the information of a file or a directory.
+ *
+ * @param name The path.
+ * @param st The information.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_fs_stat(const char *name, flash_fs_stat_t *st);
+
+/**
+ * @brief Read a directory.
+ * @details
+ * Set *pos to 0 for the first entry.
+ *
+ * @param name The path of the directory or "" for the root.
+ * @param pos The position.
+ * @param st The information of the entry.
+ *
+ * @retval 0 An entry is returned.
+ * @retval 1 No more entries.
+ * @retval -1 Failure.
+ */
+int flash_fs_dir(const char *name, unsigned int *pos, flash_fs_stat_t *st);
+
+#endif
@@ -0,0 +1,284 @@
+/**
+ * @file flash_health.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "flash.h"
+#include "flash_lock.h"
+#include "flash_util.h"
+#include "flash_health.h"
+
+#define TABLE_MAGIC     "HLTH"
+#define TABLE_VERSION   (1)
+
+static flash_info_t info;
+static flash_health_sector_t table[FLASH_HEALTH_SECTOR_COUNT_MAX];
+#ifdef FLASH_CONFIG_THREAD_SAFE
+static flash_lock_t health_lock = FLASH_LOCK_INITIALIZER;
+#endif
+
+/**
+ * @brief Update an exponential average.
+ *
+ * @param avg The average.
+ * @param us The new sample.
+ */
+static void average(unsigned long *avg, unsigned long us)
+{
+  if (*avg == 0) {
+    *avg = us;
+  } else if (us >= *avg) {
+    *avg += (us - *avg) >> FLASH_HEALTH_EWMA_SHIFT;
+  } else {
+    *avg -= (*avg - us) >> FLASH_HEALTH_EWMA_SHIFT;
+  }
+}
+
+/**
+ * @brief Check an average against the datasheet.
+ *
+ * @param avg The average in microseconds.
+ * @param typ_us The typical time in microseconds.
+ * @param max_us The maximum time in microseconds.
+ *
+ * @return 1 if the average is past the threshold.
+ */
+static int slow(unsigned long avg, unsigned long typ_us, unsigned long max_us)
+{
+  if ((avg == 0) || (max_us <= typ_us)) {
+    return 0;
+  }
+  return avg >= typ_us + (max_us - typ_us) / 100 * FLASH_HEALTH_SLOW_PERCENT;
+}
+
+/**
+ * @brief Initialize the health tracking.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_health_init(void)
+{
+  flash_info_t p;
+  if (flash_info(&p) != 0) {
+    return -1;
+  }
+  if (FLASH_HEALTH_SECTOR_COUNT_MAX < p.sector_count) {
+    return -1;
+  }
+  FLASH_LOCK(&health_lock);
+  info = p;
+  memset(table, 0, sizeof(table));
+  FLASH_UNLOCK(&health_lock);
+  return 0;
+}
+
+/**
+ * @brief Record a cycle.
+ *
+ * @param type The cycle type.
+ * @param unit The page, the subsector or the sector of the cycle.
+ * @param us The cycle time in microseconds.
+ */
+void flash_health_record(int type, unsigned int unit, unsigned long us)
+{
+  unsigned int sector;
+
+  if (info.sector_count == 0) {
+    return;
+  }
+
+  FLASH_LOCK(&health_lock);
+  switch (type) {
+    case FLASH_HEALTH_PROGRAM:
+      sector = unit / (info.sector_bytes / info.page_bytes);
+      if (sector < info.sector_count) {
+        average(&table[sector].program_us, us);
+      }
+      break;
+    case FLASH_HEALTH_SUBSECTOR_ERASE:
+      sector = (info.subsector_bytes == 0) ? info.sector_count
+        : unit / (info.sector_bytes / info.subsector_bytes);
+      if (sector < info.sector_count) {
+        table[sector].subsector_erase_count++;
+        average(&table[sector].subsector_erase_us, us);
+      }
+      break;
+    case FLASH_HEALTH_SECTOR_ERASE:
+      if (unit < info.sector_count) {
+        table[unit].erase_count++;
+        average(&table[unit].erase_us, us);
+      }
+      break;
+    case FLASH_HEALTH_BULK_ERASE:
+      for (sector = 0; sector < info.sector_count; sector++) {
+        table[sector].erase_count++;
+      }
+      break;
+    default:
+      break;
+  }
+  FLASH_UNLOCK(&health_lock);
+}
+
+/**
+ * @brief Get the health of a sector.
+ *
+ * @param sector The sector.
+ * @param p The destination.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_health_get(unsigned int sector, flash_health_sector_t *p)
+{
+  if (info.sector_count <= sector) {
+    return -1;
+  }
+  FLASH_LOCK(&health_lock);
+  *p = table[sector];
+  FLASH_UNLOCK(&health_lock);
+  return 0;
+}
+
+/**
+ * @brief Check whether a sector is slow.
+ *
+ * @param sector The sector.
+ *
+ * @return FLASH_HEALTH_SLOW_* flags, 0 for a healthy sector or -1 on failure.
+ */
+int flash_health_check(unsigned int sector)
+{
+  flash_health_sector_t h;
+  int flags = 0;
+
+  if (flash_health_get(sector, &h) != 0) {
+    return -1;
+  }
+  if (slow(h.erase_us, info.sector_erase_ms * 1000UL, info.sector_erase_max_ms * 1000UL)) {
+    flags |= FLASH_HEALTH_SLOW_ERASE;
+  }
+  if (slow(h.subsector_erase_us, info.subsector_erase_ms * 1000UL, info.subsector_erase_max_ms * 1000UL)) {
+    flags |= FLASH_HEALTH_SLOW_SUBSECTOR_ERASE;
+  }
+  if (slow(h.program_us, info.page_program_us, info.page_program_max_us)) {
+    flags |= FLASH_HEALTH_SLOW_PROGRAM;
+  }
+  return flags;
+}
+
+/**
+ * @brief Save the table.
+ * @details
+ * All fields are little endian.
+ * - magic (4 bytes) : "HLTH"
+ * - version (1 byte)
+ * - sector_count (1 byte)
+ * - reserved (2 bytes)
+ * - For each sector: erase_count, subsector_erase_count, erase_us,
+ *   subsector_erase_us, program_us (4 bytes each)
+ * - crc (2 bytes) : CRC-16/CCITT of the bytes before it.
+ *
+ * @param buf The destination buffer.
+ * @param siz The size of the buffer.
+ *
+ * @return The number of bytes or -1 on failure.
+ */
+int flash_health_save(unsigned char *buf, unsigned int siz)
+{
+  unsigned int len = FLASH_HEALTH_TABLE_BYTES(info.sector_count);
+  unsigned int i;
+  unsigned int crc;
+  unsigned char *p = buf + 8;
+
+  if ((info.sector_count == 0) || (siz < len)) {
+    return -1;
+  }
+  memcpy(buf, TABLE_MAGIC, 4);
+  buf[4] = TABLE_VERSION;
+  buf[5] = info.sector_count;
+  buf[6] = 0;
+  buf[7] = 0;
+  FLASH_LOCK(&health_lock);
+  for (i = 0; i < info.sector_count; i++) {
+    flash_util_put32(p + 0, table[i].erase_count);
+    flash_util_put32(p + 4, table[i].subsector_erase_count);
+    flash_util_put32(p + 8, table[i].erase_us);
+    flash_util_put32(p + 12, table[i].subsector_erase_us);
+    flash_util_put32(p + 16, table[i].program_us);
+    p += 20;
+  }
+  FLASH_UNLOCK(&health_lock);
+  crc = flash_util_crc16(0xFFFF, buf, len - 2);
+  p[0] = crc & 0xFF;
+  p[1] = (crc >> 8) & 0xFF;
+  return len;
+}
+
+/**
+ * @brief Load the table.
+ *
+ * @param buf The saved table.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure. The table is left as it was.
+ */
+int flash_health_load(const unsigned char *buf, unsigned int siz)
+{
+  unsigned int len = FLASH_HEALTH_TABLE_BYTES(info.sector_count);
+  const unsigned char *p = buf + 8;
+  unsigned int i;
+
+  if ((info.sector_count == 0) || (siz < len)) {
+    return -1;
+  }
+  if ((memcmp(buf, TABLE_MAGIC, 4) != 0) || (buf[4] != TABLE_VERSION) || (buf[5] != info.sector_count)) {
+    return -1;
+  }
+  if (flash_util_crc16(0xFFFF, buf, len - 2) != (unsigned int)(buf[len - 2] | (buf[len - 1] << 8))) {
+    return -1;
+  }
+  FLASH_LOCK(&health_lock);
+  for (i = 0; i < info.sector_count; i++) {
+    table[i].erase_count = flash_util_get32(p + 0);
+    table[i].subsector_erase_count = flash_util_get32(p + 4);
+    table[i].erase_us = flash_util_get32(p + 8);
+    table[i].subsector_erase_us = flash_util_get32(p + 12);
+    table[i].program_us = flash_util_get32(p + 16);
+    p += 20;
+  }
+  FLASH_UNLOCK(&health_lock);
+  return 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file flash_health.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_HEALTH_H
+#define FLASH_HEALTH_H
+
+#include "flash.h"
+
+/**
+ * @brief Cycle types.
+ */
+#define FLASH_HEALTH_NONE               (0)
+#define FLASH_HEALTH_PROGRAM            (1)
+#define FLASH_HEALTH_SUBSECTOR_ERASE    (2)
+#define FLASH_HEALTH_SECTOR_ERASE       (3)
+#define FLASH_HEALTH_BULK_ERASE         (4)
+
+/**
+ * @brief Maximum number of sectors.
+ */
+#define FLASH_HEALTH_SECTOR_COUNT_MAX   (32)
+
+/**
+ * @brief Weight of a new sample in the averages, as a power of two.
+ * @details
+ * 3 gives the new sample a weight of 1/8.
+ */
+#define FLASH_HEALTH_EWMA_SHIFT         (3)
+
+/**
+ * @brief Threshold of a slow sector.
+ * @details
+ * A sector is slow when an average passes this percentage of the way
+ * from the typical time to the maximum time of the datasheet.
+ */
+#define FLASH_HEALTH_SLOW_PERCENT       (50)
+
+/**
+ * @brief Flags of flash_health_check.
+ */
+#define FLASH_HEALTH_SLOW_ERASE             (1 << 0)
+#define FLASH_HEALTH_SLOW_SUBSECTOR_ERASE   (1 << 1)
+#define FLASH_HEALTH_SLOW_PROGRAM           (1 << 2)
+
+/**
+ * @brief Health of a sector.
+ * @details
+ * The times are the exponential averages in microseconds, 0 before the first sample.
+ * A bulk erase counts as an erase of each sector but does not change the averages.
+ */
+typedef struct {
+  unsigned long erase_count;
+  unsigned long subsector_erase_count;
+  unsigned long erase_us;
+  unsigned long subsector_erase_us;
+  unsigned long program_us;
+} flash_health_sector_t;
+
+/**
+ * @brief Size of the saved table.
+ * @details
+ * A header of 8 bytes, 20 bytes for each sector and a CRC of 2 bytes.
+ */
+#define FLASH_HEALTH_TABLE_BYTES(SECTORS) (8 + 20 * (SECTORS) + 2)
+
+/**
+ * @brief Initialize the health tracking.
+ * @details
+ * The table is cleared. Build the backend with FLASH_CONFIG_HEALTH
+ * and FLASH_CLOCK_US to feed it with the cycle times.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_health_init(void);
+
+/**
+ * @brief Record a cycle.
+ * @details
+ * The backend calls it at the WIP poll which finds the cycle over.
+ *
+ * @param type The cycle type.
+ * @param unit The page, the subsector or the sector of the cycle.
+ * @param us The cycle time in microseconds.
+ */
+void flash_health_record(int type, unsigned int unit, unsigned long us);
+
+/**
+ * @brief Get the health of a sector.
+ *
+ * @param sector The sector.
+ * @param p The destination.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_health_get(unsigned int sector, flash_health_sector_t *p);
+
+/**
+ * @brief Check whether a sector is slow.
+ *
+ * @param sector The sector.
+ *
+ * @return FLASH_HEALTH_SLOW_* flags, 0 for a healthy sector or -1 on failure.
+ */
+int flash_health_check(unsigned int sector);
+
+/**
+ * @brief Save the table.
+ *
+ * @param buf The destination buffer.
+ * @param siz The size of the buffer.
+ *
+ * @return The number of bytes or -1 on failure.
+ */
+int flash_health_save(unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Load the table.
+ *
+ * @param buf The saved table.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure. The table is left as it was.
+ */
+int flash_health_load(const unsigned char *buf, unsigned int siz);
+
+#endif
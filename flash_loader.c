@@ -0,0 +1,484 @@
+/**
+ * @file flash_loader.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "flash.h"
+#include "flash_loader.h"
+
+/**
+ * @brief Convert a hexadecimal digit.
+ *
+ * @param c The character.
+ *
+ * @return The value or -1 for an invalid character.
+ */
+static int hexdigit(char c)
+{
+  if ((c >= '0') && (c <= '9')) {
+    return c - '0';
+  }
+  if ((c >= 'A') && (c <= 'F')) {
+    return c - 'A' + 10;
+  }
+  if ((c >= 'a') && (c <= 'f')) {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+/**
+ * @brief Convert hexadecimal text to bytes.
+ *
+ * @param s The text.
+ * @param len The number of characters.
+ * @param buf The destination buffer.
+ *
+ * @return The number of bytes or -1 on failure.
+ */
+static int hexbytes(const char *s, unsigned int len, unsigned char *buf)
+{
+  unsigned int i;
+  if (len % 2) {
+    return -1;
+  }
+  for (i = 0; i < len; i += 2) {
+    int h = hexdigit(s[i]);
+    int l = hexdigit(s[i + 1]);
+    if ((h < 0) || (l < 0)) {
+      return -1;
+    }
+    buf[i / 2] = (h << 4) | l;
+  }
+  return len / 2;
+}
+
+/**
+ * @brief Program a cached page.
+ *
+ * @param p The loader context.
+ * @param e The cache entry.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int page_flush(flash_loader_t *p, flash_loader_page_t *e)
+{
+  unsigned int sector = e->page / (p->info.sector_bytes / p->info.page_bytes);
+
+  if (!p->erased[sector]) {
+    if (flash_sector_erase(sector) != 0) {
+      return -1;
+    }
+    p->erased[sector] = 1;
+  }
+  /*
+   * A page evicted earlier may come back for out of order records.
+   * The bytes not covered by the new records are 0xFF and the page
+   * program leaves the bytes programmed before as they are.
+   */
+  if (flash_page_write(e->page, e->data, p->info.page_bytes) != 0) {
+    return -1;
+  }
+  e->valid = 0;
+  return 0;
+}
+
+/**
+ * @brief Store data bytes to the page cache.
+ *
+ * @param p The loader context.
+ * @param addr The byte address.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int store(flash_loader_t *p, unsigned int addr, const unsigned char *buf, unsigned int siz)
+{
+  unsigned int limit = p->info.sector_count * p->info.sector_bytes;
+  unsigned int done = 0;
+
+  if (p->raw) {
+    if ((addr < p->raw_base) || (p->raw_siz < addr - p->raw_base)
+        || (p->raw_siz - (addr - p->raw_base) < siz)) {
+      return -1;
+    }
+    memcpy(p->raw + (addr - p->raw_base), buf, siz);
+    if (siz != 0) {
+      if ((p->raw_hi == p->raw_lo) || (addr < p->raw_lo)) {
+        p->raw_lo = addr;
+      }
+      if (p->raw_hi < addr + siz) {
+        p->raw_hi = addr + siz;
+      }
+    }
+    return 0;
+  }
+
+  if ((limit < addr + siz) || (addr + siz < addr)) {
+    return -1;
+  }
+
+  while (done < siz) {
+    unsigned int page = (addr + done) / p->info.page_bytes;
+    unsigned int ofs = (addr + done) % p->info.page_bytes;
+    unsigned int len = p->info.page_bytes - ofs;
+    flash_loader_page_t *e = 0;
+    int i;
+
+    if (siz - done < len) {
+      len = siz - done;
+    }
+    for (i = 0; i < FLASH_LOADER_CACHE_PAGES; i++) {
+      if (p->cache[i].valid && (p->cache[i].page == page)) {
+        e = &p->cache[i];
+        break;
+      }
+    }
+    if (e == 0) {
+      e = &p->cache[0];
+      for (i = 0; i < FLASH_LOADER_CACHE_PAGES; i++) {
+        if (!p->cache[i].valid) {
+          e = &p->cache[i];
+          break;
+        }
+        if (p->cache[i].stamp < e->stamp) {
+          e = &p->cache[i];
+        }
+      }
+      if (e->valid) {
+        if (page_flush(p, e) != 0) {
+          return -1;
+        }
+      }
+      memset(e->data, 0xFF, p->info.page_bytes);
+      e->page = page;
+      e->valid = 1;
+    }
+    e->stamp = ++p->stamp;
+    memcpy(e->data + ofs, buf + done, len);
+    done += len;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Process an Intel HEX record.
+ *
+ * @param p The loader context.
+ * @param rec The record bytes after the colon.
+ * @param n The number of record bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int record_ihex(flash_loader_t *p, const unsigned char *rec, int n)
+{
+  unsigned char sum = 0;
+  int i;
+
+  if ((n < 5) || (n != rec[0] + 5)) {
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    sum += rec[i];
+  }
+  if (sum != 0) {
+    return -1;
+  }
+
+  switch (rec[3]) {
+    case 0x00:
+      return store(p, p->base + ((rec[1] << 8) | rec[2]), rec + 4, rec[0]);
+    case 0x01:
+      p->done = 1;
+      return 0;
+    case 0x02:
+      if (rec[0] != 2) {
+        return -1;
+      }
+      p->base = ((rec[4] << 8) | rec[5]) << 4;
+      return 0;
+    case 0x04:
+      if (rec[0] != 2) {
+        return -1;
+      }
+      p->base = ((rec[4] << 8) | rec[5]) << 16;
+      return 0;
+    case 0x03:
+    case 0x05:
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+/**
+ * @brief Process a Motorola S-record.
+ *
+ * @param p The loader context.
+ * @param type The record type character.
+ * @param rec The record bytes after the type.
+ * @param n The number of record bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int record_srec(flash_loader_t *p, char type, const unsigned char *rec, int n)
+{
+  unsigned char sum = 0;
+  unsigned int addr = 0;
+  int alen;
+  int i;
+
+  if ((n < 1) || (n != rec[0] + 1)) {
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    sum += rec[i];
+  }
+  if (sum != 0xFF) {
+    return -1;
+  }
+
+  switch (type) {
+    case '1':
+    case '9':
+      alen = 2;
+      break;
+    case '2':
+    case '8':
+      alen = 3;
+      break;
+    case '3':
+    case '7':
+      alen = 4;
+      break;
+    case '0':
+    case '5':
+    case '6':
+      return 0;
+    default:
+      return -1;
+  }
+  if (rec[0] < alen + 1) {
+    return -1;
+  }
+  for (i = 0; i < alen; i++) {
+    addr = (addr << 8) | rec[1 + i];
+  }
+  if (type >= '7') {
+    p->done = 1;
+    return 0;
+  }
+  return store(p, addr, rec + 1 + alen, rec[0] - alen - 1);
+}
+
+/**
+ * @brief Process a line.
+ *
+ * @param p The loader context.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int line_process(flash_loader_t *p)
+{
+  unsigned char rec[FLASH_LOADER_LINE_MAX / 2];
+  int n;
+
+  if (p->line_len == 0) {
+    return 0;
+  }
+  if (p->done) {
+    return -1;
+  }
+  if (p->line[0] == ':') {
+    n = hexbytes(p->line + 1, p->line_len - 1, rec);
+    return (n < 0) ? -1 : record_ihex(p, rec, n);
+  }
+  if ((p->line[0] == 'S') && (p->line_len >= 2)) {
+    n = hexbytes(p->line + 2, p->line_len - 2, rec);
+    return (n < 0) ? -1 : record_srec(p, p->line[1], rec, n);
+  }
+  return -1;
+}
+
+/**
+ * @brief Initialize the loader.
+ *
+ * @param p The loader context.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_loader_init(flash_loader_t *p)
+{
+  memset(p, 0, sizeof(*p));
+  if (flash_info(&p->info) != 0) {
+    return -1;
+  }
+  if ((FLASH_LOADER_PAGE_BYTES_MAX < p->info.page_bytes)
+      || (FLASH_LOADER_SECTOR_COUNT_MAX < p->info.sector_count)) {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Initialize the loader to collect the records into a flat binary.
+ *
+ * @param p The loader context.
+ * @param raw The buffer for the flat binary.
+ * @param siz The size of the buffer.
+ * @param base The byte address of the buffer on the device.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_loader_init_raw(flash_loader_t *p, unsigned char *raw, unsigned int siz, unsigned int base)
+{
+  memset(p, 0, sizeof(*p));
+  if ((raw == 0) || (base + siz < base)) {
+    return -1;
+  }
+  memset(raw, 0xFF, siz);
+  p->raw = raw;
+  p->raw_base = base;
+  p->raw_siz = siz;
+  return 0;
+}
+
+/**
+ * @brief Byte addresses covered by the records in the flat binary.
+ *
+ * @param p The loader context initialized by flash_loader_init_raw.
+ * @param lo The first byte address.
+ * @param hi The end byte address.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure, e.g. no data record was found.
+ */
+int flash_loader_raw_range(flash_loader_t *p, unsigned int *lo, unsigned int *hi)
+{
+  if ((p->raw == 0) || (p->raw_hi == p->raw_lo)) {
+    return -1;
+  }
+  *lo = p->raw_lo;
+  *hi = p->raw_hi;
+  return 0;
+}
+
+/**
+ * @brief Feed Intel HEX or Motorola S-record text to the loader.
+ *
+ * @param p The loader context.
+ * @param s The text.
+ * @param siz The number of characters.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_loader_feed(flash_loader_t *p, const char *s, unsigned int siz)
+{
+  unsigned int i;
+
+  if (p->error) {
+    return -1;
+  }
+  for (i = 0; i < siz; i++) {
+    if ((s[i] == '\r') || (s[i] == '\n')) {
+      if (line_process(p) != 0) {
+        p->error = 1;
+        return -1;
+      }
+      p->line_len = 0;
+      if (s[i] == '\n') {
+        p->line_count++;
+      }
+    } else {
+      if (p->line_len == FLASH_LOADER_LINE_MAX) {
+        p->error = 1;
+        return -1;
+      }
+      p->line[p->line_len++] = s[i];
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Finish loading.
+ *
+ * @param p The loader context.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure or the end record was not found.
+ */
+int flash_loader_finish(flash_loader_t *p)
+{
+  int i;
+
+  if (p->error) {
+    return -1;
+  }
+  if (line_process(p) != 0) {
+    p->error = 1;
+    return -1;
+  }
+  p->line_len = 0;
+  for (i = 0; i < FLASH_LOADER_CACHE_PAGES; i++) {
+    if (p->cache[i].valid) {
+      if (page_flush(p, &p->cache[i]) != 0) {
+        p->error = 1;
+        return -1;
+      }
+    }
+  }
+  return p->done ? 0 : -1;
+}
+
+/**
+ * @brief The number of lines read.
+ *
+ * @param p The loader context.
+ *
+ * @return The number of lines.
+ */
+unsigned int flash_loader_line(flash_loader_t *p)
+{
+  return p->line_count;
+}
@@ -0,0 +1,171 @@
+/**
+ * @file flash_loader.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_LOADER_H
+#define FLASH_LOADER_H
+
+#include "flash.h"
+
+/**
+ * @brief Maximum length of a record line.
+ */
+#define FLASH_LOADER_LINE_MAX           (520)
+
+/**
+ * @brief Number of pages in the coalescing cache.
+ */
+#define FLASH_LOADER_CACHE_PAGES        (4)
+
+/**
+ * @brief Maximum page size in bytes.
+ */
+#define FLASH_LOADER_PAGE_BYTES_MAX     (256)
+
+/**
+ * @brief Maximum number of sectors the loader can handle.
+ */
+#define FLASH_LOADER_SECTOR_COUNT_MAX   (32)
+
+/**
+ * @brief Page cache entry.
+ */
+typedef struct {
+  unsigned int page;
+  unsigned int stamp;
+  int valid;
+  unsigned char data[FLASH_LOADER_PAGE_BYTES_MAX];
+} flash_loader_page_t;
+
+/**
+ * @brief Loader context.
+ */
+typedef struct {
+  flash_info_t info;
+  char line[FLASH_LOADER_LINE_MAX];
+  unsigned int line_len;
+  unsigned int line_count;
+  unsigned int base;
+  unsigned int stamp;
+  int done;
+  int error;
+  unsigned char erased[FLASH_LOADER_SECTOR_COUNT_MAX];
+  flash_loader_page_t cache[FLASH_LOADER_CACHE_PAGES];
+  unsigned char *raw;
+  unsigned int raw_base;
+  unsigned int raw_siz;
+  unsigned int raw_lo;
+  unsigned int raw_hi;
+} flash_loader_t;
+
+/**
+ * @brief Initialize the loader.
+ *
+ * @param p The loader context.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_loader_init(flash_loader_t *p);
+
+/**
+ * @brief Initialize the loader to collect the records into a flat binary.
+ * @details
+ * The records go into the buffer instead of the flash, and the flash is
+ * not touched. The buffer is filled with 0xFF first.
+ * flash_loader_raw_range tells the part of it the records covered.
+ *
+ * @param p The loader context.
+ * @param raw The buffer for the flat binary.
+ * @param siz The size of the buffer.
+ * @param base The byte address of the buffer on the device.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_loader_init_raw(flash_loader_t *p, unsigned char *raw, unsigned int siz, unsigned int base);
+
+/**
+ * @brief Byte addresses covered by the records in the flat binary.
+ *
+ * @param p The loader context initialized by flash_loader_init_raw.
+ * @param lo The first byte address.
+ * @param hi The end byte address.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure, e.g. no data record was found.
+ */
+int flash_loader_raw_range(flash_loader_t *p, unsigned int *lo, unsigned int *hi);
+
+/**
+ * @brief Feed Intel HEX or Motorola S-record text to the loader.
+ * @details
+ * The text can be split at any position.
+ * The format is detected line by line.
+ * The records are coalesced into the page cache, and the least recently
+ * used page is programmed when the cache is full.
+ * A sector is erased when the first page in it is programmed.
+ *
+ * @param p The loader context.
+ * @param s The text.
+ * @param siz The number of characters.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_loader_feed(flash_loader_t *p, const char *s, unsigned int siz);
+
+/**
+ * @brief Finish loading.
+ * @details
+ * All cached pages are programmed.
+ *
+ * @param p The loader context.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure or the end record was not found.
+ */
+int flash_loader_finish(flash_loader_t *p);
+
+/**
+ * @brief The number of lines read.
+ * @details
+ * It can be used to locate the line of a parse error.
+ *
+ * @param p The loader context.
+ *
+ * @return The number of lines.
+ */
+unsigned int flash_loader_line(flash_loader_t *p);
+
+#endif
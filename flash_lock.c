@@ -0,0 +1,128 @@
+/**
+ * @file flash_lock.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include "flash_lock.h"
+
+/**
+ * @brief Acquire the ticket lock.
+ *
+ * @param l The lock.
+ */
+void flash_lock_acquire(flash_lock_t *l)
+{
+  unsigned int ticket = __atomic_fetch_add(&l->next, 1, __ATOMIC_RELAXED);
+  while (__atomic_load_n(&l->owner, __ATOMIC_ACQUIRE) != ticket) {
+    FLASH_LOCK_RELAX();
+  }
+}
+
+/**
+ * @brief Try to acquire the ticket lock.
+ *
+ * @param l The lock.
+ *
+ * @retval 0 Acquired.
+ * @retval !0 The lock is held by somebody else.
+ */
+int flash_lock_try(flash_lock_t *l)
+{
+  unsigned int owner = __atomic_load_n(&l->owner, __ATOMIC_ACQUIRE);
+  unsigned int next = owner;
+  return __atomic_compare_exchange_n(
+      &l->next, &next, owner + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ? 0 : -1;
+}
+
+/**
+ * @brief Release the ticket lock.
+ *
+ * @param l The lock.
+ */
+void flash_lock_release(flash_lock_t *l)
+{
+  __atomic_store_n(&l->owner, l->owner + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Start writing the data protected by the sequence lock.
+ * @details
+ * The sequence number is odd while a writer is active.
+ *
+ * @param s The sequence lock.
+ */
+void flash_seq_write_begin(flash_seq_t *s)
+{
+  __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * @brief End writing the data protected by the sequence lock.
+ *
+ * @param s The sequence lock.
+ */
+void flash_seq_write_end(flash_seq_t *s)
+{
+  __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Start reading the data protected by the sequence lock.
+ *
+ * @param s The sequence lock.
+ *
+ * @return The sequence number for flash_seq_read_retry.
+ */
+unsigned int flash_seq_read_begin(flash_seq_t *s)
+{
+  unsigned int seq;
+  while ((seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE)) & 1) {
+    FLASH_LOCK_RELAX();
+  }
+  return seq;
+}
+
+/**
+ * @brief Check the read has to be retried.
+ *
+ * @param s The sequence lock.
+ * @param seq The sequence number from flash_seq_read_begin.
+ *
+ * @retval 0 The data read is consistent.
+ * @retval !0 A writer was active, read it again.
+ */
+int flash_seq_read_retry(flash_seq_t *s, unsigned int seq)
+{
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq;
+}
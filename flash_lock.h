@@ -0,0 +1,161 @@
+/**
+ * @file flash_lock.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_LOCK_H
+#define FLASH_LOCK_H
+
+/**
+ * @brief Ticket lock.
+ * @details
+ * The waiters get the lock in the arrival order.
+ * The lock is not bound to a thread. A thread can start a long operation
+ * and hand it over with the lock to another thread, which releases the lock
+ * when the operation is done.
+ */
+typedef struct {
+  volatile unsigned int next;
+  volatile unsigned int owner;
+} flash_lock_t;
+
+/**
+ * @brief Sequence lock.
+ * @details
+ * The readers never block. They retry when a writer was active during the read.
+ * The writers must be serialized by another lock.
+ */
+typedef struct {
+  volatile unsigned int seq;
+} flash_seq_t;
+
+#define FLASH_LOCK_INITIALIZER  { 0, 0 }
+#define FLASH_SEQ_INITIALIZER   { 0 }
+
+/**
+ * @brief Busy wait hint.
+ * @details
+ * Define it to yield the CPU, e.g. sched_yield(), while waiting for a lock.
+ */
+#ifndef FLASH_LOCK_RELAX
+#define FLASH_LOCK_RELAX()  /* Your codes */
+#endif
+
+/*
+ * Identity of the calling thread, FLASH_THREAD_SELF().
+ * Define it, e.g. (unsigned long)pthread_self(), to use flash_acquire
+ * from several threads. It has no default: without it the backends can
+ * not tell the holder from the other threads, so flash_acquire fails.
+ */
+
+/**
+ * @brief Locking of the flash layer.
+ * @details
+ * The locks are compiled in only with FLASH_CONFIG_THREAD_SAFE.
+ */
+#ifdef FLASH_CONFIG_THREAD_SAFE
+#define FLASH_LOCK(L)               flash_lock_acquire(L)
+#define FLASH_UNLOCK(L)             flash_lock_release(L)
+#define FLASH_SEQ_WRITE_BEGIN(S)    flash_seq_write_begin(S)
+#define FLASH_SEQ_WRITE_END(S)      flash_seq_write_end(S)
+#define FLASH_SEQ_READ_BEGIN(S)     flash_seq_read_begin(S)
+#define FLASH_SEQ_READ_RETRY(S, V)  flash_seq_read_retry(S, V)
+#else
+#define FLASH_LOCK(L)
+#define FLASH_UNLOCK(L)
+#define FLASH_SEQ_WRITE_BEGIN(S)
+#define FLASH_SEQ_WRITE_END(S)
+#define FLASH_SEQ_READ_BEGIN(S)     (0)
+#define FLASH_SEQ_READ_RETRY(S, V)  ((void)(V), 0)
+#endif
+
+/**
+ * @brief Acquire the ticket lock.
+ *
+ * @param l The lock.
+ */
+void flash_lock_acquire(flash_lock_t *l);
+
+/**
+ * @brief Try to acquire the ticket lock.
+ *
+ * @param l The lock.
+ *
+ * @retval 0 Acquired.
+ * @retval !0 The lock is held by somebody else.
+ */
+int flash_lock_try(flash_lock_t *l);
+
+/**
+ * @brief Release the ticket lock.
+ * @details
+ * It can be called by a thread other than the one which acquired the lock.
+ *
+ * @param l The lock.
+ */
+void flash_lock_release(flash_lock_t *l);
+
+/**
+ * @brief Start writing the data protected by the sequence lock.
+ *
+ * @param s The sequence lock.
+ */
+void flash_seq_write_begin(flash_seq_t *s);
+
+/**
+ * @brief End writing the data protected by the sequence lock.
+ *
+ * @param s The sequence lock.
+ */
+void flash_seq_write_end(flash_seq_t *s);
+
+/**
+ * @brief Start reading the data protected by the sequence lock.
+ *
+ * @param s The sequence lock.
+ *
+ * @return The sequence number for flash_seq_read_retry.
+ */
+unsigned int flash_seq_read_begin(flash_seq_t *s);
+
+/**
+ * @brief Check the read has to be retried.
+ *
+ * @param s The sequence lock.
+ * @param seq The sequence number from flash_seq_read_begin.
+ *
+ * @retval 0 The data read is consistent.
+ * @retval !0 A writer was active, read it again.
+ */
+int flash_seq_read_retry(flash_seq_t *s, unsigned int seq);
+
+#endif
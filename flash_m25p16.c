@@ -33,7 +33,182 @@
  */
 
 #include "flash.h"
+#include "flash_bus.h"
+#include "flash_lock.h"
 #include "m25p16.h"
+#ifdef FLASH_CONFIG_HEALTH
+#include "flash_health.h"
+#endif
+
+#ifdef FLASH_CONFIG_THREAD_SAFE
+static flash_lock_t device_lock = FLASH_LOCK_INITIALIZER;
+#ifdef FLASH_THREAD_SELF
+static volatile int held;
+static volatile unsigned long holder;
+/*
+ * The holder of flash_acquire runs the functions without the lock.
+ * Only the holder sets holder to itself, so the others always take the lock.
+ */
+#define OWNED()         (held && (holder == (unsigned long)FLASH_THREAD_SELF()))
+#else
+#define OWNED()         (0)
+#endif
+#define DEVICE_LOCK()           device_lock_take()
+#define DEVICE_UNLOCK(OWNED)    device_lock_give(OWNED)
+
+/**
+ * @brief Take the device lock unless the caller holds the flash.
+ * @details
+ * A function decides it once and gives the result to device_lock_give,
+ * so a flash_handoff in the middle of it does not change what it releases.
+ *
+ * @return !0 if the caller holds the flash and the lock was not taken.
+ */
+static int device_lock_take(void)
+{
+  if (OWNED()) {
+    return 1;
+  }
+  FLASH_LOCK(&device_lock);
+  return 0;
+}
+
+/**
+ * @brief Give back the device lock taken by device_lock_take.
+ *
+ * @param owned The result of device_lock_take.
+ */
+static void device_lock_give(int owned)
+{
+  if (!owned) {
+    FLASH_UNLOCK(&device_lock);
+  }
+}
+#else
+#define DEVICE_LOCK()           (0)
+#define DEVICE_UNLOCK(OWNED)    ((void)(OWNED))
+#endif
+
+#ifndef FLASH_DELAY_US
+#define FLASH_DELAY_US(US)  /* Your codes */
+#endif
+
+#ifndef FLASH_CLOCK_US
+#define FLASH_CLOCK_US()    (0) /* Your codes */
+#endif
+
+/*
+ * Cycle timing for the health tracking.
+ * A cycle starts when its instruction is sent and ends at the WIP poll
+ * that finds it over, in wait() or flash_busy().
+ */
+#ifdef FLASH_CONFIG_HEALTH
+static struct {
+  int type;
+  unsigned int unit;
+  unsigned long start_us;
+} cycle;
+#define CYCLE_BEGIN(TYPE, UNIT) \
+  do { cycle.type = (TYPE); cycle.unit = (UNIT); cycle.start_us = FLASH_CLOCK_US(); } while (0)
+#define CYCLE_END() \
+  do { \
+    if (cycle.type != FLASH_HEALTH_NONE) { \
+      flash_health_record(cycle.type, cycle.unit, FLASH_CLOCK_US() - cycle.start_us); \
+      cycle.type = FLASH_HEALTH_NONE; \
+    } \
+  } while (0)
+#else
+#define CYCLE_BEGIN(TYPE, UNIT)
+#define CYCLE_END()
+#endif
+
+/*
+ * DEVICE_ACQUIRE waits for a cycle left by a *_start function, so a command
+ * never reaches the chip while it ignores them. DEVICE_POLL_ACQUIRE does not
+ * wait, for flash_busy.
+ */
+#define DEVICE_ACQUIRE(OWNED)      do { (OWNED) = DEVICE_LOCK(); flash_bus_acquire(); wake(); settle(); } while (0)
+#define DEVICE_POLL_ACQUIRE(OWNED) do { (OWNED) = DEVICE_LOCK(); flash_bus_acquire(); wake(); } while (0)
+#define DEVICE_RELEASE(OWNED)      do { flash_bus_release(); DEVICE_UNLOCK(OWNED); } while (0)
+
+static volatile unsigned int access_count;
+static int power_down;
+static int started;
+
+/**
+ * @brief Release from the deep power-down mode if needed.
+ */
+static void release(void)
+{
+  if (power_down) {
+    m25p16_release_from_deep_power_down();
+    FLASH_DELAY_US(M25P16_RELEASE_TIME_MAX_US);
+    power_down = 0;
+  }
+}
+
+/**
+ * @brief Count an access and make the flash ready for it.
+ */
+static void wake(void)
+{
+  access_count++;
+  release();
+}
+
+/**
+ * @brief Wait for the end of the program or erase cycle.
+ * @details
+ * The other bus users get a turn between the polls.
+ */
+static void wait(void)
+{
+  uint8_t sreg = 0;
+  for (;;) {
+    m25p16_read_status_register(&sreg);
+    if (!M25P16_SREG_WRITE_IN_PROGRESS(sreg)) {
+      CYCLE_END();
+      break;
+    }
+    flash_bus_yield();
+  }
+}
+
+/**
+ * @brief Wait for the end of a cycle started by a *_start function.
+ */
+static void settle(void)
+{
+  if (started) {
+    wait();
+    started = 0;
+  }
+}
+
+/**
+ * @brief Read data bytes in chunks.
+ * @details
+ * Each chunk is a READ command with its own address header,
+ * and the other bus users get a turn between the chunks.
+ *
+ * @param addr The target byte address.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ */
+static void read_chunked(uint32_t addr, uint8_t *buf, uint32_t siz)
+{
+  for (;;) {
+    uint32_t n = flash_bus_chunk(siz);
+    m25p16_read_data_bytes(addr, buf, n);
+    addr += n;
+    buf += n;
+    siz -= n;
+    if (siz == 0) {
+      break;
+    }
+    flash_bus_yield();
+  }
+}
 
 /**
  * @brief Initialize the target flash.
@@ -61,6 +236,17 @@ int flash_info(flash_info_t *p)
   p->page_bytes = M25P16_PAGE_BYTE_SIZE;
   p->sector_count = M25P16_SECTOR_COUNT;
   p->sector_bytes = M25P16_SECTOR_BYTE_SIZE;
+  p->subsector_count = 0;
+  p->subsector_bytes = 0;
+  p->page_program_us = M25P16_PAGE_PROGRAM_TIME_TYP_US;
+  p->subsector_erase_ms = 0;
+  p->sector_erase_ms = M25P16_SECTOR_ERASE_TIME_TYP_MS;
+  p->bulk_erase_ms = M25P16_BULK_ERASE_TIME_TYP_MS;
+  p->release_us = M25P16_RELEASE_TIME_MAX_US;
+  p->page_program_max_us = M25P16_PAGE_PROGRAM_TIME_MAX_US;
+  p->subsector_erase_max_ms = 0;
+  p->sector_erase_max_ms = M25P16_SECTOR_ERASE_TIME_MAX_MS;
+  p->bulk_erase_max_ms = M25P16_BULK_ERASE_TIME_MAX_MS;
   return 0;
 }
 
@@ -74,16 +260,98 @@ int flash_info(flash_info_t *p)
  */
 int flash_sector_erase(unsigned int sector)
 {
-    uint8_t sreg = 0;
+  int owned;
+
+  if (M25P16_SECTOR_COUNT <= sector) {
+    return -1;
+  }
+
+  DEVICE_ACQUIRE(owned);
+  m25p16_write_enable();
+  m25p16_sector_erase(M25P16_SECTOR_BYTE_SIZE * sector);
+  CYCLE_BEGIN(FLASH_HEALTH_SECTOR_ERASE, sector);
+  wait();
+  m25p16_write_disable();
+  DEVICE_RELEASE(owned);
+
+  return 0;
+}
+
+/**
+ * @brief Erase subsector.
+ * @details
+ * The M25P16 does not have the subsector erase.
+ *
+ * @param subsector The target subsector number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_subsector_erase(unsigned int subsector)
+{
+  (void)subsector;
+  return -1;
+}
+
+/**
+ * @brief Erase the whole flash.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_bulk_erase(void)
+{
+  int owned;
+
+  DEVICE_ACQUIRE(owned);
+  m25p16_write_enable();
+  m25p16_bulk_erase();
+  CYCLE_BEGIN(FLASH_HEALTH_BULK_ERASE, 0);
+  wait();
+  m25p16_write_disable();
+  DEVICE_RELEASE(owned);
+
+  return 0;
+}
+
+/**
+ * @brief Check the protection of a sector.
+ *
+ * @param sector The target sector number.
+ *
+ * @retval 0 The sector can be programmed and erased.
+ * @retval 1 The sector is protected.
+ * @retval -1 Failure.
+ */
+int flash_sector_protected(unsigned int sector)
+{
+  uint8_t sreg = 0;
+  unsigned int bp;
+  unsigned int count;
+  int owned;
+
+  if (M25P16_SECTOR_COUNT <= sector) {
+    return -1;
+  }
 
-    m25p16_write_enable();
-    m25p16_sector_erase(M25P16_SECTOR_BYTE_SIZE * sector);
-    do {
-      m25p16_read_status_register(&sreg);
-    } while (M25P16_SREG_WRITE_IN_PROGRESS(sreg));
-    m25p16_write_disable();
+  DEVICE_POLL_ACQUIRE(owned);
+  m25p16_read_status_register(&sreg);
+  if (!M25P16_SREG_WRITE_IN_PROGRESS(sreg)) {
+    CYCLE_END();
+    started = 0;
+  }
+  DEVICE_RELEASE(owned);
 
+  /*
+   * BP2-BP0 protect 1, 2, 4, 8 or 16 sectors, or all of them,
+   * from the top of the memory.
+   */
+  bp = (sreg >> 2) & 0x07;
+  if (bp == 0) {
     return 0;
+  }
+  count = (bp < 6) ? (1 << (bp - 1)) : M25P16_SECTOR_COUNT;
+  return (M25P16_SECTOR_COUNT - count <= sector) ? 1 : 0;
 }
 
 /**
@@ -98,18 +366,167 @@ int flash_sector_erase(unsigned int sector)
 int flash_page_write(unsigned int page, unsigned char *buf, unsigned int siz)
 {
   unsigned int addr = M25P16_PAGE_BYTE_SIZE * page;
+  int owned;
 
   if (M25P16_PAGE_BYTE_SIZE < siz) {
     return -1;
   }
 
-  uint8_t sreg = 0;
+  DEVICE_ACQUIRE(owned);
   m25p16_write_enable();
   m25p16_page_program(addr, buf, siz);
-  do {
-    m25p16_read_status_register(&sreg);
-  } while (M25P16_SREG_WRITE_IN_PROGRESS(sreg));
+  CYCLE_BEGIN(FLASH_HEALTH_PROGRAM, addr / M25P16_PAGE_BYTE_SIZE);
+  wait();
   m25p16_write_disable();
+  DEVICE_RELEASE(owned);
+
+  return 0;
+}
+
+/**
+ * @brief Program bytes in a page.
+ *
+ * @param addr The target byte address.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_program(unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  int owned;
+
+  if ((M25P16_PAGE_BYTE_SIZE < (addr % M25P16_PAGE_BYTE_SIZE) + siz)
+      || (M25P16_PAGE_COUNT * M25P16_PAGE_BYTE_SIZE <= addr)) {
+    return -1;
+  }
+
+  DEVICE_ACQUIRE(owned);
+  m25p16_write_enable();
+  m25p16_page_program(addr, buf, siz);
+  CYCLE_BEGIN(FLASH_HEALTH_PROGRAM, addr / M25P16_PAGE_BYTE_SIZE);
+  wait();
+  m25p16_write_disable();
+  DEVICE_RELEASE(owned);
+
+  return 0;
+}
+
+/**
+ * @brief Start programming bytes in a page.
+ *
+ * @param addr The target byte address.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_program_start(unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  int owned;
+
+  if ((M25P16_PAGE_BYTE_SIZE < (addr % M25P16_PAGE_BYTE_SIZE) + siz)
+      || (M25P16_PAGE_COUNT * M25P16_PAGE_BYTE_SIZE <= addr)) {
+    return -1;
+  }
+
+  DEVICE_ACQUIRE(owned);
+  m25p16_write_enable();
+  m25p16_page_program(addr, buf, siz);
+  CYCLE_BEGIN(FLASH_HEALTH_PROGRAM, addr / M25P16_PAGE_BYTE_SIZE);
+  started = 1;
+  DEVICE_RELEASE(owned);
+
+  return 0;
+}
+
+/**
+ * @brief Start erasing a sector.
+ *
+ * @param sector The target sector number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sector_erase_start(unsigned int sector)
+{
+  int owned;
+
+  if (M25P16_SECTOR_COUNT <= sector) {
+    return -1;
+  }
+
+  DEVICE_ACQUIRE(owned);
+  m25p16_write_enable();
+  m25p16_sector_erase(M25P16_SECTOR_BYTE_SIZE * sector);
+  CYCLE_BEGIN(FLASH_HEALTH_SECTOR_ERASE, sector);
+  started = 1;
+  DEVICE_RELEASE(owned);
+
+  return 0;
+}
+
+/**
+ * @brief Start erasing a subsector.
+ * @details
+ * The M25P16 does not have the subsector erase.
+ *
+ * @param subsector The target subsector number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_subsector_erase_start(unsigned int subsector)
+{
+  (void)subsector;
+  return -1;
+}
+
+/**
+ * @brief Check a program or erase cycle is in progress.
+ *
+ * @retval 0 The flash is ready.
+ * @retval 1 A cycle is in progress.
+ */
+int flash_busy(void)
+{
+  uint8_t sreg = 0;
+  int owned;
+
+  DEVICE_POLL_ACQUIRE(owned);
+  m25p16_read_status_register(&sreg);
+  if (!M25P16_SREG_WRITE_IN_PROGRESS(sreg)) {
+    CYCLE_END();
+    started = 0;
+  }
+  DEVICE_RELEASE(owned);
+
+  return M25P16_SREG_WRITE_IN_PROGRESS(sreg) ? 1 : 0;
+}
+
+/**
+ * @brief Read bytes from the target flash.
+ *
+ * @param addr The target byte address.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_read(unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  int owned;
+
+  if ((M25P16_PAGE_COUNT * M25P16_PAGE_BYTE_SIZE < addr + siz) || (addr + siz < addr)) {
+    return -1;
+  }
+
+  DEVICE_ACQUIRE(owned);
+  read_chunked(addr, buf, siz);
+  DEVICE_RELEASE(owned);
 
   return 0;
 }
@@ -125,13 +542,135 @@ int flash_page_write(unsigned int page, unsigned char *buf, unsigned int siz)
 int flash_page_read(unsigned int page, unsigned char *buf, unsigned int siz)
 {
   unsigned int addr = M25P16_PAGE_BYTE_SIZE * page;
+  int owned;
 
   if (M25P16_PAGE_BYTE_SIZE < siz) {
     return -1;
   }
 
-  m25p16_read_data_bytes(addr, buf, siz);
+  DEVICE_ACQUIRE(owned);
+  read_chunked(addr, buf, siz);
+  DEVICE_RELEASE(owned);
 
   return 0;
 }
 
+/**
+ * @brief Enter the deep power-down mode.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure, e.g. a cycle is in progress.
+ */
+int flash_deep_power_down(void)
+{
+  uint8_t sreg = 0;
+  int r = 0;
+  int owned;
+
+  owned = DEVICE_LOCK();
+  flash_bus_acquire();
+  if (!power_down) {
+    m25p16_read_status_register(&sreg);
+    if (M25P16_SREG_WRITE_IN_PROGRESS(sreg)) {
+      r = -1;
+    } else {
+      m25p16_deep_power_down();
+      FLASH_DELAY_US(M25P16_DEEP_POWER_DOWN_TIME_MAX_US);
+      power_down = 1;
+    }
+  }
+  DEVICE_RELEASE(owned);
+
+  return r;
+}
+
+/**
+ * @brief Release from the deep power-down mode.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_release_from_deep_power_down(void)
+{
+  int owned;
+
+  owned = DEVICE_LOCK();
+  flash_bus_acquire();
+  release();
+  DEVICE_RELEASE(owned);
+
+  return 0;
+}
+
+/**
+ * @brief Take the flash for a sequence of functions.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure, e.g. FLASH_THREAD_SELF is not defined.
+ */
+int flash_acquire(void)
+{
+#ifdef FLASH_CONFIG_THREAD_SAFE
+#ifdef FLASH_THREAD_SELF
+  FLASH_LOCK(&device_lock);
+  holder = (unsigned long)FLASH_THREAD_SELF();
+  held = 1;
+#else
+  return -1;
+#endif
+#endif
+  return 0;
+}
+
+/**
+ * @brief Take over the flash held by another thread.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure, e.g. the flash is not held.
+ */
+int flash_handoff(void)
+{
+#ifdef FLASH_CONFIG_THREAD_SAFE
+#ifdef FLASH_THREAD_SELF
+  if (!held) {
+    return -1;
+  }
+  holder = (unsigned long)FLASH_THREAD_SELF();
+#else
+  return -1;
+#endif
+#endif
+  return 0;
+}
+
+/**
+ * @brief Give the flash back to the other users.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure, e.g. the caller is not the holder.
+ */
+int flash_release(void)
+{
+#ifdef FLASH_CONFIG_THREAD_SAFE
+#ifdef FLASH_THREAD_SELF
+  if (!OWNED()) {
+    return -1;
+  }
+  held = 0;
+  FLASH_UNLOCK(&device_lock);
+#else
+  return -1;
+#endif
+#endif
+  return 0;
+}
+
+/**
+ * @brief Number of accesses to the flash.
+ *
+ * @return The number of accesses.
+ */
+unsigned int flash_access_count(void)
+{
+  return access_count;
+}
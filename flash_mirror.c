@@ -0,0 +1,760 @@
+/**
+ * @file flash_mirror.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "flash.h"
+#include "flash_dev.h"
+#include "flash_lock.h"
+#include "flash_mirror.h"
+
+#ifndef FLASH_MIRROR_RELAX
+#define FLASH_MIRROR_RELAX()    /* Your codes */
+#endif
+
+#ifndef FLASH_DELAY_US
+#define FLASH_DELAY_US(US)  /* Your codes */
+#endif
+
+/*
+ * Interval of the busy polls, less than a page program time.
+ */
+#define POLL_US             (50)
+
+#define OP_NONE             (0)
+#define OP_PROGRAM          (1)
+#define OP_SECTOR_ERASE     (2)
+#define OP_SUBSECTOR_ERASE  (3)
+
+/*
+ * The stages of an operation, in their order.
+ * The journal is erased first only when it is full.
+ */
+#define STAGE_ERASE_JOURNAL0    (0)
+#define STAGE_ERASE_JOURNAL1    (1)
+#define STAGE_INTENT            (2)
+#define STAGE_FIRST             (3)
+#define STAGE_DONE              (4)
+#define STAGE_SECOND            (5)
+
+/*
+ * Journal entry: sequence number (4 bytes), sector (2 bytes) and check (2 bytes),
+ * little endian.
+ */
+#define ENTRY_BYTES         (8)
+
+static const unsigned char stage_dev[] = { 0, 1, 1, 0, 0, 1 };
+
+static const flash_dev_t *device[2];
+static flash_info_t chip;
+static unsigned int journal;
+static unsigned int journal_pos[2];
+static unsigned long seq;
+static unsigned char valid[2][FLASH_MIRROR_SECTOR_COUNT_MAX];
+static unsigned char page[FLASH_MIRROR_PAGE_BYTES_MAX];
+static unsigned char other[FLASH_MIRROR_PAGE_BYTES_MAX];
+static unsigned char entry[ENTRY_BYTES];
+static struct {
+  int type;
+  int stage;
+  unsigned int target;
+  unsigned int siz;
+  unsigned int sector;
+  unsigned int dev;
+} op;
+#ifdef FLASH_CONFIG_THREAD_SAFE
+static flash_lock_t mirror_lock = FLASH_LOCK_INITIALIZER;
+#endif
+
+/**
+ * @brief Compute the check of a journal entry.
+ *
+ * @param n The sequence number.
+ * @param sector The sector.
+ *
+ * @return The check.
+ */
+static unsigned int entry_check(unsigned long n, unsigned int sector)
+{
+  return (unsigned int)((n ^ (n >> 16) ^ sector ^ 0x5AA5) & 0xFFFF);
+}
+
+/**
+ * @brief Decode a journal entry.
+ *
+ * @param e The entry.
+ * @param n The sequence number.
+ * @param sector The sector.
+ *
+ * @retval 1 A valid entry.
+ * @retval 0 A blank entry.
+ * @retval -1 A broken entry, e.g. by a power loss during its program.
+ */
+static int entry_get(const unsigned char *e, unsigned long *n, unsigned int *sector)
+{
+  unsigned int i;
+
+  for (i = 0; (i < ENTRY_BYTES) && (e[i] == 0xFF); i++) {
+  }
+  if (i == ENTRY_BYTES) {
+    return 0;
+  }
+  *n = (unsigned long)e[0] | ((unsigned long)e[1] << 8)
+      | ((unsigned long)e[2] << 16) | ((unsigned long)e[3] << 24);
+  *sector = (unsigned int)e[4] | ((unsigned int)e[5] << 8);
+  if ((*n == 0) || (chip.sector_count <= *sector)
+      || (((unsigned int)e[6] | ((unsigned int)e[7] << 8)) != entry_check(*n, *sector))) {
+    return -1;
+  }
+  return 1;
+}
+
+/**
+ * @brief Wait for the end of a cycle on a device.
+ *
+ * @param d The device number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int wait(unsigned int d)
+{
+  int r;
+  while ((r = device[d]->busy(device[d]->arg)) > 0) {
+    FLASH_DELAY_US(POLL_US);
+  }
+  return r;
+}
+
+/**
+ * @brief Issue a stage of the current operation on its device.
+ * @details
+ * The sector is inconsistent on the device until the first or the
+ * second stage ends.
+ *
+ * @param stage The stage.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int issue(int stage)
+{
+  unsigned int d = stage_dev[stage];
+  const flash_dev_t *p = device[d];
+  int r;
+
+  op.stage = stage;
+  op.dev = d;
+  switch (stage) {
+    case STAGE_ERASE_JOURNAL0:
+    case STAGE_ERASE_JOURNAL1:
+      r = p->sector_erase_start(p->arg, journal);
+      break;
+    case STAGE_INTENT:
+    case STAGE_DONE:
+      r = p->program_start(p->arg,
+          journal * chip.sector_bytes + journal_pos[d] * ENTRY_BYTES, entry, ENTRY_BYTES);
+      journal_pos[d]++;
+      break;
+    default:
+      valid[d][op.sector] = 0;
+      switch (op.type) {
+        case OP_PROGRAM:
+          r = p->program_start(p->arg, op.target, page, op.siz);
+          break;
+        case OP_SECTOR_ERASE:
+          r = p->sector_erase_start(p->arg, op.target);
+          break;
+        case OP_SUBSECTOR_ERASE:
+          r = p->subsector_erase_start ? p->subsector_erase_start(p->arg, op.target) : -1;
+          break;
+        default:
+          r = -1;
+          break;
+      }
+      break;
+  }
+  if (r != 0) {
+    op.type = OP_NONE;
+  }
+  return r;
+}
+
+/**
+ * @brief Advance the current operation.
+ *
+ * @retval 0 Idle.
+ * @retval 1 An operation is in progress.
+ * @retval -1 Failure.
+ */
+static int step(void)
+{
+  int r;
+
+  if (op.type == OP_NONE) {
+    return 0;
+  }
+  r = device[op.dev]->busy(device[op.dev]->arg);
+  if (r < 0) {
+    op.type = OP_NONE;
+    return -1;
+  }
+  if (r) {
+    return 1;
+  }
+  switch (op.stage) {
+    case STAGE_ERASE_JOURNAL0:
+    case STAGE_ERASE_JOURNAL1:
+      journal_pos[op.dev] = 0;
+      break;
+    case STAGE_FIRST:
+      valid[op.dev][op.sector] = 1;
+      break;
+    case STAGE_SECOND:
+      valid[op.dev][op.sector] = 1;
+      op.type = OP_NONE;
+      return 0;
+    default:
+      break;
+  }
+  return (issue(op.stage + 1) == 0) ? 1 : -1;
+}
+
+/**
+ * @brief Start an operation.
+ * @details
+ * It waits for the end of the previous operation.
+ *
+ * @param type The operation type.
+ * @param target The byte address, the sector or the subsector.
+ * @param buf The data bytes for the program.
+ * @param siz The number of data bytes.
+ * @param sector The sector the operation changes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int start(int type, unsigned int target, unsigned char *buf, unsigned int siz, unsigned int sector)
+{
+  unsigned int entries = chip.sector_bytes / ENTRY_BYTES;
+  int r;
+
+  for (;;) {
+    FLASH_LOCK(&mirror_lock);
+    r = step();
+    if (r <= 0) {
+      break;
+    }
+    FLASH_UNLOCK(&mirror_lock);
+    FLASH_MIRROR_RELAX();
+  }
+  if (r == 0) {
+    op.type = type;
+    op.target = target;
+    op.siz = siz;
+    op.sector = sector;
+    if (buf) {
+      memcpy(page, buf, siz);
+    }
+    seq++;
+    entry[0] = (unsigned char)seq;
+    entry[1] = (unsigned char)(seq >> 8);
+    entry[2] = (unsigned char)(seq >> 16);
+    entry[3] = (unsigned char)(seq >> 24);
+    entry[4] = (unsigned char)sector;
+    entry[5] = (unsigned char)(sector >> 8);
+    entry[6] = (unsigned char)entry_check(seq, sector);
+    entry[7] = (unsigned char)(entry_check(seq, sector) >> 8);
+    if ((journal_pos[0] < entries) && (journal_pos[1] < entries)) {
+      r = issue(STAGE_INTENT);
+    } else {
+      r = issue(STAGE_ERASE_JOURNAL0);
+    }
+  }
+  FLASH_UNLOCK(&mirror_lock);
+  return r;
+}
+
+/**
+ * @brief Check whether a device has the range consistent and idle.
+ *
+ * @param d The device number.
+ * @param addr The byte address.
+ * @param siz The number of bytes.
+ *
+ * @return 1 if the device can serve the read.
+ */
+static int readable(unsigned int d, unsigned int addr, unsigned int siz)
+{
+  unsigned int s;
+
+  if ((op.type != OP_NONE) && (op.dev == d)) {
+    return 0;
+  }
+  for (s = addr / chip.sector_bytes; s <= (addr + siz - 1) / chip.sector_bytes; s++) {
+    if (!valid[d][s]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Copy a sector from one device to the other.
+ * @details
+ * The blank pages are not programmed.
+ *
+ * @param sector The sector.
+ * @param src The source device, 0 or 1.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int copy(unsigned int sector, unsigned int src)
+{
+  const flash_dev_t *from = device[src];
+  const flash_dev_t *to = device[1 - src];
+  unsigned int addr;
+  unsigned int i;
+  int r;
+
+  valid[1 - src][sector] = 0;
+  r = to->sector_erase_start(to->arg, sector);
+  if (r == 0) {
+    r = wait(1 - src);
+  }
+  for (addr = sector * chip.sector_bytes; (r == 0) && (addr < (sector + 1) * chip.sector_bytes); addr += chip.page_bytes) {
+    r = from->read(from->arg, addr, page, chip.page_bytes);
+    for (i = 0; (r == 0) && (i < chip.page_bytes) && (page[i] == 0xFF); i++) {
+    }
+    if ((r == 0) && (i < chip.page_bytes)) {
+      r = to->program_start(to->arg, addr, page, chip.page_bytes);
+      if (r == 0) {
+        r = wait(1 - src);
+      }
+    }
+  }
+  if (r == 0) {
+    valid[1 - src][sector] = 1;
+  }
+  return r;
+}
+
+/**
+ * @brief Compare a sector on the devices.
+ *
+ * @param sector The sector.
+ *
+ * @retval 1 The devices have different bytes.
+ * @retval 0 The devices have the same bytes.
+ * @retval -1 Failure.
+ */
+static int differ(unsigned int sector)
+{
+  unsigned int addr;
+
+  for (addr = sector * chip.sector_bytes; addr < (sector + 1) * chip.sector_bytes; addr += chip.page_bytes) {
+    if ((device[0]->read(device[0]->arg, addr, page, chip.page_bytes) != 0)
+        || (device[1]->read(device[1]->arg, addr, other, chip.page_bytes) != 0)) {
+      return -1;
+    }
+    if (memcmp(page, other, chip.page_bytes) != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Scan the journal of a device.
+ * @details
+ * It finds the next free entry after the last programmed one
+ * and the last valid entry.
+ *
+ * @param d The device number.
+ * @param n The sequence number of the last valid entry, 0 if none.
+ * @param sector The sector of the last valid entry.
+ *
+ * @retval 0 Success.
+ * @retval 1 Success, but the journal has a broken entry or a gap.
+ * @retval -1 Failure.
+ */
+static int scan(unsigned int d, unsigned long *n, unsigned int *sector)
+{
+  unsigned int entries = chip.sector_bytes / ENTRY_BYTES;
+  unsigned int per_page = chip.page_bytes / ENTRY_BYTES;
+  unsigned int blanks = 0;
+  unsigned long en;
+  unsigned int es;
+  unsigned int i;
+  int dirty = 0;
+  int r;
+
+  *n = 0;
+  *sector = 0;
+  journal_pos[d] = 0;
+  for (i = 0; i < entries; i++) {
+    if ((i % per_page) == 0) {
+      if (device[d]->read(device[d]->arg,
+            journal * chip.sector_bytes + i * ENTRY_BYTES, page, chip.page_bytes) != 0) {
+        return -1;
+      }
+    }
+    r = entry_get(&page[(i % per_page) * ENTRY_BYTES], &en, &es);
+    if (r == 0) {
+      blanks++;
+      continue;
+    }
+    if (r == 1) {
+      *n = en;
+      *sector = es;
+    } else {
+      dirty = 1;
+    }
+    if (blanks != 0) {
+      dirty = 1;
+    }
+    journal_pos[d] = i + 1;
+  }
+  return dirty;
+}
+
+/**
+ * @brief Bring the devices to the same contents after a power loss.
+ * @details
+ * The first device logs an operation after it has finished it and
+ * the second one before the first one starts it. With an entry only
+ * on the second device the sector is copied from it, which undoes the
+ * operation. With the same entry on both the sector is copied from the
+ * first device when they differ, which completes the operation.
+ * The journals are erased after a copy or when one of them is broken,
+ * e.g. by a power loss during its erase.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int recover(void)
+{
+  unsigned long n[2];
+  unsigned int sector[2];
+  unsigned int d;
+  int dirty[2];
+  int r = 0;
+
+  dirty[0] = scan(0, &n[0], &sector[0]);
+  dirty[1] = scan(1, &n[1], &sector[1]);
+  if ((dirty[0] < 0) || (dirty[1] < 0)) {
+    return -1;
+  }
+  seq = (n[0] < n[1]) ? n[1] : n[0];
+  if (n[0] < n[1]) {
+    r = copy(sector[1], 1);
+  } else if (n[0] != 0) {
+    r = differ(sector[0]);
+    if (r == 1) {
+      r = copy(sector[0], 0);
+    } else if ((r == 0) && !dirty[0] && !dirty[1]) {
+      return 0;
+    }
+  } else if (!dirty[0] && !dirty[1]) {
+    return 0;
+  }
+  for (d = 0; (r == 0) && (d < 2); d++) {
+    r = device[d]->sector_erase_start(device[d]->arg, journal);
+    if (r == 0) {
+      r = wait(d);
+    }
+    journal_pos[d] = 0;
+  }
+  return r;
+}
+
+/**
+ * @brief Initialize the mirror.
+ *
+ * @param a The first device.
+ * @param b The second device.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_mirror_init(const flash_dev_t *a, const flash_dev_t *b)
+{
+  flash_info_t info;
+
+  device[0] = 0;
+  if ((a->info(a->arg, &chip) != 0) || (b->info(b->arg, &info) != 0)) {
+    return -1;
+  }
+  if ((info.page_bytes != chip.page_bytes)
+      || (info.sector_count != chip.sector_count)
+      || (info.sector_bytes != chip.sector_bytes)
+      || (info.subsector_count != chip.subsector_count)
+      || (info.subsector_bytes != chip.subsector_bytes)) {
+    return -1;
+  }
+  if ((FLASH_MIRROR_SECTOR_COUNT_MAX < chip.sector_count) || (chip.sector_count < 2)
+      || (FLASH_MIRROR_PAGE_BYTES_MAX < chip.page_bytes)
+      || (chip.page_bytes % ENTRY_BYTES)) {
+    return -1;
+  }
+  if ((a->subsector_erase_start == 0) || (b->subsector_erase_start == 0)) {
+    chip.subsector_count = 0;
+    chip.subsector_bytes = 0;
+  }
+  journal = chip.sector_count - 1;
+  chip.sector_count = journal;
+  chip.page_count = journal * (chip.sector_bytes / chip.page_bytes);
+  if (chip.subsector_bytes) {
+    chip.subsector_count = journal * (chip.sector_bytes / chip.subsector_bytes);
+  }
+  device[0] = a;
+  device[1] = b;
+  op.type = OP_NONE;
+  memset(valid, 1, sizeof(valid));
+  if (recover() != 0) {
+    device[0] = 0;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Start to program bytes within a page.
+ *
+ * @param addr The byte address.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_mirror_program_start(unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  if ((device[0] == 0) || (siz == 0) || (chip.page_bytes < addr % chip.page_bytes + siz)) {
+    return -1;
+  }
+  if (chip.sector_count * chip.sector_bytes <= addr) {
+    return -1;
+  }
+  return start(OP_PROGRAM, addr, buf, siz, addr / chip.sector_bytes);
+}
+
+/**
+ * @brief Start to erase a sector.
+ *
+ * @param sector The sector.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_mirror_sector_erase_start(unsigned int sector)
+{
+  if ((device[0] == 0) || (chip.sector_count <= sector)) {
+    return -1;
+  }
+  return start(OP_SECTOR_ERASE, sector, 0, 0, sector);
+}
+
+/**
+ * @brief Start to erase a subsector.
+ *
+ * @param subsector The subsector.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_mirror_subsector_erase_start(unsigned int subsector)
+{
+  if ((device[0] == 0) || (chip.subsector_count <= subsector)) {
+    return -1;
+  }
+  return start(OP_SUBSECTOR_ERASE, subsector, 0, 0,
+      subsector * chip.subsector_bytes / chip.sector_bytes);
+}
+
+/**
+ * @brief Run the mirror.
+ *
+ * @retval 0 Idle.
+ * @retval 1 An operation is in progress.
+ * @retval -1 Failure.
+ */
+int flash_mirror_busy(void)
+{
+  int r;
+  FLASH_LOCK(&mirror_lock);
+  r = step();
+  FLASH_UNLOCK(&mirror_lock);
+  return r;
+}
+
+/**
+ * @brief Read bytes.
+ *
+ * @param addr The byte address.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_mirror_read(unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  unsigned int d;
+  int r = -1;
+
+  if ((device[0] == 0) || (addr + siz < addr) || (chip.sector_count * chip.sector_bytes < addr + siz)) {
+    return -1;
+  }
+  if (siz == 0) {
+    return 0;
+  }
+
+  FLASH_LOCK(&mirror_lock);
+  if (step() < 0) {
+    FLASH_UNLOCK(&mirror_lock);
+    return -1;
+  }
+  for (d = 0; d < 2; d++) {
+    if (readable(d, addr, siz)) {
+      r = device[d]->read(device[d]->arg, addr, buf, siz);
+      break;
+    }
+  }
+  FLASH_UNLOCK(&mirror_lock);
+  return r;
+}
+
+/**
+ * @brief Copy a sector from one device to the other.
+ *
+ * @param sector The sector.
+ * @param src The source device, 0 or 1.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_mirror_repair(unsigned int sector, unsigned int src)
+{
+  int r;
+
+  if ((device[0] == 0) || (chip.sector_count <= sector) || (1 < src)) {
+    return -1;
+  }
+  for (;;) {
+    FLASH_LOCK(&mirror_lock);
+    r = step();
+    if (r <= 0) {
+      break;
+    }
+    FLASH_UNLOCK(&mirror_lock);
+    FLASH_MIRROR_RELAX();
+  }
+  r = copy(sector, src);
+  FLASH_UNLOCK(&mirror_lock);
+  return r;
+}
+
+/**
+ * @brief Mirrored device: information.
+ */
+static int mirror_info(void *arg, flash_info_t *p)
+{
+  (void)arg;
+  if (device[0] == 0) {
+    return -1;
+  }
+  *p = chip;
+  return 0;
+}
+
+/**
+ * @brief Mirrored device: read bytes.
+ */
+static int mirror_read(void *arg, unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  (void)arg;
+  return flash_mirror_read(addr, buf, siz);
+}
+
+/**
+ * @brief Mirrored device: start to program.
+ */
+static int mirror_program_start(void *arg, unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  (void)arg;
+  return flash_mirror_program_start(addr, buf, siz);
+}
+
+/**
+ * @brief Mirrored device: start to erase a sector.
+ */
+static int mirror_sector_erase_start(void *arg, unsigned int sector)
+{
+  (void)arg;
+  return flash_mirror_sector_erase_start(sector);
+}
+
+/**
+ * @brief Mirrored device: start to erase a subsector.
+ */
+static int mirror_subsector_erase_start(void *arg, unsigned int subsector)
+{
+  (void)arg;
+  return flash_mirror_subsector_erase_start(subsector);
+}
+
+/**
+ * @brief Mirrored device: busy while an operation is in progress.
+ */
+static int mirror_busy(void *arg)
+{
+  (void)arg;
+  return flash_mirror_busy();
+}
+
+/**
+ * @brief The mirrored device.
+ */
+const flash_dev_t flash_mirror_dev = {
+  mirror_info,
+  mirror_read,
+  mirror_program_start,
+  mirror_sector_erase_start,
+  mirror_subsector_erase_start,
+  mirror_busy,
+  0,
+  0,
+  0
+};
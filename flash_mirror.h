@@ -0,0 +1,167 @@
+/**
+ * @file flash_mirror.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_MIRROR_H
+#define FLASH_MIRROR_H
+
+#include "flash.h"
+#include "flash_dev.h"
+
+/**
+ * @brief Maximum number of sectors of a device.
+ * @details
+ * The last sector of each device holds the journal of the mirror,
+ * so the mirror has one sector less than a device.
+ */
+#define FLASH_MIRROR_SECTOR_COUNT_MAX   (32)
+
+/**
+ * @brief Maximum page size of a device.
+ */
+#define FLASH_MIRROR_PAGE_BYTES_MAX     (256)
+
+/**
+ * @brief The mirrored device.
+ * @details
+ * It presents the mirror as one device with the flash_dev_t functions.
+ */
+extern const flash_dev_t flash_mirror_dev;
+
+/**
+ * @brief Initialize the mirror.
+ * @details
+ * The devices must have the same geometry and the same contents,
+ * and their last sectors must be erased before the first use.
+ *
+ * Each operation is logged in the journal of the second device before
+ * it starts on the first one, and in the journal of the first device
+ * after it has finished there. The journals are read here, and a sector
+ * left different by a power loss during an operation is copied from the
+ * device which has it consistent: the operation is undone if the first
+ * device did not finish it, and completed otherwise. The journals are
+ * erased during the operation after the one which fills them.
+ *
+ * @param a The first device.
+ * @param b The second device.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_mirror_init(const flash_dev_t *a, const flash_dev_t *b);
+
+/**
+ * @brief Start to program bytes within a page.
+ * @details
+ * The bytes are programmed on one device and then on the other,
+ * so one of them always has the sector consistent and idle.
+ * With the journal entries it takes two short page programs more.
+ * The data bytes are copied.
+ *
+ * @param addr The byte address.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_mirror_program_start(unsigned int addr, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Start to erase a sector.
+ * @details
+ * The sector is erased on one device and then on the other.
+ *
+ * @param sector The sector.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_mirror_sector_erase_start(unsigned int sector);
+
+/**
+ * @brief Start to erase a subsector.
+ * @details
+ * The subsector is erased on one device and then on the other.
+ *
+ * @param subsector The subsector.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_mirror_subsector_erase_start(unsigned int subsector);
+
+/**
+ * @brief Run the mirror.
+ * @details
+ * It moves an operation from the first device to the second one
+ * when the first one has finished.
+ *
+ * @retval 0 Idle.
+ * @retval 1 An operation is in progress.
+ * @retval -1 Failure.
+ */
+int flash_mirror_busy(void);
+
+/**
+ * @brief Read bytes.
+ * @details
+ * The bytes are read from a device which is idle and has all sectors
+ * in the range consistent. During an operation it is the device
+ * the operation is not running on, so a read never waits for a cycle.
+ *
+ * @param addr The byte address.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_mirror_read(unsigned int addr, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Copy a sector from one device to the other.
+ * @details
+ * flash_mirror_init repairs the sector of an operation cut by a power
+ * loss. Use it for the other sectors, e.g. after a device is replaced,
+ * when the caller knows which device has the good sector.
+ *
+ * @param sector The sector.
+ * @param src The source device, 0 or 1.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_mirror_repair(unsigned int sector, unsigned int src);
+
+#endif
@@ -0,0 +1,131 @@
+/**
+ * @file flash_patch.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include "flash.h"
+#include "flash_patch.h"
+
+typedef struct {
+  unsigned int start;
+  unsigned int end;
+} span_t;
+
+/**
+ * @brief Update a page by programming only the changed bytes.
+ *
+ * @param page The target page number.
+ * @param buf The new data from the page offset 0.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval 1 An erase is needed since some bits go from 0 to 1.
+ * @retval -1 Failure.
+ */
+int flash_page_patch(unsigned int page, unsigned char *buf, unsigned int siz)
+{
+  unsigned char curr[FLASH_PATCH_PAGE_BYTES_MAX];
+
+  if (FLASH_PATCH_PAGE_BYTES_MAX < siz) {
+    return -1;
+  }
+  if (flash_page_read(page, curr, siz) != 0) {
+    return -1;
+  }
+  return flash_page_patch_with(page, buf, curr, siz);
+}
+
+/**
+ * @brief Update a page with known current contents.
+ *
+ * @param page The target page number.
+ * @param buf The new data from the page offset 0.
+ * @param curr The current data from the page offset 0.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval 1 An erase is needed since some bits go from 0 to 1.
+ * @retval -1 Failure.
+ */
+int flash_page_patch_with(unsigned int page, unsigned char *buf, const unsigned char *curr, unsigned int siz)
+{
+  span_t span[FLASH_PATCH_SPAN_MAX];
+  flash_info_t info;
+  unsigned int count = 0;
+  unsigned int i;
+  int overflow = 0;
+
+  if (flash_info(&info) != 0) {
+    return -1;
+  }
+  if ((info.page_bytes < siz) || (info.page_count <= page)) {
+    return -1;
+  }
+
+  for (i = 0; i < siz; i++) {
+    if (buf[i] & ~curr[i]) {
+      return 1;
+    }
+    if (buf[i] == curr[i]) {
+      continue;
+    }
+    if ((count != 0) && (i - span[count - 1].end <= FLASH_PATCH_GAP_BYTES)) {
+      span[count - 1].end = i + 1;
+    } else if (count < FLASH_PATCH_SPAN_MAX) {
+      span[count].start = i;
+      span[count].end = i + 1;
+      count++;
+    } else {
+      /*
+       * Too many spans, fall back to a single span.
+       */
+      span[count - 1].end = i + 1;
+      overflow = 1;
+    }
+  }
+
+  if (overflow) {
+    span[0].end = span[count - 1].end;
+    count = 1;
+  }
+
+  for (i = 0; i < count; i++) {
+    if (flash_program(
+          page * info.page_bytes + span[i].start,
+          buf + span[i].start,
+          span[i].end - span[i].start) != 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
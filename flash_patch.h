@@ -0,0 +1,91 @@
+/**
+ * @file flash_patch.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_PATCH_H
+#define FLASH_PATCH_H
+
+/**
+ * @brief Maximum page size in bytes.
+ */
+#define FLASH_PATCH_PAGE_BYTES_MAX  (256)
+
+/**
+ * @brief Largest run of unchanged bytes merged into a span.
+ * @details
+ * Sending a few unchanged bytes again is cheaper than
+ * another command sequence with its header and WIP polling.
+ */
+#define FLASH_PATCH_GAP_BYTES       (16)
+
+/**
+ * @brief Maximum number of spans programmed for a page.
+ * @details
+ * When there are more spans, a single span from the first
+ * changed byte to the last changed byte is programmed instead.
+ */
+#define FLASH_PATCH_SPAN_MAX        (4)
+
+/**
+ * @brief Update a page by programming only the changed bytes.
+ * @details
+ * The current contents of the page are read and compared with the new data.
+ * The changed bytes are grouped into a few spans, and only the spans are programmed.
+ * The current contents are read into a buffer of FLASH_PATCH_PAGE_BYTES_MAX
+ * bytes on the stack, so the callers never share it.
+ *
+ * @param page The target page number.
+ * @param buf The new data from the page offset 0.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval 1 An erase is needed since some bits go from 0 to 1.
+ * @retval -1 Failure.
+ */
+int flash_page_patch(unsigned int page, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Update a page with known current contents.
+ *
+ * @param page The target page number.
+ * @param buf The new data from the page offset 0.
+ * @param curr The current data from the page offset 0.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval 1 An erase is needed since some bits go from 0 to 1.
+ * @retval -1 Failure.
+ */
+int flash_page_patch_with(unsigned int page, unsigned char *buf, const unsigned char *curr, unsigned int siz);
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * @file flash_power.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include "flash.h"
+#include "flash_power.h"
+
+#define AVERAGE(AVG, SAMPLE) \
+  ((AVG) + (((int)(SAMPLE) - (int)(AVG)) >> FLASH_POWER_AVERAGE_SHIFT))
+
+static unsigned int idle;
+static int prediction;
+static unsigned int release;
+static int started;
+static int sleeping;
+static int burst_valid;
+static int early;
+static unsigned int last_count;
+static unsigned int last_tick;
+static unsigned int last_access;
+static unsigned int burst_start;
+static unsigned int period;
+static unsigned int tick;
+
+/**
+ * @brief Initialize the power manager.
+ *
+ * @param idle_us The idle time before the deep power-down in microseconds.
+ * @param predict Wake up ahead of the predicted access if not 0.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_power_init(unsigned int idle_us, int predict)
+{
+  flash_info_t info;
+
+  if (flash_info(&info) != 0) {
+    return -1;
+  }
+  idle = idle_us;
+  prediction = predict;
+  release = info.release_us;
+  started = 0;
+  sleeping = 0;
+  burst_valid = 0;
+  early = 0;
+  period = 0;
+  tick = 0;
+  return 0;
+}
+
+/**
+ * @brief Run the power manager.
+ *
+ * @param now_us The current time in microseconds.
+ */
+void flash_power_tick(unsigned int now_us)
+{
+  unsigned int count = flash_access_count();
+
+  if (!started) {
+    started = 1;
+    last_count = count;
+    last_tick = now_us;
+    last_access = now_us;
+    return;
+  }
+  tick = (tick == 0) ? (now_us - last_tick) : AVERAGE(tick, now_us - last_tick);
+  last_tick = now_us;
+
+  if (count != last_count) {
+    /*
+     * An access after an idle time starts a burst.
+     * The interval between the bursts is the predicted period.
+     */
+    if (sleeping || early || (idle <= now_us - last_access)) {
+      if (burst_valid) {
+        period = (period == 0) ? (now_us - burst_start) : AVERAGE(period, now_us - burst_start);
+      }
+      burst_start = now_us;
+      burst_valid = 1;
+    }
+    last_count = count;
+    last_access = now_us;
+    sleeping = 0;
+    early = 0;
+    return;
+  }
+
+  if (!sleeping) {
+    if (idle <= now_us - last_access) {
+      if (flash_deep_power_down() == 0) {
+        sleeping = 1;
+      }
+    }
+    return;
+  }
+
+  if (prediction && (period != 0)) {
+    int remain = (int)(burst_start + period - now_us);
+    /*
+     * Skip the bursts which did not come.
+     */
+    while (remain < 0) {
+      burst_start += period;
+      remain += period;
+    }
+    if (remain <= (int)(tick + release)) {
+      flash_release_from_deep_power_down();
+      sleeping = 0;
+      early = 1;
+      last_access = now_us;
+    }
+  }
+}
+
+/**
+ * @brief Check the flash is in the deep power-down mode.
+ *
+ * @retval 0 No.
+ * @retval 1 Yes.
+ */
+int flash_power_sleeping(void)
+{
+  return sleeping;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file flash_power.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_POWER_H
+#define FLASH_POWER_H
+
+/**
+ * @brief Weight of the new sample in the averages as a shift count (1/4).
+ */
+#define FLASH_POWER_AVERAGE_SHIFT   (2)
+
+/**
+ * @brief Initialize the power manager.
+ *
+ * @param idle_us The idle time before the deep power-down in microseconds.
+ * @param predict Wake up ahead of the predicted access if not 0.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_power_init(unsigned int idle_us, int predict);
+
+/**
+ * @brief Run the power manager.
+ * @details
+ * Call it periodically, e.g. from a timer, with a free running microsecond clock.
+ * The flash enters the deep power-down mode after the idle time.
+ * The next access releases it transparently.
+ * The accesses starting after an idle time are taken as periodic bursts,
+ * e.g. log flushes, and with the prediction enabled the flash is released
+ * one tick and the release time before the next burst is expected.
+ *
+ * @param now_us The current time in microseconds.
+ */
+void flash_power_tick(unsigned int now_us);
+
+/**
+ * @brief Check the flash is in the deep power-down mode.
+ *
+ * @retval 0 No.
+ * @retval 1 Yes.
+ */
+int flash_power_sleeping(void);
+
+#endif
@@ -0,0 +1,218 @@
+/**
+ * @file flash_readq.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "flash.h"
+#include "flash_lock.h"
+#include "flash_readq.h"
+
+static unsigned char *scratch;
+static unsigned int scratch_siz;
+static flash_readq_req_t *pending[FLASH_READQ_MAX];
+static unsigned int pending_count;
+#ifdef FLASH_CONFIG_THREAD_SAFE
+static flash_lock_t queue_lock = FLASH_LOCK_INITIALIZER;
+static flash_lock_t flush_lock = FLASH_LOCK_INITIALIZER;
+#endif
+
+/**
+ * @brief Complete a request.
+ * @details
+ * It is called after the flush lock is released, so the callback can
+ * submit and flush again.
+ *
+ * @param req The read request with its result.
+ */
+static void complete(flash_readq_req_t *req)
+{
+  flash_readq_callback_t callback = req->callback;
+  __atomic_store_n(&req->done, 1, __ATOMIC_RELEASE);
+  if (callback) {
+    callback(req);
+  }
+}
+
+/**
+ * @brief Serve the requests.
+ * @details
+ * It sets the results. The requests are completed by the caller.
+ *
+ * @param reqs The requests sorted by address.
+ * @param count The number of the requests.
+ *
+ * @retval 0 Success.
+ * @retval !0 Some requests failed.
+ */
+static int serve(flash_readq_req_t **reqs, unsigned int count)
+{
+  unsigned int i = 0;
+  int err = 0;
+
+  while (i < count) {
+    unsigned int lo = reqs[i]->addr;
+    unsigned int hi = reqs[i]->addr + reqs[i]->siz;
+    unsigned int n = 1;
+    unsigned int k;
+    int r;
+
+    /*
+     * Extend the group while the next request starts
+     * within the gap and the group fits in the scratch buffer.
+     */
+    while (i + n < count) {
+      flash_readq_req_t *next = reqs[i + n];
+      unsigned int end = next->addr + next->siz;
+      if (hi + FLASH_READQ_GAP_BYTES < next->addr) {
+        break;
+      }
+      if (end < hi) {
+        end = hi;
+      }
+      if (scratch_siz < end - lo) {
+        break;
+      }
+      hi = end;
+      n++;
+    }
+
+    if (n == 1) {
+      r = flash_read(reqs[i]->addr, reqs[i]->buf, reqs[i]->siz);
+      reqs[i]->result = r;
+    } else {
+      r = flash_read(lo, scratch, hi - lo);
+      for (k = i; k < i + n; k++) {
+        if (r == 0) {
+          memcpy(reqs[k]->buf, scratch + (reqs[k]->addr - lo), reqs[k]->siz);
+        }
+        reqs[k]->result = r;
+      }
+    }
+    if (r != 0) {
+      err = -1;
+    }
+    i += n;
+  }
+
+  return err;
+}
+
+/**
+ * @brief Initialize the read queue.
+ *
+ * @param buf The scratch buffer.
+ * @param siz The size of the scratch buffer.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_readq_init(unsigned char *buf, unsigned int siz)
+{
+  scratch = buf;
+  scratch_siz = siz;
+  pending_count = 0;
+  return 0;
+}
+
+/**
+ * @brief Queue a read request.
+ *
+ * @param req The read request.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_readq_submit(flash_readq_req_t *req)
+{
+  int full;
+
+  req->result = 0;
+  req->done = 0;
+
+  for (;;) {
+    FLASH_LOCK(&queue_lock);
+    if (pending_count < FLASH_READQ_MAX) {
+      pending[pending_count++] = req;
+      full = (pending_count == FLASH_READQ_MAX);
+      FLASH_UNLOCK(&queue_lock);
+      break;
+    }
+    FLASH_UNLOCK(&queue_lock);
+    flash_readq_flush();
+  }
+
+  if (full) {
+    return flash_readq_flush();
+  }
+  return 0;
+}
+
+/**
+ * @brief Serve all queued read requests.
+ *
+ * @retval 0 Success.
+ * @retval !0 Some requests failed.
+ */
+int flash_readq_flush(void)
+{
+  flash_readq_req_t *reqs[FLASH_READQ_MAX];
+  unsigned int count;
+  unsigned int i;
+  unsigned int j;
+  int r;
+
+  FLASH_LOCK(&flush_lock);
+
+  FLASH_LOCK(&queue_lock);
+  count = pending_count;
+  memcpy(reqs, pending, sizeof(reqs[0]) * count);
+  pending_count = 0;
+  FLASH_UNLOCK(&queue_lock);
+
+  for (i = 1; i < count; i++) {
+    flash_readq_req_t *req = reqs[i];
+    for (j = i; (j > 0) && (req->addr < reqs[j - 1]->addr); j--) {
+      reqs[j] = reqs[j - 1];
+    }
+    reqs[j] = req;
+  }
+  r = serve(reqs, count);
+
+  FLASH_UNLOCK(&flush_lock);
+
+  for (i = 0; i < count; i++) {
+    complete(reqs[i]);
+  }
+
+  return r;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file flash_readq.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_READQ_H
+#define FLASH_READQ_H
+
+/**
+ * @brief Maximum number of pending read requests.
+ * @details
+ * The queue is flushed when it gets full.
+ */
+#define FLASH_READQ_MAX         (16)
+
+/**
+ * @brief Largest gap merged between two read requests.
+ * @details
+ * Reading a few unused bytes is cheaper than another
+ * chip select cycle with a 4 byte command header.
+ */
+#define FLASH_READQ_GAP_BYTES   (8)
+
+typedef struct flash_readq_req flash_readq_req_t;
+
+/**
+ * @brief Completion callback.
+ * @details
+ * It is called by flash_readq_flush after the queue is unlocked,
+ * so it can submit the request again.
+ *
+ * @param req The completed request.
+ */
+typedef void (*flash_readq_callback_t)(flash_readq_req_t *req);
+
+/**
+ * @brief Read request.
+ * @details
+ * The caller owns the memory and keeps it until done is set,
+ * or until the callback returns when it has one.
+ * result is 0 for success and !0 for failure.
+ */
+struct flash_readq_req {
+  unsigned int addr;
+  unsigned char *buf;
+  unsigned int siz;
+  flash_readq_callback_t callback;
+  void *arg;
+  int result;
+  volatile int done;
+};
+
+/**
+ * @brief Initialize the read queue.
+ * @details
+ * The merged reads are done into the scratch buffer and copied to the requests.
+ * A merged read is never larger than the scratch buffer.
+ *
+ * @param buf The scratch buffer.
+ * @param siz The size of the scratch buffer.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_readq_init(unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Queue a read request.
+ * @details
+ * The request is served by the next flash_readq_flush.
+ * The queue is flushed in the call when it gets full.
+ *
+ * @param req The read request.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_readq_submit(flash_readq_req_t *req);
+
+/**
+ * @brief Serve all queued read requests.
+ * @details
+ * The requests are sorted by address. Overlapping and adjacent
+ * requests are served by a single read and scattered to the buffers.
+ * Call it at the end of the collection window, e.g. from a timer.
+ *
+ * @retval 0 Success.
+ * @retval !0 Some requests failed.
+ */
+int flash_readq_flush(void);
+
+#endif
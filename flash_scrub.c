@@ -0,0 +1,220 @@
+/**
+ * @file flash_scrub.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "flash.h"
+#include "flash_ecc.h"
+#include "flash_scrub.h"
+
+static const flash_scrub_config_t *cfg;
+static unsigned int page_count;
+static unsigned int next;
+static unsigned int since_checkpoint;
+static unsigned int last_step;
+static unsigned int last_count;
+static int started;
+static unsigned char data[FLASH_ECC_DATA_BYTES];
+static unsigned char raw[FLASH_ECC_DATA_BYTES];
+static flash_scrub_stats_t stats;
+
+/**
+ * @brief Give a page to the relocate callback.
+ *
+ * @param page The page number.
+ * @param reason The reason.
+ */
+static void relocate(unsigned int page, int reason)
+{
+  stats.relocations++;
+  if ((cfg->relocate == 0) || (cfg->relocate(page, data, reason, cfg->arg) != 0)) {
+    stats.failures++;
+  }
+}
+
+/**
+ * @brief Program a corrected page back.
+ * @details
+ * It is possible when every corrected bit is 0, i.e. the flash lost
+ * a programmed bit, which is the usual retention failure of NOR.
+ *
+ * @param page The page number.
+ *
+ * @retval 0 Success.
+ * @retval !0 The page cannot be repaired in place.
+ */
+static int rewrite(unsigned int page)
+{
+  unsigned int i;
+
+  if (flash_page_read(page, raw, FLASH_ECC_DATA_BYTES) != 0) {
+    return -1;
+  }
+  for (i = 0; i < FLASH_ECC_DATA_BYTES; i++) {
+    if (data[i] & ~raw[i]) {
+      return -1;
+    }
+  }
+  if (flash_program(page * FLASH_ECC_DATA_BYTES, data, FLASH_ECC_DATA_BYTES) != 0) {
+    return -1;
+  }
+  return (flash_ecc_page_check(page, raw) == 0) ? 0 : -1;
+}
+
+/**
+ * @brief Scan a page.
+ *
+ * @param page The page number.
+ */
+static void scan(unsigned int page)
+{
+  int r = flash_ecc_page_check(page, data);
+
+  stats.pages++;
+  switch (r) {
+    case 0:
+      break;
+    case 1:
+      if (rewrite(page) == 0) {
+        stats.rewrites++;
+      } else {
+        relocate(page, FLASH_SCRUB_WEAK);
+      }
+      break;
+    case 2:
+      /* The data is good. Storing it again replaces the code. */
+      if (flash_ecc_program(page * FLASH_ECC_DATA_BYTES, data, FLASH_ECC_DATA_BYTES) == 0) {
+        stats.code_rewrites++;
+      } else {
+        relocate(page, FLASH_SCRUB_WEAK);
+      }
+      break;
+    default:
+      relocate(page, FLASH_SCRUB_UNCORRECTABLE);
+      return;
+  }
+  if (cfg->verify && (cfg->verify(page, data, cfg->arg) != 0)) {
+    relocate(page, FLASH_SCRUB_CORRUPT);
+  }
+}
+
+/**
+ * @brief Initialize the scrubber.
+ *
+ * @param config The configuration. It must stay valid.
+ * @param page The page to start from, e.g. the last checkpoint.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_scrub_init(const flash_scrub_config_t *config, unsigned int page)
+{
+  flash_info_t info;
+
+  if ((flash_info(&info) != 0) || (info.page_bytes != FLASH_ECC_DATA_BYTES)
+      || (info.sector_count <= FLASH_ECC_PARITY_SECTORS) || (config->pages_per_step == 0)) {
+    return -1;
+  }
+  cfg = config;
+  page_count = (info.sector_count - FLASH_ECC_PARITY_SECTORS) * (info.sector_bytes / info.page_bytes);
+  next = (page < page_count) ? page : 0;
+  since_checkpoint = 0;
+  started = 0;
+  memset(&stats, 0, sizeof(stats));
+  return 0;
+}
+
+/**
+ * @brief Run the scrubber.
+ *
+ * @param now_us The current time in microseconds.
+ *
+ * @retval 0 Nothing was scanned.
+ * @retval 1 Pages were scanned.
+ * @retval 2 A pass was completed.
+ * @retval -1 Failure.
+ */
+int flash_scrub_step(unsigned int now_us)
+{
+  unsigned int count = flash_access_count();
+  unsigned int i;
+  int r = 1;
+
+  if (cfg == 0) {
+    return -1;
+  }
+  if (started && ((now_us - last_step) < cfg->interval_us)) {
+    return 0;
+  }
+  if (started && (count != last_count)) {
+    /* The foreground used the flash. Wait for an idle interval. */
+    stats.deferrals++;
+    last_step = now_us;
+    last_count = count;
+    return 0;
+  }
+  started = 1;
+  last_step = now_us;
+
+  for (i = 0; i < cfg->pages_per_step; i++) {
+    if ((i != 0) && cfg->preempt && cfg->preempt(cfg->arg)) {
+      break;
+    }
+    scan(next);
+    since_checkpoint++;
+    if (++next >= page_count) {
+      next = 0;
+      stats.passes++;
+      r = 2;
+    }
+    if (cfg->checkpoint && ((r == 2) || (since_checkpoint >= cfg->checkpoint_pages))) {
+      cfg->checkpoint(next, cfg->arg);
+      since_checkpoint = 0;
+    }
+    if (r == 2) {
+      break;
+    }
+  }
+  last_count = flash_access_count();
+  return r;
+}
+
+/**
+ * @brief Get the statistics.
+ *
+ * @param p The destination.
+ */
+void flash_scrub_stats(flash_scrub_stats_t *p)
+{
+  *p = stats;
+}
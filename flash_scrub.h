@@ -0,0 +1,123 @@
+/**
+ * @file flash_scrub.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_SCRUB_H
+#define FLASH_SCRUB_H
+
+/**
+ * @brief Reasons of a relocation.
+ */
+#define FLASH_SCRUB_WEAK            (1) /**< Corrected, but the page cannot be programmed back. */
+#define FLASH_SCRUB_UNCORRECTABLE   (2) /**< More than one bit error. The data is the best effort. */
+#define FLASH_SCRUB_CORRUPT         (3) /**< The verify callback rejected the page. */
+
+/**
+ * @brief Scrubber configuration.
+ * @details
+ * All callbacks are optional.
+ *
+ * relocate moves the data of a bad page somewhere else and returns 0 on success.
+ * verify checks a page against the manifest of its owner, e.g. by hashing
+ * the pages of an image as they pass, and returns !0 if the page is corrupt.
+ * checkpoint stores the next page to scan, which is given to flash_scrub_init
+ * after a reboot. It is called every checkpoint_pages pages and at the end
+ * of a pass.
+ * preempt returns !0 when the foreground needs the flash, and the step
+ * ends after the current page.
+ */
+typedef struct {
+  unsigned int pages_per_step;
+  unsigned int interval_us;
+  unsigned int checkpoint_pages;
+  int (*relocate)(unsigned int page, const unsigned char *data, int reason, void *arg);
+  int (*verify)(unsigned int page, const unsigned char *data, void *arg);
+  void (*checkpoint)(unsigned int page, void *arg);
+  int (*preempt)(void *arg);
+  void *arg;
+} flash_scrub_config_t;
+
+/**
+ * @brief Scrubber statistics.
+ */
+typedef struct {
+  unsigned long pages;          /**< Pages scanned. */
+  unsigned long passes;         /**< Complete passes over the flash. */
+  unsigned long rewrites;       /**< Corrected pages programmed back. */
+  unsigned long code_rewrites;  /**< Codes with a bit error stored again. */
+  unsigned long relocations;    /**< Pages given to relocate. */
+  unsigned long failures;       /**< Relocations failed or not possible. */
+  unsigned long deferrals;      /**< Steps skipped for the foreground. */
+} flash_scrub_stats_t;
+
+/**
+ * @brief Initialize the scrubber.
+ * @details
+ * It scans the pages covered by the ECC layer, which must be initialized.
+ *
+ * @param config The configuration. It must stay valid.
+ * @param page The page to start from, e.g. the last checkpoint.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_scrub_init(const flash_scrub_config_t *config, unsigned int page);
+
+/**
+ * @brief Run the scrubber.
+ * @details
+ * Call it from the idle loop with a free running microsecond clock.
+ * A step scans at most pages_per_step pages, and the steps are at least
+ * interval_us apart. A step is deferred when other users accessed the flash
+ * since the previous step, so the scan only runs when the flash is idle.
+ *
+ * A corrected page whose errors are bits lost to 1 is programmed back,
+ * since programming can clear them. Other bad pages go to relocate.
+ *
+ * @param now_us The current time in microseconds.
+ *
+ * @retval 0 Nothing was scanned.
+ * @retval 1 Pages were scanned.
+ * @retval 2 A pass was completed.
+ * @retval -1 Failure.
+ */
+int flash_scrub_step(unsigned int now_us);
+
+/**
+ * @brief Get the statistics.
+ *
+ * @param p The destination.
+ */
+void flash_scrub_stats(flash_scrub_stats_t *p);
+
+#endif
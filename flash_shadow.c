@@ -0,0 +1,413 @@
+/**
+ * @file flash_shadow.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "flash.h"
+#include "flash_lock.h"
+#include "flash_patch.h"
+#include "flash_shadow.h"
+
+#define BITMAP_BYTES(N)     (((N) + 7) / 8)
+#define BITMAP_SET(B, N)    ((B)[(N) / 8] |=  (1 << ((N) % 8)))
+#define BITMAP_CLR(B, N)    ((B)[(N) / 8] &= ~(1 << ((N) % 8)))
+#define BITMAP_GET(B, N)    ((B)[(N) / 8] &   (1 << ((N) % 8)))
+
+static flash_info_t info;
+static unsigned char *mirror;
+static unsigned int unit_count;
+static unsigned int unit_pages;
+static unsigned int dirty_count;
+static unsigned char page_dirty[BITMAP_BYTES(FLASH_SHADOW_PAGE_COUNT_MAX)];
+static unsigned short unit_dirty[FLASH_SHADOW_UNIT_COUNT_MAX];
+static unsigned char unit_erase[FLASH_SHADOW_UNIT_COUNT_MAX];
+static unsigned char chip[FLASH_SHADOW_PAGE_BYTES_MAX];
+#ifdef FLASH_CONFIG_THREAD_SAFE
+static flash_lock_t shadow_lock = FLASH_LOCK_INITIALIZER;
+static flash_seq_t shadow_seq = FLASH_SEQ_INITIALIZER;
+#endif
+
+/**
+ * @brief Check the bytes can be programmed over the current contents.
+ * @details
+ * A program operation only changes bits from 1 to 0.
+ *
+ * @param next The new contents.
+ * @param curr The current contents.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 An erase is needed.
+ * @retval 1 The bytes can be programmed without an erase.
+ */
+static int programmable(const unsigned char *next, const unsigned char *curr, unsigned int siz)
+{
+  unsigned int i;
+  for (i = 0; i < siz; i++) {
+    if (next[i] & ~curr[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Check the bytes are all erased.
+ *
+ * @param p The data.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Some bytes are programmed.
+ * @retval 1 All bytes are 0xFF.
+ */
+static int blank(const unsigned char *p, unsigned int siz)
+{
+  unsigned int i;
+  for (i = 0; i < siz; i++) {
+    if (p[i] != 0xFF) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void page_clean(unsigned int page, unsigned int unit)
+{
+  if (BITMAP_GET(page_dirty, page)) {
+    BITMAP_CLR(page_dirty, page);
+    unit_dirty[unit]--;
+    dirty_count--;
+  }
+}
+
+/**
+ * @brief Synchronize an erase unit with page programming only.
+ *
+ * @param unit The target erase unit number.
+ *
+ * @retval 0 Success.
+ * @retval 1 An erase is needed.
+ * @retval -1 Failure.
+ */
+static int sync_program(unsigned int unit)
+{
+  unsigned int first = unit * unit_pages;
+  unsigned int page;
+
+  /*
+   * Verify all dirty pages first to keep the unit consistent
+   * when it turns out an erase is needed.
+   */
+  for (page = first; page < first + unit_pages; page++) {
+    if (!BITMAP_GET(page_dirty, page)) {
+      continue;
+    }
+    if (flash_page_read(page, chip, info.page_bytes) != 0) {
+      return -1;
+    }
+    if (!programmable(mirror + page * info.page_bytes, chip, info.page_bytes)) {
+      return 1;
+    }
+  }
+
+  for (page = first; page < first + unit_pages; page++) {
+    if (!BITMAP_GET(page_dirty, page)) {
+      continue;
+    }
+    if (flash_page_patch(page, mirror + page * info.page_bytes, info.page_bytes) != 0) {
+      return -1;
+    }
+    page_clean(page, unit);
+  }
+  unit_erase[unit] = 0;
+  return 0;
+}
+
+/**
+ * @brief Synchronize an erase unit with an erase and page programming.
+ * @details
+ * The unit is a subsector when the flash has the subsector erase,
+ * so a change in a sector erases and programs only its subsector.
+ *
+ * @param unit The target erase unit number.
+ *
+ * @retval 0 Success.
+ * @retval -1 Failure.
+ */
+static int sync_erase(unsigned int unit)
+{
+  unsigned int first = unit * unit_pages;
+  unsigned int page;
+  int r;
+
+  r = (info.subsector_count != 0) ? flash_subsector_erase(unit) : flash_sector_erase(unit);
+  if (r != 0) {
+    return -1;
+  }
+  for (page = first; page < first + unit_pages; page++) {
+    if (!blank(mirror + page * info.page_bytes, info.page_bytes)) {
+      if (flash_page_write(page, mirror + page * info.page_bytes, info.page_bytes) != 0) {
+        return -1;
+      }
+    }
+    page_clean(page, unit);
+  }
+  unit_erase[unit] = 0;
+  return 0;
+}
+
+/**
+ * @brief Initialize the shadow mirror.
+ *
+ * @param buf The mirror buffer.
+ * @param siz The size of the mirror buffer.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_shadow_init(unsigned char *buf, unsigned int siz)
+{
+  unsigned int page;
+
+  if (flash_info(&info) != 0) {
+    return -1;
+  }
+  if (info.subsector_count != 0) {
+    unit_count = info.subsector_count;
+    unit_pages = info.subsector_bytes / info.page_bytes;
+  } else {
+    unit_count = info.sector_count;
+    unit_pages = info.sector_bytes / info.page_bytes;
+  }
+  if ((FLASH_SHADOW_PAGE_COUNT_MAX < info.page_count)
+      || (FLASH_SHADOW_UNIT_COUNT_MAX < unit_count)
+      || (FLASH_SHADOW_PAGE_BYTES_MAX < info.page_bytes)
+      || (siz < info.page_count * info.page_bytes)) {
+    return -1;
+  }
+
+  mirror = buf;
+  dirty_count = 0;
+  memset(page_dirty, 0, sizeof(page_dirty));
+  memset(unit_dirty, 0, sizeof(unit_dirty));
+  memset(unit_erase, 0, sizeof(unit_erase));
+
+  for (page = 0; page < info.page_count; page++) {
+    if (flash_page_read(page, mirror + page * info.page_bytes, info.page_bytes) != 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Read data from the shadow mirror.
+ *
+ * @param addr The target byte address.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_shadow_read(unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  unsigned int seq;
+
+  if ((info.page_count * info.page_bytes < addr + siz) || (addr + siz < addr)) {
+    return -1;
+  }
+
+  /*
+   * The readers never wait for the device.
+   * They only retry when a writer updated the mirror meanwhile.
+   */
+  do {
+    seq = FLASH_SEQ_READ_BEGIN(&shadow_seq);
+    memcpy(buf, mirror + addr, siz);
+  } while (FLASH_SEQ_READ_RETRY(&shadow_seq, seq));
+
+  return 0;
+}
+
+/**
+ * @brief Write data to the shadow mirror.
+ *
+ * @param addr The target byte address.
+ * @param buf The source buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_shadow_write(unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  unsigned int done = 0;
+
+  if ((info.page_count * info.page_bytes < addr + siz) || (addr + siz < addr)) {
+    return -1;
+  }
+
+  /*
+   * One write section for the whole write,
+   * so a reader never sees a part of it.
+   */
+  FLASH_LOCK(&shadow_lock);
+  FLASH_SEQ_WRITE_BEGIN(&shadow_seq);
+  while (done < siz) {
+    unsigned int page = (addr + done) / info.page_bytes;
+    unsigned int ofs = (addr + done) % info.page_bytes;
+    unsigned int len = info.page_bytes - ofs;
+    unsigned int unit = page / unit_pages;
+    unsigned char *p = mirror + addr + done;
+
+    if (siz - done < len) {
+      len = siz - done;
+    }
+    if (memcmp(p, buf + done, len) != 0) {
+      /*
+       * The unit may need an erase when a bit goes back to 1.
+       * This is a conservative guess and it is verified in the sync.
+       */
+      if (!programmable(buf + done, p, len)) {
+        unit_erase[unit] = 1;
+      }
+      memcpy(p, buf + done, len);
+      if (!BITMAP_GET(page_dirty, page)) {
+        BITMAP_SET(page_dirty, page);
+        unit_dirty[unit]++;
+        dirty_count++;
+      }
+    }
+    done += len;
+  }
+  FLASH_SEQ_WRITE_END(&shadow_seq);
+  FLASH_UNLOCK(&shadow_lock);
+
+  return 0;
+}
+
+/**
+ * @brief Synchronize one erase unit with the shadow lock held.
+ *
+ * @retval 0 The device is up to date.
+ * @retval 1 Dirty pages are still remaining.
+ * @retval -1 Failure.
+ */
+static int sync_step(void)
+{
+  unsigned int unit;
+  int r;
+
+  if (dirty_count == 0) {
+    return 0;
+  }
+
+  /*
+   * The units which can be programmed without an erase come first.
+   */
+  for (unit = 0; unit < unit_count; unit++) {
+    if ((unit_dirty[unit] != 0) && !unit_erase[unit]) {
+      /*
+       * The guess of the write path was wrong, the unit needs an erase.
+       */
+      r = sync_program(unit);
+      if (r == 1) {
+        r = sync_erase(unit);
+      }
+      if (r != 0) {
+        return -1;
+      }
+      return (dirty_count != 0) ? 1 : 0;
+    }
+  }
+
+  for (unit = 0; unit < unit_count; unit++) {
+    if (unit_dirty[unit] != 0) {
+      r = sync_program(unit);
+      if (r == 1) {
+        r = sync_erase(unit);
+      }
+      if (r != 0) {
+        return -1;
+      }
+      return (dirty_count != 0) ? 1 : 0;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Synchronize one erase unit to the device.
+ * @details
+ * The writers wait while a unit is synchronized,
+ * but the readers are served from the mirror.
+ *
+ * @retval 0 The device is up to date.
+ * @retval 1 Dirty pages are still remaining.
+ * @retval -1 Failure.
+ */
+int flash_shadow_sync(void)
+{
+  int r;
+  FLASH_LOCK(&shadow_lock);
+  r = sync_step();
+  FLASH_UNLOCK(&shadow_lock);
+  return r;
+}
+
+/**
+ * @brief Synchronize all dirty pages to the device.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_shadow_barrier(void)
+{
+  int r;
+  do {
+    r = flash_shadow_sync();
+  } while (r == 1);
+  return r;
+}
+
+/**
+ * @brief Number of dirty pages.
+ *
+ * @return The number of pages waiting for synchronization.
+ */
+unsigned int flash_shadow_dirty_count(void)
+{
+  return dirty_count;
+}
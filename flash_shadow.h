@@ -0,0 +1,132 @@
+/**
+ * @file flash_shadow.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_SHADOW_H
+#define FLASH_SHADOW_H
+
+/**
+ * @brief Maximum number of pages the shadow can track.
+ */
+#define FLASH_SHADOW_PAGE_COUNT_MAX     (8192)
+
+/**
+ * @brief Maximum number of erase units the shadow can track.
+ * @details
+ * An erase unit is a subsector, or a sector if the flash has no
+ * subsector erase.
+ */
+#define FLASH_SHADOW_UNIT_COUNT_MAX     (512)
+
+/**
+ * @brief Maximum page size in bytes.
+ */
+#define FLASH_SHADOW_PAGE_BYTES_MAX     (256)
+
+/**
+ * @brief Initialize the shadow mirror.
+ * @details
+ * The whole device is read into the mirror buffer.
+ * The mirror buffer must hold page_count * page_bytes reported by flash_info.
+ *
+ * @param buf The mirror buffer.
+ * @param siz The size of the mirror buffer.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_shadow_init(unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Read data from the shadow mirror.
+ * @details
+ * With FLASH_CONFIG_THREAD_SAFE it never blocks on the device operations.
+ *
+ * @param addr The target byte address.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_shadow_read(unsigned int addr, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Write data to the shadow mirror.
+ * @details
+ * The data is stored in the mirror and the touched pages are marked dirty.
+ * An erase unit is marked for an erase when a bit goes back to 1.
+ * Nothing is sent to the device until flash_shadow_sync or flash_shadow_barrier.
+ * A concurrent flash_shadow_read sees all or none of the write.
+ *
+ * @param addr The target byte address.
+ * @param buf The source buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_shadow_write(unsigned int addr, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Synchronize one erase unit to the device.
+ * @details
+ * Call it from the idle loop.
+ * Units which can be programmed without an erase are synchronized first.
+ * The units which need an erase are deferred to collect more writes,
+ * and only the unit is erased, e.g. a 4KB subsector on the M25PX16.
+ *
+ * @retval 0 The device is up to date.
+ * @retval 1 Dirty pages are still remaining.
+ * @retval -1 Failure.
+ */
+int flash_shadow_sync(void);
+
+/**
+ * @brief Synchronize all dirty pages to the device.
+ * @details
+ * All data written before the call is durable on return.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_shadow_barrier(void);
+
+/**
+ * @brief Number of dirty pages.
+ *
+ * @return The number of pages waiting for synchronization.
+ */
+unsigned int flash_shadow_dirty_count(void);
+
+#endif
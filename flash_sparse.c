@@ -0,0 +1,718 @@
+/**
+ * @file flash_sparse.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "flash.h"
+#include "flash_erase.h"
+#include "flash_loader.h"
+#include "flash_util.h"
+#include "flash_sparse.h"
+
+typedef struct {
+  unsigned char type;
+  unsigned char fill;
+  unsigned int offset;
+  unsigned int length;
+  const unsigned char *data;
+} chunk_t;
+
+/*
+ * ELF header and program header fields.
+ */
+#define ELF_CLASS_32        (1)
+#define ELF_CLASS_64        (2)
+#define ELF_DATA_LSB        (1)
+#define ELF_PT_LOAD         (1)
+#define ELF_EHDR_BYTES_32   (52)
+#define ELF_EHDR_BYTES_64   (64)
+#define ELF_PHDR_BYTES_32   (32)
+#define ELF_PHDR_BYTES_64   (56)
+
+/*
+ * Buffers of flash_sparse_write and the loader context of
+ * flash_sparse_from_records, which are not reentrant.
+ */
+static unsigned char page_buf[FLASH_SPARSE_PAGE_BYTES_MAX];
+static unsigned char unit_buf[FLASH_SPARSE_UNIT_BYTES_MAX];
+static flash_loader_t loader;
+
+/**
+ * @brief Parse a chunk.
+ *
+ * @param p The current position in the sparse image.
+ * @param end The end of the sparse image.
+ * @param c The chunk.
+ *
+ * @return The position of the next chunk or 0 on failure.
+ */
+static const unsigned char *chunk_parse(
+    const unsigned char *p, const unsigned char *end, chunk_t *c)
+{
+  if ((unsigned int)(end - p) < FLASH_SPARSE_CHUNK_BYTES) {
+    return 0;
+  }
+  c->type = p[0];
+  c->fill = p[1];
+  c->offset = flash_util_get32(p + 4);
+  c->length = flash_util_get32(p + 8);
+  c->data = p + FLASH_SPARSE_CHUNK_BYTES;
+  p += FLASH_SPARSE_CHUNK_BYTES;
+  switch (c->type) {
+    case FLASH_SPARSE_CHUNK_RAW:
+      if ((unsigned int)(end - p) < c->length) {
+        return 0;
+      }
+      return p + c->length;
+    case FLASH_SPARSE_CHUNK_FILL:
+      return p;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief Program a page if it is not blank.
+ *
+ * @param page The target page number.
+ * @param buf The page data.
+ * @param siz The page size.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int page_flush(unsigned int page, const unsigned char *buf, unsigned int siz)
+{
+  unsigned int i;
+  for (i = 0; i < siz; i++) {
+    if (buf[i] != 0xFF) {
+      return flash_page_write(page, (unsigned char *)buf, siz);
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Copy the chunks over a buffer.
+ * @details
+ * The chunks have been validated by the caller.
+ *
+ * @param img The sparse image.
+ * @param siz The size of the sparse image.
+ * @param addr The byte address of the buffer on the device.
+ * @param buf The buffer.
+ * @param len The size of the buffer.
+ * @param mask Write 0xFF for the covered bytes instead of the chunk data.
+ */
+static void overlay(
+    const unsigned char *img, unsigned int siz,
+    unsigned int addr, unsigned char *buf, unsigned int len, int mask)
+{
+  const unsigned char *end = img + siz;
+  const unsigned char *p = img + FLASH_SPARSE_HEADER_BYTES;
+  unsigned int count = flash_util_get16(img + 6);
+  unsigned int i;
+  chunk_t c;
+
+  for (i = 0; i < count; i++) {
+    unsigned int from;
+    unsigned int to;
+    p = chunk_parse(p, end, &c);
+    if ((p == 0) || (addr + len <= c.offset)) {
+      break;
+    }
+    if (c.offset + c.length <= addr) {
+      continue;
+    }
+    from = (c.offset < addr) ? addr : c.offset;
+    to = (addr + len < c.offset + c.length) ? (addr + len) : (c.offset + c.length);
+    if (mask) {
+      memset(buf + (from - addr), 0xFF, to - from);
+    } else if (c.type == FLASH_SPARSE_CHUNK_RAW) {
+      memcpy(buf + (from - addr), c.data + (from - c.offset), to - from);
+    } else {
+      memset(buf + (from - addr), c.fill, to - from);
+    }
+  }
+}
+
+/**
+ * @brief Check an erase unit has data outside the chunks.
+ *
+ * @param img The sparse image.
+ * @param siz The size of the sparse image.
+ * @param info The flash information.
+ * @param addr The byte address of the erase unit.
+ * @param unit The size of the erase unit.
+ *
+ * @retval 0 The bytes outside the chunks are blank.
+ * @retval 1 The bytes outside the chunks have to be kept.
+ * @retval -1 Failure.
+ */
+static int unit_used(
+    const unsigned char *img, unsigned int siz,
+    const flash_info_t *info, unsigned int addr, unsigned int unit)
+{
+  unsigned int ofs;
+  unsigned int i;
+
+  for (ofs = 0; ofs < unit; ofs += info->page_bytes) {
+    if (flash_page_read((addr + ofs) / info->page_bytes, page_buf, info->page_bytes) != 0) {
+      return -1;
+    }
+    overlay(img, siz, addr + ofs, page_buf, info->page_bytes, 1);
+    for (i = 0; i < info->page_bytes; i++) {
+      if (page_buf[i] != 0xFF) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Rewrite an erase unit with the chunks over its current data.
+ *
+ * @param img The sparse image.
+ * @param siz The size of the sparse image.
+ * @param info The flash information.
+ * @param n The erase unit number.
+ * @param unit The size of the erase unit.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int unit_rewrite(
+    const unsigned char *img, unsigned int siz,
+    const flash_info_t *info, unsigned int n, unsigned int unit)
+{
+  unsigned int addr = n * unit;
+  unsigned int ofs;
+  int r;
+
+  if (flash_read(addr, unit_buf, unit) != 0) {
+    return -1;
+  }
+  overlay(img, siz, addr, unit_buf, unit, 0);
+  r = (info->subsector_count != 0) ? flash_subsector_erase(n) : flash_sector_erase(n);
+  if (r != 0) {
+    return -1;
+  }
+  for (ofs = 0; ofs < unit; ofs += info->page_bytes) {
+    if (page_flush((addr + ofs) / info->page_bytes, unit_buf + ofs, info->page_bytes) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Write a sparse image to the target flash.
+ *
+ * @param img The sparse image.
+ * @param siz The size of the sparse image.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sparse_write(const unsigned char *img, unsigned int siz)
+{
+  unsigned short touched[FLASH_SPARSE_SECTOR_COUNT_MAX];
+  unsigned short keep[FLASH_SPARSE_SECTOR_COUNT_MAX];
+  const unsigned char *end = img + siz;
+  const unsigned char *p;
+  flash_info_t info;
+  unsigned int count;
+  unsigned int limit;
+  unsigned int unit;
+  unsigned int per;
+  unsigned int next;
+  unsigned int page;
+  unsigned int sector;
+  unsigned int i;
+  chunk_t c;
+
+  if (flash_info(&info) != 0) {
+    return -1;
+  }
+  if ((FLASH_SPARSE_SECTOR_COUNT_MAX < info.sector_count)
+      || (FLASH_SPARSE_PAGE_BYTES_MAX < info.page_bytes)) {
+    return -1;
+  }
+  if ((siz < FLASH_SPARSE_HEADER_BYTES)
+      || (memcmp(img, "SPRS", 4) != 0)
+      || (flash_util_get16(img + 4) != FLASH_SPARSE_VERSION)) {
+    return -1;
+  }
+  count = flash_util_get16(img + 6);
+  limit = info.sector_count * info.sector_bytes;
+  if (info.subsector_count != 0) {
+    unit = info.subsector_bytes;
+    per = info.sector_bytes / info.subsector_bytes;
+  } else {
+    unit = info.sector_bytes;
+    per = 1;
+  }
+  if (FLASH_ERASE_SUBSECTOR_PER_SECTOR_MAX < per) {
+    return -1;
+  }
+
+  /*
+   * Validate all chunks and collect the erase units they touch
+   * before the device is touched.
+   */
+  memset(touched, 0, sizeof(touched));
+  next = 0;
+  p = img + FLASH_SPARSE_HEADER_BYTES;
+  for (i = 0; i < count; i++) {
+    unsigned int n;
+    p = chunk_parse(p, end, &c);
+    if (p == 0) {
+      return -1;
+    }
+    if ((c.offset < next) || (limit < c.offset + c.length) || (c.offset + c.length < c.offset)) {
+      return -1;
+    }
+    if (c.length == 0) {
+      continue;
+    }
+    for (n = c.offset / unit; n <= (c.offset + c.length - 1) / unit; n++) {
+      touched[n / per] |= 1 << (n % per);
+    }
+    next = c.offset + c.length;
+  }
+
+  /*
+   * The units with data outside the chunks are rewritten through the unit buffer,
+   * the others are simply erased.
+   */
+  memset(keep, 0, sizeof(keep));
+  for (sector = 0; sector < info.sector_count; sector++) {
+    if (touched[sector] == 0) {
+      continue;
+    }
+    if (flash_sector_protected(sector) != 0) {
+      return -1;
+    }
+    for (i = 0; i < per; i++) {
+      int r;
+      if (!(touched[sector] & (1 << i))) {
+        continue;
+      }
+      r = unit_used(img, siz, &info, (sector * per + i) * unit, unit);
+      if (r < 0) {
+        return -1;
+      }
+      if (r) {
+        if (FLASH_SPARSE_UNIT_BYTES_MAX < unit) {
+          return -1;
+        }
+        keep[sector] |= 1 << i;
+      }
+    }
+  }
+
+  for (sector = 0; sector < info.sector_count; sector++) {
+    flash_erase_range_t ranges[FLASH_ERASE_SUBSECTOR_PER_SECTOR_MAX];
+    flash_erase_plan_t plan;
+    unsigned int n = 0;
+    for (i = 0; i < per; i++) {
+      if (keep[sector] & (1 << i)) {
+        if (unit_rewrite(img, siz, &info, sector * per + i, unit) != 0) {
+          return -1;
+        }
+      } else if (touched[sector] & (1 << i)) {
+        ranges[n].addr = (sector * per + i) * unit;
+        ranges[n].siz = unit;
+        n++;
+      }
+    }
+    if (n != 0) {
+      if ((flash_erase_plan(ranges, n, &plan) != 0) || (flash_erase_execute(&plan) != 0)) {
+        return -1;
+      }
+    }
+  }
+
+  /*
+   * Assemble the pages from the chunks.
+   * A page shared by two chunks is programmed once.
+   * The pages of the rewritten units are already done.
+   */
+  page = limit / info.page_bytes;
+  p = img + FLASH_SPARSE_HEADER_BYTES;
+  for (i = 0; i < count; i++) {
+    unsigned int done = 0;
+    p = chunk_parse(p, end, &c);
+    if ((c.type == FLASH_SPARSE_CHUNK_FILL) && (c.fill == 0xFF)) {
+      continue;
+    }
+    while (done < c.length) {
+      unsigned int addr = c.offset + done;
+      unsigned int ofs = addr % info.page_bytes;
+      unsigned int len = info.page_bytes - ofs;
+      if (c.length - done < len) {
+        len = c.length - done;
+      }
+      if (addr / info.page_bytes != page) {
+        if (page < limit / info.page_bytes) {
+          if (page_flush(page, page_buf, info.page_bytes) != 0) {
+            return -1;
+          }
+        }
+        page = addr / info.page_bytes;
+        memset(page_buf, 0xFF, info.page_bytes);
+      }
+      if (!(keep[addr / info.sector_bytes] & (1 << ((addr / unit) % per)))) {
+        if (c.type == FLASH_SPARSE_CHUNK_RAW) {
+          memcpy(page_buf + ofs, c.data + done, len);
+        } else {
+          memset(page_buf + ofs, c.fill, len);
+        }
+      }
+      done += len;
+    }
+  }
+  if (page < limit / info.page_bytes) {
+    if (page_flush(page, page_buf, info.page_bytes) != 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Check a block consists of a single value.
+ *
+ * @param p The block.
+ * @param siz The size of the block.
+ *
+ * @retval 0 The block has different values.
+ * @retval 1 The block has a single value.
+ */
+static int uniform(const unsigned char *p, unsigned int siz)
+{
+  unsigned int i;
+  for (i = 1; i < siz; i++) {
+    if (p[i] != p[0]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Append a chunk to a sparse image.
+ *
+ * @param img The sparse image.
+ * @param img_siz The size of the buffer of the sparse image.
+ * @param len The size of the sparse image, updated.
+ * @param count The number of the chunks, updated.
+ * @param fill The fill value, or -1 for a raw chunk.
+ * @param offset The byte address on the device.
+ * @param length The number of bytes.
+ * @param data The data of a raw chunk.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure, the buffer is too small.
+ */
+static int chunk_put(
+    unsigned char *img, unsigned int img_siz, unsigned int *len, unsigned int *count,
+    int fill, unsigned int offset, unsigned int length, const unsigned char *data)
+{
+  unsigned int bytes = (fill < 0) ? length : 0;
+  unsigned char *p = img + *len;
+
+  if ((*count == 0xFFFF) || (img_siz - *len < FLASH_SPARSE_CHUNK_BYTES + bytes)) {
+    return -1;
+  }
+  p[0] = (fill < 0) ? FLASH_SPARSE_CHUNK_RAW : FLASH_SPARSE_CHUNK_FILL;
+  p[1] = (fill < 0) ? 0 : fill;
+  flash_util_put16(p + 2, 0);
+  flash_util_put32(p + 4, offset);
+  flash_util_put32(p + 8, length);
+  if (bytes != 0) {
+    memcpy(p + FLASH_SPARSE_CHUNK_BYTES, data, bytes);
+  }
+  *len += FLASH_SPARSE_CHUNK_BYTES + bytes;
+  (*count)++;
+  return 0;
+}
+
+/**
+ * @brief Append the padding of a flat binary to a sparse image.
+ * @details
+ * The padding in a sector of FLASH_SPARSE_GAP_BYTES which holds nothing
+ * else of the binary is dropped. The rest becomes 0xFF fill chunks, so
+ * the writer erases it with the data around it instead of keeping the
+ * old contents of the flash there.
+ *
+ * @param img The sparse image.
+ * @param img_siz The size of the buffer of the sparse image.
+ * @param len The size of the sparse image, updated.
+ * @param count The number of the chunks, updated.
+ * @param lo The first byte address of the binary on the device.
+ * @param hi The end byte address of the binary on the device.
+ * @param from The first byte address of the padding.
+ * @param to The end byte address of the padding.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure, the buffer is too small.
+ */
+static int padding_put(
+    unsigned char *img, unsigned int img_siz, unsigned int *len, unsigned int *count,
+    unsigned int lo, unsigned int hi, unsigned int from, unsigned int to)
+{
+  while (from < to) {
+    unsigned int sector = from - (from % FLASH_SPARSE_GAP_BYTES);
+    unsigned int next = ((to - sector) < FLASH_SPARSE_GAP_BYTES) ? to : (sector + FLASH_SPARSE_GAP_BYTES);
+    unsigned int first = (sector < lo) ? lo : sector;
+    unsigned int last = ((hi - sector) < FLASH_SPARSE_GAP_BYTES) ? hi : (sector + FLASH_SPARSE_GAP_BYTES);
+    if (((from != first) || (next != last))
+        && (chunk_put(img, img_siz, len, count, 0xFF, from, next - from, 0) != 0)) {
+      return -1;
+    }
+    from = next;
+  }
+  return 0;
+}
+
+/**
+ * @brief Convert a flat binary to a sparse image.
+ *
+ * @param raw The flat binary.
+ * @param siz The size of the flat binary.
+ * @param base The byte address of the flat binary on the device.
+ * @param flags FLASH_SPARSE_FLAG_* flags.
+ * @param img The destination buffer for the sparse image.
+ * @param img_siz The size of the destination buffer.
+ * @param img_len The size of the sparse image written.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sparse_from_raw(
+    const unsigned char *raw, unsigned int siz, unsigned int base, int flags,
+    unsigned char *img, unsigned int img_siz, unsigned int *img_len)
+{
+  unsigned int count = 0;
+  unsigned int len = FLASH_SPARSE_HEADER_BYTES;
+  unsigned int ofs = 0;
+
+  if (img_siz < FLASH_SPARSE_HEADER_BYTES) {
+    return -1;
+  }
+
+  while (ofs < siz) {
+    unsigned int run = ofs;
+    unsigned int n = FLASH_SPARSE_BLOCK_BYTES;
+    int fill;
+
+    /*
+     * Blocks of a single value become a fill chunk,
+     * the others are merged into a raw chunk.
+     */
+    if (siz - run < n) {
+      n = siz - run;
+    }
+    fill = uniform(raw + run, n) ? raw[run] : -1;
+    run += n;
+    while (run < siz) {
+      n = FLASH_SPARSE_BLOCK_BYTES;
+      if (siz - run < n) {
+        n = siz - run;
+      }
+      if ((uniform(raw + run, n) ? raw[run] : -1) != fill) {
+        break;
+      }
+      run += n;
+    }
+
+    if ((fill != 0xFF) || (flags & FLASH_SPARSE_FLAG_KEEP_PADDING)) {
+      if (chunk_put(img, img_siz, &len, &count, fill, base + ofs, run - ofs, raw + ofs) != 0) {
+        return -1;
+      }
+    } else if (padding_put(img, img_siz, &len, &count, base, base + siz, base + ofs, base + run) != 0) {
+      return -1;
+    }
+    ofs = run;
+  }
+
+  memcpy(img, "SPRS", 4);
+  flash_util_put16(img + 4, FLASH_SPARSE_VERSION);
+  flash_util_put16(img + 6, count);
+  flash_util_put32(img + 8, siz);
+  flash_util_put32(img + 12, 0);
+  *img_len = len;
+
+  return 0;
+}
+
+/**
+ * @brief Convert the PT_LOAD segments of an ELF file to a sparse image.
+ *
+ * @param elf The ELF file.
+ * @param siz The size of the ELF file.
+ * @param load_base The physical address of the device byte 0.
+ * @param flags FLASH_SPARSE_FLAG_* flags.
+ * @param raw The buffer for the flat binary.
+ * @param raw_siz The size of the buffer for the flat binary.
+ * @param raw_base The byte address of the buffer on the device.
+ * @param img The destination buffer for the sparse image.
+ * @param img_siz The size of the destination buffer.
+ * @param img_len The size of the sparse image written.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sparse_from_elf(
+    const unsigned char *elf, unsigned int siz, unsigned int load_base, int flags,
+    unsigned char *raw, unsigned int raw_siz, unsigned int raw_base,
+    unsigned char *img, unsigned int img_siz, unsigned int *img_len)
+{
+  unsigned int phoff;
+  unsigned int phentsize;
+  unsigned int phnum;
+  unsigned int lo = 0;
+  unsigned int hi = 0;
+  unsigned int i;
+  int wide;
+
+  if ((siz < ELF_EHDR_BYTES_32) || (memcmp(elf, "\177ELF", 4) != 0) || (elf[5] != ELF_DATA_LSB)) {
+    return -1;
+  }
+  wide = (elf[4] == ELF_CLASS_64);
+  if (wide) {
+    if ((siz < ELF_EHDR_BYTES_64) || (flash_util_get32(elf + 36) != 0)) {
+      return -1;
+    }
+    phoff = flash_util_get32(elf + 32);
+    phentsize = flash_util_get16(elf + 54);
+    phnum = flash_util_get16(elf + 56);
+  } else if (elf[4] == ELF_CLASS_32) {
+    phoff = flash_util_get32(elf + 28);
+    phentsize = flash_util_get16(elf + 42);
+    phnum = flash_util_get16(elf + 44);
+  } else {
+    return -1;
+  }
+  if ((phentsize < (wide ? ELF_PHDR_BYTES_64 : ELF_PHDR_BYTES_32))
+      || (siz < phoff) || ((siz - phoff) / phentsize < phnum)) {
+    return -1;
+  }
+
+  memset(raw, 0xFF, raw_siz);
+  for (i = 0; i < phnum; i++) {
+    const unsigned char *ph = elf + phoff + i * phentsize;
+    unsigned int offset;
+    unsigned int paddr;
+    unsigned int filesz;
+    unsigned int addr;
+
+    if (flash_util_get32(ph) != ELF_PT_LOAD) {
+      continue;
+    }
+    if (wide) {
+      if ((flash_util_get32(ph + 12) != 0) || (flash_util_get32(ph + 28) != 0) || (flash_util_get32(ph + 36) != 0)) {
+        return -1;
+      }
+      offset = flash_util_get32(ph + 8);
+      paddr = flash_util_get32(ph + 24);
+      filesz = flash_util_get32(ph + 32);
+    } else {
+      offset = flash_util_get32(ph + 4);
+      paddr = flash_util_get32(ph + 12);
+      filesz = flash_util_get32(ph + 16);
+    }
+    /*
+     * The bytes beyond the file size, e.g. .bss, are not stored.
+     */
+    if (filesz == 0) {
+      continue;
+    }
+    if ((siz < offset) || (siz - offset < filesz) || (paddr < load_base)) {
+      return -1;
+    }
+    addr = paddr - load_base;
+    if ((addr < raw_base) || (raw_siz < addr - raw_base) || (raw_siz - (addr - raw_base) < filesz)) {
+      return -1;
+    }
+    memcpy(raw + (addr - raw_base), elf + offset, filesz);
+    if ((hi == lo) || (addr < lo)) {
+      lo = addr;
+    }
+    if (hi < addr + filesz) {
+      hi = addr + filesz;
+    }
+  }
+  if (hi == lo) {
+    return -1;
+  }
+
+  return flash_sparse_from_raw(raw + (lo - raw_base), hi - lo, lo, flags, img, img_siz, img_len);
+}
+
+/**
+ * @brief Convert Intel HEX or Motorola S-record text to a sparse image.
+ *
+ * @param text The text.
+ * @param len The number of characters.
+ * @param flags FLASH_SPARSE_FLAG_* flags.
+ * @param raw The buffer for the flat binary.
+ * @param raw_siz The size of the buffer for the flat binary.
+ * @param raw_base The byte address of the buffer on the device.
+ * @param img The destination buffer for the sparse image.
+ * @param img_siz The size of the destination buffer.
+ * @param img_len The size of the sparse image written.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sparse_from_records(
+    const char *text, unsigned int len, int flags,
+    unsigned char *raw, unsigned int raw_siz, unsigned int raw_base,
+    unsigned char *img, unsigned int img_siz, unsigned int *img_len)
+{
+  unsigned int lo;
+  unsigned int hi;
+
+  if ((flash_loader_init_raw(&loader, raw, raw_siz, raw_base) != 0)
+      || (flash_loader_feed(&loader, text, len) != 0)
+      || (flash_loader_finish(&loader) != 0)
+      || (flash_loader_raw_range(&loader, &lo, &hi) != 0)) {
+    return -1;
+  }
+
+  return flash_sparse_from_raw(raw + (lo - raw_base), hi - lo, lo, flags, img, img_siz, img_len);
+}
@@ -0,0 +1,211 @@
+/**
+ * @file flash_sparse.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_SPARSE_H
+#define FLASH_SPARSE_H
+
+/**
+ * @brief Sparse image layout.
+ * @details
+ * All multi-byte fields are little endian.
+ *
+ * Header (16 bytes)
+ * - magic (4 bytes) : 'S', 'P', 'R', 'S'
+ * - version (2 bytes) : FLASH_SPARSE_VERSION
+ * - chunk_count (2 bytes) : The number of chunks.
+ * - image_bytes (4 bytes) : The size of the flat image.
+ * - reserved (4 bytes) : 0
+ *
+ * Chunk (12 bytes + data)
+ * - type (1 byte) : FLASH_SPARSE_CHUNK_RAW or FLASH_SPARSE_CHUNK_FILL.
+ * - fill (1 byte) : The fill value for FLASH_SPARSE_CHUNK_FILL.
+ * - reserved (2 bytes) : 0
+ * - offset (4 bytes) : The byte address on the device.
+ * - length (4 bytes) : The number of bytes.
+ * - data (length bytes) : Only for FLASH_SPARSE_CHUNK_RAW.
+ *
+ * The chunks are sorted by offset and never overlap.
+ * The address ranges not covered by any chunk keep their data.
+ */
+#define FLASH_SPARSE_VERSION            (1)
+#define FLASH_SPARSE_HEADER_BYTES       (16)
+#define FLASH_SPARSE_CHUNK_BYTES        (12)
+
+#define FLASH_SPARSE_CHUNK_RAW          (1)
+#define FLASH_SPARSE_CHUNK_FILL         (2)
+
+/**
+ * @brief Maximum number of sectors the writer can handle.
+ */
+#define FLASH_SPARSE_SECTOR_COUNT_MAX   (32)
+
+/**
+ * @brief Maximum page size in bytes.
+ */
+#define FLASH_SPARSE_PAGE_BYTES_MAX     (256)
+
+/**
+ * @brief Maximum erase unit size the writer can read back.
+ * @details
+ * An erase unit with data outside the chunks is read into a buffer of
+ * this size and written back. Raise it to the sector size to keep the data
+ * on a flash without the subsector erase, e.g. on the M25P16 when a binary
+ * from flash_sparse_from_raw starts or ends inside a sector holding
+ * other data.
+ */
+#ifndef FLASH_SPARSE_UNIT_BYTES_MAX
+#define FLASH_SPARSE_UNIT_BYTES_MAX     (4096)
+#endif
+
+/**
+ * @brief Block size used by the converter to detect padding.
+ */
+#define FLASH_SPARSE_BLOCK_BYTES        (256)
+
+/**
+ * @brief Sector size used by the converter to drop padding.
+ * @details
+ * It is the largest erase unit of the supported flash.
+ */
+#define FLASH_SPARSE_GAP_BYTES          (65536)
+
+/**
+ * @brief Keep the padding as 0xFF fill chunks.
+ * @details
+ * Without this flag the padding in a sector of FLASH_SPARSE_GAP_BYTES
+ * holding nothing else of the binary becomes a gap in the image, and the
+ * writer does not touch that sector. The padding in the other sectors
+ * is still a 0xFF fill chunk, so the binary reads back as it is from its
+ * first to its last sector with data.
+ */
+#define FLASH_SPARSE_FLAG_KEEP_PADDING  (1 << 0)
+
+/**
+ * @brief Write a sparse image to the target flash.
+ * @details
+ * Only the erase units spanned by chunks are erased,
+ * with the plan of flash_erase_plan.
+ * The data outside the chunks in those units is read back and programmed
+ * again. The writer fails before the device is touched when such a unit is
+ * larger than FLASH_SPARSE_UNIT_BYTES_MAX.
+ * 0xFF fill chunks are erased but never programmed.
+ * The pages which are left blank are not programmed.
+ *
+ * The page and the erase unit are assembled in static buffers, as the
+ * unit is too large for the stack of a small target. It is not reentrant:
+ * only one image is written at a time.
+ *
+ * @param img The sparse image.
+ * @param siz The size of the sparse image.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sparse_write(const unsigned char *img, unsigned int siz);
+
+/**
+ * @brief Convert a flat binary to a sparse image.
+ *
+ * @param raw The flat binary.
+ * @param siz The size of the flat binary.
+ * @param base The byte address of the flat binary on the device.
+ * @param flags FLASH_SPARSE_FLAG_* flags.
+ * @param img The destination buffer for the sparse image.
+ * @param img_siz The size of the destination buffer.
+ * @param img_len The size of the sparse image written.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sparse_from_raw(
+    const unsigned char *raw, unsigned int siz, unsigned int base, int flags,
+    unsigned char *img, unsigned int img_siz, unsigned int *img_len);
+
+/**
+ * @brief Convert the PT_LOAD segments of an ELF file to a sparse image.
+ * @details
+ * 32-bit and 64-bit little endian files are accepted. The file bytes of a
+ * segment go to its physical address less load_base on the device; the
+ * bytes beyond them, e.g. .bss, are not stored. The segments are put into
+ * the buffer for the flat binary, filled with 0xFF, and converted from
+ * their lowest to their highest address as flash_sparse_from_raw does, so
+ * the gaps between them are padding.
+ *
+ * @param elf The ELF file.
+ * @param siz The size of the ELF file.
+ * @param load_base The physical address of the device byte 0.
+ * @param flags FLASH_SPARSE_FLAG_* flags.
+ * @param raw The buffer for the flat binary.
+ * @param raw_siz The size of the buffer for the flat binary.
+ * @param raw_base The byte address of the buffer on the device.
+ * @param img The destination buffer for the sparse image.
+ * @param img_siz The size of the destination buffer.
+ * @param img_len The size of the sparse image written.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure, e.g. a segment outside the buffer or no segment with data.
+ */
+int flash_sparse_from_elf(
+    const unsigned char *elf, unsigned int siz, unsigned int load_base, int flags,
+    unsigned char *raw, unsigned int raw_siz, unsigned int raw_base,
+    unsigned char *img, unsigned int img_siz, unsigned int *img_len);
+
+/**
+ * @brief Convert Intel HEX or Motorola S-record text to a sparse image.
+ * @details
+ * The records are parsed by flash_loader into the buffer for the flat
+ * binary, filled with 0xFF, and converted from their lowest to their
+ * highest address as flash_sparse_from_raw does. The addresses of the
+ * records are the byte addresses on the device. The text needs its end
+ * record. The loader context is static, so it is not reentrant.
+ *
+ * @param text The text.
+ * @param len The number of characters.
+ * @param flags FLASH_SPARSE_FLAG_* flags.
+ * @param raw The buffer for the flat binary.
+ * @param raw_siz The size of the buffer for the flat binary.
+ * @param raw_base The byte address of the buffer on the device.
+ * @param img The destination buffer for the sparse image.
+ * @param img_siz The size of the destination buffer.
+ * @param img_len The size of the sparse image written.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure, e.g. a parse error or a record outside the buffer.
+ */
+int flash_sparse_from_records(
+    const char *text, unsigned int len, int flags,
+    unsigned char *raw, unsigned int raw_siz, unsigned int raw_base,
+    unsigned char *img, unsigned int img_siz, unsigned int *img_len);
+
+#endif
@@ -0,0 +1,449 @@
+/**
+ * @file flash_stripe.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include "flash.h"
+#include "flash_dev.h"
+#include "flash_stripe.h"
+
+#ifndef FLASH_DELAY_US
+#define FLASH_DELAY_US(US)  /* Your codes */
+#endif
+
+/*
+ * Interval of the busy polls, less than a page program time.
+ */
+#define POLL_US             (50)
+
+static const flash_dev_t *device[FLASH_STRIPE_DEV_MAX];
+static unsigned int dev_count;
+static unsigned int stripe;
+static int subsector_ok;
+static flash_info_t chip;
+
+/**
+ * @brief Map a logical byte address.
+ *
+ * @param addr The logical byte address.
+ * @param phys The byte address on the device.
+ *
+ * @return The device number.
+ */
+static unsigned int map(unsigned int addr, unsigned int *phys)
+{
+  unsigned int k = addr / stripe;
+  *phys = (k / dev_count) * stripe + addr % stripe;
+  return k % dev_count;
+}
+
+/**
+ * @brief The first logical byte address on a device.
+ *
+ * @param d The device number.
+ * @param addr The logical byte address to start from.
+ *
+ * @return The first logical byte address at or after addr on the device.
+ */
+static unsigned int next_on(unsigned int d, unsigned int addr)
+{
+  unsigned int k = addr / stripe;
+  unsigned int skip = (d + dev_count - (k % dev_count)) % dev_count;
+  if (skip == 0) {
+    return addr;
+  }
+  return (k + skip) * stripe;
+}
+
+/**
+ * @brief Check the logical range.
+ *
+ * @param addr The logical byte address.
+ * @param siz The number of bytes.
+ *
+ * @return 1 if the range is on the devices.
+ */
+static int in_range(unsigned int addr, unsigned int siz)
+{
+  unsigned int limit = chip.sector_count * chip.sector_bytes * dev_count;
+  return (dev_count != 0) && (addr + siz >= addr) && (addr + siz <= limit);
+}
+
+/**
+ * @brief Wait for the end of the cycles on all devices.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int wait_all(void)
+{
+  int r;
+  while ((r = flash_stripe_dev.busy(flash_stripe_dev.arg)) > 0) {
+    FLASH_DELAY_US(POLL_US);
+  }
+  return r;
+}
+
+/**
+ * @brief Striped device: information.
+ */
+static int stripe_info(void *arg, flash_info_t *p)
+{
+  (void)arg;
+  if (dev_count == 0) {
+    return -1;
+  }
+  *p = chip;
+  p->page_count = chip.page_count * dev_count;
+  p->sector_bytes = chip.sector_bytes * dev_count;
+  if (subsector_ok) {
+    p->subsector_bytes = chip.subsector_bytes * dev_count;
+  } else {
+    p->subsector_count = 0;
+    p->subsector_bytes = 0;
+  }
+  return 0;
+}
+
+/**
+ * @brief Striped device: read bytes across the stripes.
+ * @details
+ * The stripes go to the devices in turn. A device with read_start gets its
+ * next stripe as soon as the previous one is done, so the transfers of the
+ * devices overlap. A device without it reads the stripe at once.
+ */
+static int stripe_read(void *arg, unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  int active[FLASH_STRIPE_DEV_MAX];
+  unsigned int count = 0;
+  unsigned int d;
+  int err = 0;
+  (void)arg;
+  if (!in_range(addr, siz)) {
+    return -1;
+  }
+  for (d = 0; d < dev_count; d++) {
+    active[d] = 0;
+  }
+  while ((siz && !err) || count) {
+    if (siz && !err) {
+      unsigned int phys;
+      unsigned int n = stripe - addr % stripe;
+      d = map(addr, &phys);
+      if (siz < n) {
+        n = siz;
+      }
+      if (!active[d]) {
+        if (device[d]->read_start == 0) {
+          err = (device[d]->read(device[d]->arg, phys, buf, n) != 0);
+        } else if (device[d]->read_start(device[d]->arg, phys, buf, n) != 0) {
+          err = 1;
+        } else {
+          active[d] = 1;
+          count++;
+        }
+        addr += n;
+        buf += n;
+        siz -= n;
+        continue;
+      }
+    }
+    /*
+     * The next stripe waits for its device. The reads end soon,
+     * so they are polled without a delay.
+     */
+    for (d = 0; d < dev_count; d++) {
+      if (active[d]) {
+        int r = device[d]->read_done(device[d]->arg);
+        if (r != 0) {
+          active[d] = 0;
+          count--;
+          if (r < 0) {
+            err = 1;
+          }
+        }
+      }
+    }
+  }
+  return err ? -1 : 0;
+}
+
+/**
+ * @brief Striped device: start to program a page on its device.
+ */
+static int stripe_program_start(void *arg, unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  unsigned int phys;
+  unsigned int d;
+  (void)arg;
+  if (!in_range(addr, siz) || (chip.page_bytes < addr % chip.page_bytes + siz)) {
+    return -1;
+  }
+  d = map(addr, &phys);
+  return device[d]->program_start(device[d]->arg, phys, buf, siz);
+}
+
+/**
+ * @brief Striped device: start to erase the sector on all devices.
+ */
+static int stripe_sector_erase_start(void *arg, unsigned int sector)
+{
+  unsigned int d;
+  (void)arg;
+  if ((dev_count == 0) || (chip.sector_count <= sector)) {
+    return -1;
+  }
+  for (d = 0; d < dev_count; d++) {
+    if (device[d]->sector_erase_start(device[d]->arg, sector) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Striped device: start to erase the subsector on all devices.
+ */
+static int stripe_subsector_erase_start(void *arg, unsigned int subsector)
+{
+  unsigned int d;
+  (void)arg;
+  if (!subsector_ok || (chip.subsector_count <= subsector)) {
+    return -1;
+  }
+  for (d = 0; d < dev_count; d++) {
+    if (device[d]->subsector_erase_start(device[d]->arg, subsector) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Striped device: busy if any device is busy.
+ */
+static int stripe_busy(void *arg)
+{
+  unsigned int d;
+  int ret = 0;
+  (void)arg;
+  for (d = 0; d < dev_count; d++) {
+    int r = device[d]->busy(device[d]->arg);
+    if (r < 0) {
+      return -1;
+    }
+    if (r) {
+      ret = 1;
+    }
+  }
+  return ret;
+}
+
+/**
+ * @brief The striped device.
+ */
+const flash_dev_t flash_stripe_dev = {
+  stripe_info,
+  stripe_read,
+  stripe_program_start,
+  stripe_sector_erase_start,
+  stripe_subsector_erase_start,
+  stripe_busy,
+  0,
+  0,
+  0
+};
+
+/**
+ * @brief Initialize the striping.
+ *
+ * @param dev The devices.
+ * @param count The number of devices.
+ * @param stripe_bytes The stripe size, e.g. the page size or 4096.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_stripe_init(const flash_dev_t *const *dev, unsigned int count, unsigned int stripe_bytes)
+{
+  unsigned int d;
+
+  dev_count = 0;
+  if ((count == 0) || (FLASH_STRIPE_DEV_MAX < count)) {
+    return -1;
+  }
+  for (d = 0; d < count; d++) {
+    flash_info_t info;
+    if ((dev[d]->info(dev[d]->arg, &info) != 0)
+        || ((dev[d]->read_start == 0) != (dev[d]->read_done == 0))) {
+      return -1;
+    }
+    if (d == 0) {
+      chip = info;
+    } else if ((info.page_bytes != chip.page_bytes)
+        || (info.sector_count != chip.sector_count)
+        || (info.sector_bytes != chip.sector_bytes)
+        || (info.subsector_count != chip.subsector_count)
+        || (info.subsector_bytes != chip.subsector_bytes)) {
+      return -1;
+    }
+    device[d] = dev[d];
+  }
+  if ((stripe_bytes == 0)
+      || (stripe_bytes % chip.page_bytes)
+      || (chip.sector_bytes % stripe_bytes)) {
+    return -1;
+  }
+  subsector_ok = (chip.subsector_count != 0) && ((chip.subsector_bytes % stripe_bytes) == 0);
+  for (d = 0; subsector_ok && (d < count); d++) {
+    if (dev[d]->subsector_erase_start == 0) {
+      subsector_ok = 0;
+    }
+  }
+  stripe = stripe_bytes;
+  dev_count = count;
+  return 0;
+}
+
+/**
+ * @brief Program bytes on all devices at once.
+ * @details
+ * Each device has its own cursor, and a device gets its next page
+ * as soon as its program cycle is over. So the program cycles overlap
+ * even when a stripe has several pages.
+ *
+ * @param addr The logical byte address.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_stripe_program(unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  unsigned int cursor[FLASH_STRIPE_DEV_MAX];
+  unsigned int end = addr + siz;
+  unsigned int active;
+  unsigned int d;
+
+  if (!in_range(addr, siz)) {
+    return -1;
+  }
+  for (d = 0; d < dev_count; d++) {
+    cursor[d] = next_on(d, addr);
+  }
+
+  do {
+    unsigned int started = 0;
+    active = 0;
+    for (d = 0; d < dev_count; d++) {
+      unsigned int phys;
+      unsigned int n;
+      int r;
+      if (end <= cursor[d]) {
+        continue;
+      }
+      active++;
+      r = device[d]->busy(device[d]->arg);
+      if (r < 0) {
+        return -1;
+      }
+      if (r) {
+        continue;
+      }
+      map(cursor[d], &phys);
+      n = chip.page_bytes - phys % chip.page_bytes;
+      if (end - cursor[d] < n) {
+        n = end - cursor[d];
+      }
+      if (device[d]->program_start(device[d]->arg, phys, buf + (cursor[d] - addr), n) != 0) {
+        return -1;
+      }
+      cursor[d] = next_on(d, cursor[d] + n);
+      started++;
+    }
+    if (active && !started) {
+      FLASH_DELAY_US(POLL_US);
+    }
+  } while (active);
+
+  return wait_all();
+}
+
+/**
+ * @brief Read bytes.
+ *
+ * @param addr The logical byte address.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_stripe_read(unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  return stripe_read(0, addr, buf, siz);
+}
+
+/**
+ * @brief Erase a logical sector.
+ *
+ * @param sector The logical sector.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_stripe_sector_erase(unsigned int sector)
+{
+  if (stripe_sector_erase_start(0, sector) != 0) {
+    wait_all();
+    return -1;
+  }
+  return wait_all();
+}
+
+/**
+ * @brief Erase a logical subsector.
+ *
+ * @param subsector The logical subsector.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_stripe_subsector_erase(unsigned int subsector)
+{
+  if (stripe_subsector_erase_start(0, subsector) != 0) {
+    wait_all();
+    return -1;
+  }
+  return wait_all();
+}
@@ -0,0 +1,131 @@
+/**
+ * @file flash_stripe.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_STRIPE_H
+#define FLASH_STRIPE_H
+
+#include "flash.h"
+#include "flash_dev.h"
+
+/**
+ * @brief Maximum number of devices.
+ */
+#define FLASH_STRIPE_DEV_MAX    (4)
+
+/**
+ * @brief The striped device.
+ * @details
+ * It presents the striped devices as one device with the flash_dev_t functions.
+ * A page belongs to one device, and a sector or a subsector consists of
+ * the sectors or the subsectors with the same number on all devices.
+ */
+extern const flash_dev_t flash_stripe_dev;
+
+/**
+ * @brief Initialize the striping.
+ * @details
+ * The devices must have the same geometry.
+ * The stripe is a multiple of the page size and divides the sector size.
+ * The subsector erase is available if the stripe also divides the subsector size.
+ *
+ * Logical byte address A is in stripe K = A / stripe, which is on
+ * device K % count at the byte address (K / count) * stripe + A % stripe.
+ *
+ * @param dev The devices.
+ * @param count The number of devices.
+ * @param stripe_bytes The stripe size, e.g. the page size or 4096.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_stripe_init(const flash_dev_t *const *dev, unsigned int count, unsigned int stripe_bytes);
+
+/**
+ * @brief Program bytes on all devices at once.
+ * @details
+ * The range may span pages and stripes.
+ * While a page is in the program cycle on a device,
+ * the next pages are sent to the other devices.
+ * The range must be erased.
+ *
+ * @param addr The logical byte address.
+ * @param buf The data bytes.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_stripe_program(unsigned int addr, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Read bytes.
+ * @details
+ * The stripes are read on all devices at once when the devices have
+ * read_start, so the read bandwidth grows with the number of devices.
+ * Otherwise they are read one after another.
+ *
+ * @param addr The logical byte address.
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_stripe_read(unsigned int addr, unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Erase a logical sector.
+ * @details
+ * The sectors on all devices are erased at once.
+ *
+ * @param sector The logical sector.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_stripe_sector_erase(unsigned int sector);
+
+/**
+ * @brief Erase a logical subsector.
+ * @details
+ * The subsectors on all devices are erased at once.
+ *
+ * @param subsector The logical subsector.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_stripe_subsector_erase(unsigned int subsector);
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * @file flash_util.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_UTIL_H
+#define FLASH_UTIL_H
+
+/**
+ * @brief Update CRC-16/CCITT.
+ * @details
+ * Start with 0xFFFF.
+ *
+ * @param crc The current value.
+ * @param buf The bytes.
+ * @param siz The number of bytes.
+ *
+ * @return The new value.
+ */
+unsigned int flash_util_crc16(unsigned int crc, const unsigned char *buf, unsigned int siz);
+
+/**
+ * @brief Store a 16-bit little endian value.
+ *
+ * @param p The destination.
+ * @param v The value.
+ */
+void flash_util_put16(unsigned char *p, unsigned int v);
+
+/**
+ * @brief Load a 16-bit little endian value.
+ *
+ * @param p The source.
+ *
+ * @return The value.
+ */
+unsigned int flash_util_get16(const unsigned char *p);
+
+/**
+ * @brief Store a 32-bit little endian value.
+ *
+ * @param p The destination.
+ * @param v The value.
+ */
+void flash_util_put32(unsigned char *p, unsigned long v);
+
+/**
+ * @brief Load a 32-bit little endian value.
+ *
+ * @param p The source.
+ *
+ * @return The value.
+ */
+unsigned long flash_util_get32(const unsigned char *p);
+
+#endif
@@ -0,0 +1,557 @@
+/**
+ * @file flash_xfer.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "flash.h"
+#include "flash_util.h"
+#include "flash_xfer.h"
+
+#define RX_SOF      (0)
+#define RX_HEADER   (1)
+#define RX_PAYLOAD  (2)
+#define RX_CRC      (3)
+
+#define RX_NONE     (0)
+#define RX_READY    (1)
+#define RX_FRAME    (2)
+
+#define SLOT_FREE   (0)
+#define SLOT_FILLED (1)
+
+/**
+ * @brief Receive a byte of a frame.
+ * @details
+ * RX_READY is returned when the header is received,
+ * and the caller sets the payload buffer before the next byte.
+ * A frame with a bad length or CRC is dropped and
+ * the sender sends it again.
+ *
+ * @param p The receiver.
+ * @param c The byte.
+ *
+ * @return RX_NONE, RX_READY or RX_FRAME.
+ */
+static int rx_put(flash_xfer_rx_t *p, unsigned char c)
+{
+  unsigned int crc;
+
+  switch (p->state) {
+    case RX_SOF:
+      if (c == FLASH_XFER_SOF) {
+        p->header[0] = c;
+        p->count = 1;
+        p->state = RX_HEADER;
+      }
+      return RX_NONE;
+    case RX_HEADER:
+      p->header[p->count++] = c;
+      if (p->count < FLASH_XFER_HEADER_BYTES) {
+        return RX_NONE;
+      }
+      p->len = p->header[3] | (p->header[4] << 8);
+      if (FLASH_XFER_PAYLOAD_MAX < p->len) {
+        p->state = RX_SOF;
+        return RX_NONE;
+      }
+      p->count = 0;
+      p->state = (p->len == 0) ? RX_CRC : RX_PAYLOAD;
+      return RX_READY;
+    case RX_PAYLOAD:
+      p->payload[p->count++] = c;
+      if (p->count == p->len) {
+        p->count = 0;
+        p->state = RX_CRC;
+      }
+      return RX_NONE;
+    case RX_CRC:
+      p->crc[p->count++] = c;
+      if (p->count < FLASH_XFER_CRC_BYTES) {
+        return RX_NONE;
+      }
+      p->state = RX_SOF;
+      crc = flash_util_crc16(0xFFFF, p->header + 1, FLASH_XFER_HEADER_BYTES - 1);
+      crc = flash_util_crc16(crc, p->payload, p->len);
+      if (crc != flash_util_get16(p->crc)) {
+        return RX_NONE;
+      }
+      return RX_FRAME;
+    default:
+      p->state = RX_SOF;
+      return RX_NONE;
+  }
+}
+
+/**
+ * @brief Send a frame.
+ *
+ * @param io The byte stream.
+ * @param type The frame type.
+ * @param seq The sequence number.
+ * @param buf The payload.
+ * @param len The number of payload bytes.
+ */
+static void tx_frame(
+    const flash_xfer_io_t *io, unsigned char type, unsigned char seq,
+    const unsigned char *buf, unsigned int len)
+{
+  unsigned char header[FLASH_XFER_HEADER_BYTES];
+  unsigned int crc;
+  unsigned int i;
+
+  header[0] = FLASH_XFER_SOF;
+  header[1] = type;
+  header[2] = seq;
+  header[3] = len & 0xFF;
+  header[4] = (len >> 8) & 0xFF;
+  crc = flash_util_crc16(0xFFFF, header + 1, FLASH_XFER_HEADER_BYTES - 1);
+  crc = flash_util_crc16(crc, buf, len);
+  for (i = 0; i < FLASH_XFER_HEADER_BYTES; i++) {
+    io->put(header[i], io->arg);
+  }
+  for (i = 0; i < len; i++) {
+    io->put(buf[i], io->arg);
+  }
+  io->put(crc & 0xFF, io->arg);
+  io->put((crc >> 8) & 0xFF, io->arg);
+}
+
+/**
+ * @brief Encode with the run length encoding.
+ * @details
+ * The output is a sequence of (count - 1, value) pairs.
+ *
+ * @param src The source bytes.
+ * @param siz The number of source bytes.
+ * @param dst The destination buffer.
+ * @param max The size of the destination buffer.
+ *
+ * @return The number of encoded bytes or 0 if it does not fit.
+ */
+static unsigned int rle_encode(
+    const unsigned char *src, unsigned int siz,
+    unsigned char *dst, unsigned int max)
+{
+  unsigned int i = 0;
+  unsigned int n = 0;
+
+  while (i < siz) {
+    unsigned int run = 1;
+    while ((i + run < siz) && (run < 256) && (src[i + run] == src[i])) {
+      run++;
+    }
+    if (max < n + 2) {
+      return 0;
+    }
+    dst[n++] = run - 1;
+    dst[n++] = src[i];
+    i += run;
+  }
+  return n;
+}
+
+/**
+ * @brief Decode the run length encoding.
+ *
+ * @param src The encoded bytes.
+ * @param siz The number of encoded bytes.
+ * @param dst The destination buffer.
+ * @param max The size of the destination buffer.
+ *
+ * @return The number of decoded bytes or -1 on failure.
+ */
+static int rle_decode(
+    const unsigned char *src, unsigned int siz,
+    unsigned char *dst, unsigned int max)
+{
+  unsigned int i;
+  unsigned int n = 0;
+
+  if (siz % 2) {
+    return -1;
+  }
+  for (i = 0; i < siz; i += 2) {
+    unsigned int run = src[i] + 1;
+    if (max < n + run) {
+      return -1;
+    }
+    memset(dst + n, src[i + 1], run);
+    n += run;
+  }
+  return n;
+}
+
+/**
+ * @brief Send the acknowledgement of the target.
+ *
+ * @param p The target context.
+ */
+static void target_ack(flash_xfer_target_t *p)
+{
+  unsigned char buf[2];
+  buf[0] = p->acked;
+  buf[1] = p->status ? 1 : 0;
+  tx_frame(p->io, FLASH_XFER_TYPE_ACK, p->acked, buf, sizeof(buf));
+}
+
+/**
+ * @brief Handle a frame received by the target.
+ *
+ * @param p The target context.
+ */
+static void target_frame(flash_xfer_target_t *p)
+{
+  unsigned char type = p->rx.header[1];
+  unsigned char seq = p->rx.header[2];
+  flash_xfer_slot_t *slot = &p->slot[p->tail % FLASH_XFER_WINDOW];
+
+  if ((seq != p->expect) || p->end) {
+    /*
+     * A frame sent again or one after a dropped frame.
+     * The acknowledgement tells the host where to restart.
+     */
+    target_ack(p);
+    return;
+  }
+  switch (type) {
+    case FLASH_XFER_TYPE_DATA:
+      if (p->rx.payload == p->discard) {
+        return;
+      }
+      slot->seq = seq;
+      slot->len = p->rx.len;
+      slot->state = SLOT_FILLED;
+      p->tail++;
+      p->expect++;
+      break;
+    case FLASH_XFER_TYPE_END:
+      p->end = 1;
+      p->expect++;
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief Run the program engine of the target.
+ * @details
+ * It starts an erase or a program cycle and returns without waiting.
+ *
+ * @param p The target context.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int target_program(flash_xfer_target_t *p)
+{
+  flash_xfer_slot_t *slot = &p->slot[p->head % FLASH_XFER_WINDOW];
+  unsigned int limit = p->info.sector_count * p->info.sector_bytes;
+  unsigned int addr;
+  unsigned int sector;
+  int siz;
+
+  if (p->busy) {
+    int r = flash_busy();
+    if (r < 0) {
+      return -1;
+    }
+    if (r) {
+      return 0;
+    }
+    p->busy = 0;
+    if (p->erasing) {
+      p->erasing = 0;
+    } else {
+      slot->state = SLOT_FREE;
+      p->head++;
+      p->acked = slot->seq + 1;
+      target_ack(p);
+      slot = &p->slot[p->head % FLASH_XFER_WINDOW];
+    }
+  }
+
+  if (p->head == p->tail) {
+    if (p->end && (p->acked != p->expect)) {
+      p->acked = p->expect;
+      target_ack(p);
+    }
+    return 0;
+  }
+
+  if (slot->len < 5) {
+    return -1;
+  }
+  addr = slot->payload[0]
+    | (slot->payload[1] << 8)
+    | (slot->payload[2] << 16)
+    | ((unsigned int)slot->payload[3] << 24);
+  if ((addr % FLASH_XFER_DATA_BYTES) || (limit <= addr)) {
+    return -1;
+  }
+  sector = addr / p->info.sector_bytes;
+  if (!p->erased[sector]) {
+    if (flash_sector_erase_start(sector) != 0) {
+      return -1;
+    }
+    p->erased[sector] = 1;
+    p->erasing = 1;
+    p->busy = 1;
+    return 0;
+  }
+
+  if (slot->payload[4] & FLASH_XFER_FLAG_RLE) {
+    siz = rle_decode(slot->payload + 5, slot->len - 5, p->page, sizeof(p->page));
+  } else {
+    siz = slot->len - 5;
+    if (FLASH_XFER_DATA_BYTES < siz) {
+      return -1;
+    }
+    memcpy(p->page, slot->payload + 5, siz);
+  }
+  if ((siz <= 0) || (limit < addr + siz)) {
+    return -1;
+  }
+  if (flash_program_start(addr, p->page, siz) != 0) {
+    return -1;
+  }
+  p->busy = 1;
+  return 0;
+}
+
+/**
+ * @brief Initialize the target.
+ *
+ * @param p The target context.
+ * @param io The byte stream to the host.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_xfer_target_init(flash_xfer_target_t *p, const flash_xfer_io_t *io)
+{
+  memset(p, 0, sizeof(*p));
+  p->io = io;
+  if (flash_info(&p->info) != 0) {
+    return -1;
+  }
+  if (FLASH_XFER_SECTOR_COUNT_MAX < p->info.sector_count) {
+    return -1;
+  }
+  if (p->info.page_bytes % FLASH_XFER_DATA_BYTES) {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Run the target.
+ *
+ * @param p The target context.
+ *
+ * @retval FLASH_XFER_RUNNING The transfer is running.
+ * @retval FLASH_XFER_DONE All pages are programmed.
+ * @retval FLASH_XFER_ERROR Failure.
+ */
+int flash_xfer_target_poll(flash_xfer_target_t *p)
+{
+  int c;
+
+  if (p->status) {
+    return FLASH_XFER_ERROR;
+  }
+
+  /*
+   * Receive until a frame completes, then give the program engine
+   * a chance so a finished page is followed by the next one at once.
+   */
+  while ((c = p->io->get(p->io->arg)) >= 0) {
+    int r = rx_put(&p->rx, c);
+    if (r == RX_READY) {
+      flash_xfer_slot_t *slot = &p->slot[p->tail % FLASH_XFER_WINDOW];
+      p->rx.payload = (slot->state == SLOT_FREE) ? slot->payload : p->discard;
+    }
+    if (r == RX_FRAME) {
+      target_frame(p);
+      break;
+    }
+  }
+
+  if (target_program(p) != 0) {
+    p->status = -1;
+    target_ack(p);
+    return FLASH_XFER_ERROR;
+  }
+
+  if (p->end && (p->head == p->tail) && !p->busy) {
+    return FLASH_XFER_DONE;
+  }
+  return FLASH_XFER_RUNNING;
+}
+
+/**
+ * @brief Send a frame of the host.
+ *
+ * @param p The host context.
+ * @param index The frame index.
+ */
+static void host_send(flash_xfer_host_t *p, unsigned int index)
+{
+  unsigned int ofs = index * FLASH_XFER_DATA_BYTES;
+  unsigned int siz;
+  unsigned int n = 0;
+  unsigned int addr;
+
+  if (index == p->frames) {
+    tx_frame(p->io, FLASH_XFER_TYPE_END, index & 0xFF, 0, 0);
+    return;
+  }
+
+  addr = p->addr + ofs;
+  siz = p->siz - ofs;
+  if (FLASH_XFER_DATA_BYTES < siz) {
+    siz = FLASH_XFER_DATA_BYTES;
+  }
+  p->txbuf[0] = addr & 0xFF;
+  p->txbuf[1] = (addr >> 8) & 0xFF;
+  p->txbuf[2] = (addr >> 16) & 0xFF;
+  p->txbuf[3] = (addr >> 24) & 0xFF;
+  if (p->rle) {
+    n = rle_encode(p->image + ofs, siz, p->txbuf + 5, siz - 1);
+  }
+  if (n) {
+    p->txbuf[4] = FLASH_XFER_FLAG_RLE;
+  } else {
+    p->txbuf[4] = 0;
+    memcpy(p->txbuf + 5, p->image + ofs, siz);
+    n = siz;
+  }
+  tx_frame(p->io, FLASH_XFER_TYPE_DATA, index & 0xFF, p->txbuf, 5 + n);
+}
+
+/**
+ * @brief Initialize the host.
+ *
+ * @param p The host context.
+ * @param io The byte stream to the target.
+ * @param image The image.
+ * @param siz The size of the image.
+ * @param addr The byte address of the image on the target. It must be page aligned.
+ * @param rle Use the run length encoding for the pages where it is smaller.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_xfer_host_init(
+    flash_xfer_host_t *p, const flash_xfer_io_t *io,
+    const unsigned char *image, unsigned int siz, unsigned int addr, int rle)
+{
+  memset(p, 0, sizeof(*p));
+  if (addr % FLASH_XFER_DATA_BYTES) {
+    return -1;
+  }
+  p->io = io;
+  p->image = image;
+  p->siz = siz;
+  p->addr = addr;
+  p->rle = rle;
+  p->frames = (siz + FLASH_XFER_DATA_BYTES - 1) / FLASH_XFER_DATA_BYTES;
+  p->rx.payload = p->rxbuf;
+  return 0;
+}
+
+/**
+ * @brief Run the host.
+ *
+ * @param p The host context.
+ * @param now_us The current time in microseconds.
+ *
+ * @retval FLASH_XFER_RUNNING The transfer is running.
+ * @retval FLASH_XFER_DONE The target has programmed the image.
+ * @retval FLASH_XFER_ERROR Failure.
+ */
+int flash_xfer_host_poll(flash_xfer_host_t *p, unsigned int now_us)
+{
+  int c;
+
+  if (!p->started) {
+    p->started = 1;
+    p->last_us = now_us;
+  }
+
+  while ((c = p->io->get(p->io->arg)) >= 0) {
+    unsigned int ahead;
+    if (rx_put(&p->rx, c) != RX_FRAME) {
+      continue;
+    }
+    if ((p->rx.header[1] != FLASH_XFER_TYPE_ACK) || (p->rx.len != 2)) {
+      continue;
+    }
+    if (p->rxbuf[1]) {
+      return FLASH_XFER_ERROR;
+    }
+    /*
+     * The target answers the frames sent again even while it waits
+     * for a long erase cycle, so it is alive and the retries restart.
+     */
+    p->retry = 0;
+    /*
+     * The acknowledgement is cumulative. Anything outside of
+     * the frames in flight is a stale one.
+     */
+    ahead = (unsigned char)(p->rxbuf[0] - p->base);
+    if ((ahead == 0) || (p->next - p->base < ahead)) {
+      continue;
+    }
+    p->base += ahead;
+    p->last_us = now_us;
+  }
+
+  if (p->frames < p->base) {
+    return FLASH_XFER_DONE;
+  }
+
+  if (now_us - p->last_us >= FLASH_XFER_TIMEOUT_US) {
+    if (FLASH_XFER_RETRY_MAX <= p->retry++) {
+      return FLASH_XFER_ERROR;
+    }
+    p->next = p->base;
+    p->last_us = now_us;
+  }
+
+  while ((p->next <= p->frames) && (p->next - p->base < FLASH_XFER_WINDOW)) {
+    host_send(p, p->next);
+    p->next++;
+  }
+  return FLASH_XFER_RUNNING;
+}
@@ -0,0 +1,236 @@
+/**
+ * @file flash_xfer.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_XFER_H
+#define FLASH_XFER_H
+
+#include "flash.h"
+
+/**
+ * @brief Frame layout.
+ * @details
+ * All multi-byte fields are little endian.
+ *
+ * - sof (1 byte) : FLASH_XFER_SOF
+ * - type (1 byte) : FLASH_XFER_TYPE_*
+ * - seq (1 byte) : The sequence number.
+ * - len (2 bytes) : The number of payload bytes.
+ * - payload (len bytes)
+ * - crc (2 bytes) : CRC-16/CCITT of type, seq, len and payload.
+ *
+ * DATA payload
+ * - addr (4 bytes) : The byte address of the page.
+ * - flags (1 byte) : FLASH_XFER_FLAG_*
+ * - data : The page data, run length encoded with FLASH_XFER_FLAG_RLE.
+ *
+ * ACK payload
+ * - next (1 byte) : The next sequence number expected, i.e. all before it are programmed.
+ * - status (1 byte) : 0 for success, !0 for failure.
+ *
+ * END payload : none.
+ */
+#define FLASH_XFER_SOF              (0x7E)
+#define FLASH_XFER_TYPE_DATA        (0x01)
+#define FLASH_XFER_TYPE_ACK         (0x02)
+#define FLASH_XFER_TYPE_END         (0x03)
+#define FLASH_XFER_FLAG_RLE         (1 << 0)
+
+#define FLASH_XFER_HEADER_BYTES     (5)
+#define FLASH_XFER_CRC_BYTES        (2)
+#define FLASH_XFER_DATA_BYTES       (256)
+#define FLASH_XFER_PAYLOAD_MAX      (5 + FLASH_XFER_DATA_BYTES)
+
+/**
+ * @brief Number of frames in flight.
+ * @details
+ * The target has the same number of frame buffers, so it receives
+ * the following frames while a page is in the program cycle.
+ */
+#define FLASH_XFER_WINDOW           (4)
+
+/**
+ * @brief Retransmission timeout of the host in microseconds.
+ */
+#define FLASH_XFER_TIMEOUT_US       (200000)
+
+/**
+ * @brief Retransmissions of the host before giving up.
+ */
+#define FLASH_XFER_RETRY_MAX        (10)
+
+/**
+ * @brief Maximum number of sectors the target can handle.
+ */
+#define FLASH_XFER_SECTOR_COUNT_MAX (32)
+
+#define FLASH_XFER_RUNNING          (0)
+#define FLASH_XFER_DONE             (1)
+#define FLASH_XFER_ERROR            (-1)
+
+/**
+ * @brief Byte stream.
+ * @details
+ * get returns the next byte, or -1 when no byte is available, without blocking.
+ * put sends a byte.
+ */
+typedef struct {
+  int (*get)(void *arg);
+  void (*put)(int c, void *arg);
+  void *arg;
+} flash_xfer_io_t;
+
+/**
+ * @brief Frame receiver.
+ */
+typedef struct {
+  int state;
+  unsigned int count;
+  unsigned int len;
+  unsigned char header[FLASH_XFER_HEADER_BYTES];
+  unsigned char crc[FLASH_XFER_CRC_BYTES];
+  unsigned char *payload;
+} flash_xfer_rx_t;
+
+/**
+ * @brief Frame buffer of the target.
+ */
+typedef struct {
+  int state;
+  unsigned char seq;
+  unsigned int len;
+  unsigned char payload[FLASH_XFER_PAYLOAD_MAX];
+} flash_xfer_slot_t;
+
+/**
+ * @brief Target context.
+ */
+typedef struct {
+  const flash_xfer_io_t *io;
+  flash_info_t info;
+  flash_xfer_rx_t rx;
+  flash_xfer_slot_t slot[FLASH_XFER_WINDOW];
+  unsigned char discard[FLASH_XFER_PAYLOAD_MAX];
+  unsigned int head;
+  unsigned int tail;
+  unsigned char expect;
+  unsigned char acked;
+  int busy;
+  int erasing;
+  int end;
+  int status;
+  unsigned char erased[FLASH_XFER_SECTOR_COUNT_MAX];
+  unsigned char page[FLASH_XFER_DATA_BYTES];
+} flash_xfer_target_t;
+
+/**
+ * @brief Host context.
+ */
+typedef struct {
+  const flash_xfer_io_t *io;
+  const unsigned char *image;
+  unsigned int siz;
+  unsigned int addr;
+  int rle;
+  flash_xfer_rx_t rx;
+  unsigned char rxbuf[FLASH_XFER_PAYLOAD_MAX];
+  unsigned char txbuf[FLASH_XFER_PAYLOAD_MAX];
+  unsigned int frames;
+  unsigned int base;
+  unsigned int next;
+  unsigned int last_us;
+  unsigned int retry;
+  int started;
+} flash_xfer_host_t;
+
+/**
+ * @brief Initialize the target.
+ *
+ * @param p The target context.
+ * @param io The byte stream to the host.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_xfer_target_init(flash_xfer_target_t *p, const flash_xfer_io_t *io);
+
+/**
+ * @brief Run the target.
+ * @details
+ * Call it repeatedly. It never waits for a program or erase cycle,
+ * so the frames keep being received while a page is programmed.
+ * A sector is erased before the first page in it is programmed.
+ * A frame is acknowledged when its page has been programmed.
+ *
+ * @param p The target context.
+ *
+ * @retval FLASH_XFER_RUNNING The transfer is running.
+ * @retval FLASH_XFER_DONE All pages are programmed.
+ * @retval FLASH_XFER_ERROR Failure.
+ */
+int flash_xfer_target_poll(flash_xfer_target_t *p);
+
+/**
+ * @brief Initialize the host.
+ *
+ * @param p The host context.
+ * @param io The byte stream to the target.
+ * @param image The image.
+ * @param siz The size of the image.
+ * @param addr The byte address of the image on the target. It must be page aligned.
+ * @param rle Use the run length encoding for the pages where it is smaller.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_xfer_host_init(
+    flash_xfer_host_t *p, const flash_xfer_io_t *io,
+    const unsigned char *image, unsigned int siz, unsigned int addr, int rle);
+
+/**
+ * @brief Run the host.
+ * @details
+ * Call it repeatedly. Up to FLASH_XFER_WINDOW frames are sent ahead
+ * of the acknowledgements, and the frames after the last acknowledged
+ * one are sent again on the timeout.
+ *
+ * @param p The host context.
+ * @param now_us The current time in microseconds.
+ *
+ * @retval FLASH_XFER_RUNNING The transfer is running.
+ * @retval FLASH_XFER_DONE The target has programmed the image.
+ * @retval FLASH_XFER_ERROR Failure.
+ */
+int flash_xfer_host_poll(flash_xfer_host_t *p, unsigned int now_us);
+
+#endif
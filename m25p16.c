@@ -34,10 +34,111 @@
 
 #include "m25p16.h"
 
+#ifndef SPI_INIT
 #define SPI_INIT()      /* Your codes */
+#endif
+
+#ifndef SPI_ASSERT
 #define SPI_ASSERT()    /* Your codes */
+#endif
+
+#ifndef SPI_TRANSMIT
 #define SPI_TRANSMIT(D) /* Your codes */
+#endif
+
+#ifndef SPI_DEASSERT
 #define SPI_DEASSERT()  /* Your codes */
+#endif
+
+/*
+ * Wide frames for the payload phases.
+ * Define SPI_FRAME_BITS as 16 or 32 with SPI_TRANSMIT16(D) or SPI_TRANSMIT32(D)
+ * if the controller moves wide words more efficiently than bytes.
+ * The first byte on the bus is the most significant byte of a word.
+ * Instructions, addresses and the tail of a payload use 8-bit frames.
+ */
+#ifndef SPI_FRAME_BITS
+#define SPI_FRAME_BITS  (8)
+#endif
+
+#if (SPI_FRAME_BITS == 32) && !defined(SPI_TRANSMIT32)
+#error "SPI_FRAME_BITS 32 needs SPI_TRANSMIT32(D)."
+#elif (SPI_FRAME_BITS == 16) && !defined(SPI_TRANSMIT16)
+#error "SPI_FRAME_BITS 16 needs SPI_TRANSMIT16(D)."
+#endif
+
+#if SPI_FRAME_BITS == 32
+#define WORD_BYTES          (4)
+#define WORD_TRANSMIT(D)    SPI_TRANSMIT32(D)
+#elif SPI_FRAME_BITS == 16
+#define WORD_BYTES          (2)
+#define WORD_TRANSMIT(D)    SPI_TRANSMIT16(D)
+#elif SPI_FRAME_BITS != 8
+#error "SPI_FRAME_BITS must be 8, 16 or 32."
+#endif
+
+/*
+ * Instrumentation hooks.
+ * They are called before the chip select is asserted, after it is
+ * deasserted, when an instruction code is sent and when the status
+ * register is read, which covers every WIP poll of the flash layer.
+ * They are empty unless defined, e.g. in the header given by
+ * M25P16_HOOK_HEADER, to feed cycle counters, trace buffers or histograms.
+ */
+#ifdef M25P16_HOOK_HEADER
+#include M25P16_HOOK_HEADER
+#endif
+
+#ifndef M25P16_HOOK_ASSERT
+#define M25P16_HOOK_ASSERT()
+#endif
+
+#ifndef M25P16_HOOK_DEASSERT
+#define M25P16_HOOK_DEASSERT()
+#endif
+
+#ifndef M25P16_HOOK_COMMAND
+#define M25P16_HOOK_COMMAND(CMD)
+#endif
+
+#ifndef M25P16_HOOK_STATUS
+#define M25P16_HOOK_STATUS(SREG)
+#endif
+
+#define CS_ASSERT()     do { M25P16_HOOK_ASSERT(); SPI_ASSERT(); } while (0)
+#define CS_DEASSERT()   do { SPI_DEASSERT(); M25P16_HOOK_DEASSERT(); } while (0)
+#define COMMAND(CMD)    do { M25P16_HOOK_COMMAND(CMD); SPI_TRANSMIT(CMD); } while (0)
+
+/*
+ * Instruction headers.
+ * An instruction code and a 24-bit address are encoded at once into a
+ * contiguous buffer, which is a constant for a constant address, and go
+ * out with SPI_TRANSMIT_BLOCK. Define SPI_TRANSMIT_BLOCK(BUF, SIZ) to send
+ * a buffer in one transfer, e.g. by DMA. The bytes received are discarded.
+ */
+#define HEADER_BYTES    (4)
+#define HEADER(CMD, ADDR) \
+  { (CMD), ((ADDR) >> 16) & 0xFF, ((ADDR) >> 8) & 0xFF, ((ADDR) >> 0) & 0xFF }
+#define HEADER_TRANSMIT(H) \
+  do { M25P16_HOOK_COMMAND((H)[0]); SPI_TRANSMIT_BLOCK((H), sizeof(H)); } while (0)
+
+#ifndef SPI_TRANSMIT_BLOCK
+#define SPI_TRANSMIT_BLOCK(BUF, SIZ)    transmit_block((BUF), (SIZ))
+
+/**
+ * @brief Send a buffer byte by byte.
+ *
+ * @param buf The buffer.
+ * @param siz The number of bytes.
+ */
+static void transmit_block(const uint8_t *buf, uint32_t siz)
+{
+  uint32_t i;
+  for (i = 0; i < siz; i++) {
+    SPI_TRANSMIT(buf[i]);
+  }
+}
+#endif
 
 #define CMD_WRITE_ENABLE                    (0x06)
 #define CMD_WRITE_DISABLE                   (0x04)
@@ -51,6 +152,54 @@
 #define CMD_DEEP_POWER_DOWN                 (0xB9)
 #define CMD_RELEASE_FROM_DEEP_POWER_DOWN    (0xAB)
 
+/**
+ * @brief Receive the payload of a read.
+ *
+ * @param buf The destination buffer.
+ * @param siz The number of bytes.
+ */
+static void payload_receive(uint8_t *buf, uint32_t siz)
+{
+  uint32_t i = 0;
+#ifdef WORD_BYTES
+  for (; i + WORD_BYTES <= siz; i += WORD_BYTES) {
+    uint32_t w = WORD_TRANSMIT(0);
+    int k;
+    for (k = WORD_BYTES - 1; k >= 0; k--) {
+      buf[i + k] = w & 0xFF;
+      w >>= 8;
+    }
+  }
+#endif
+  for (; i < siz; i++) {
+    buf[i] = SPI_TRANSMIT(0);
+  }
+}
+
+/**
+ * @brief Send the payload of a program.
+ *
+ * @param buf The source buffer.
+ * @param siz The number of bytes.
+ */
+static void payload_send(const uint8_t *buf, uint32_t siz)
+{
+  uint32_t i = 0;
+#ifdef WORD_BYTES
+  for (; i + WORD_BYTES <= siz; i += WORD_BYTES) {
+    uint32_t w = 0;
+    int k;
+    for (k = 0; k < WORD_BYTES; k++) {
+      w = (w << 8) | buf[i + k];
+    }
+    WORD_TRANSMIT(w);
+  }
+#endif
+  for (; i < siz; i++) {
+    SPI_TRANSMIT(buf[i]);
+  }
+}
+
 void m25p16_init(void)
 {
   SPI_INIT();
@@ -65,9 +214,9 @@ void m25p16_init(void)
  */
 void m25p16_write_enable(void)
 {
-  SPI_ASSERT();
-  SPI_TRANSMIT(CMD_WRITE_ENABLE);
-  SPI_DEASSERT();
+  CS_ASSERT();
+  COMMAND(CMD_WRITE_ENABLE);
+  CS_DEASSERT();
 }
 
 /**
@@ -85,9 +234,9 @@ void m25p16_write_enable(void)
  */
 void m25p16_write_disable(void)
 {
-  SPI_ASSERT();
-  SPI_TRANSMIT(CMD_WRITE_DISABLE);
-  SPI_DEASSERT();
+  CS_ASSERT();
+  COMMAND(CMD_WRITE_DISABLE);
+  CS_DEASSERT();
 }
 
 /**
@@ -105,8 +254,8 @@ void m25p16_write_disable(void)
 void m25p16_read_identification(m25p16_identification_t *p)
 {
   int i;
-  SPI_ASSERT();
-  SPI_TRANSMIT(CMD_READ_IDENTIFICATION);
+  CS_ASSERT();
+  COMMAND(CMD_READ_IDENTIFICATION);
   p->manufacturer = SPI_TRANSMIT(0);
   p->memory_type = SPI_TRANSMIT(0);
   p->memory_capacity = SPI_TRANSMIT(0);
@@ -114,7 +263,7 @@ void m25p16_read_identification(m25p16_identification_t *p)
   for (i = 0; i < p->cfd_length; i++) {
     p->cfd_content[i] = SPI_TRANSMIT(0);
   }
-  SPI_DEASSERT();
+  CS_DEASSERT();
 }
 
 /**
@@ -127,10 +276,12 @@ void m25p16_read_identification(m25p16_identification_t *p)
  */
 void m25p16_read_status_register(uint8_t *sreg)
 {
-  SPI_ASSERT();
-  SPI_TRANSMIT(CMD_READ_STATUS_REGISTER);
+  static const uint8_t header[] = { CMD_READ_STATUS_REGISTER };
+  CS_ASSERT();
+  HEADER_TRANSMIT(header);
   *sreg = SPI_TRANSMIT(0);
-  SPI_DEASSERT();
+  CS_DEASSERT();
+  M25P16_HOOK_STATUS(*sreg);
 }
 
 /**
@@ -148,10 +299,10 @@ void m25p16_read_status_register(uint8_t *sreg)
  */
 void m25p16_write_status_register(uint8_t sreg)
 {
-  SPI_ASSERT();
-  SPI_TRANSMIT(CMD_WRITE_STATUS_REGISTER);
+  CS_ASSERT();
+  COMMAND(CMD_WRITE_STATUS_REGISTER);
   SPI_TRANSMIT(sreg);
-  SPI_DEASSERT();
+  CS_DEASSERT();
 }
 
 /**
@@ -172,16 +323,11 @@ void m25p16_write_status_register(uint8_t sreg)
  */
 void m25p16_read_data_bytes(uint32_t addr, uint8_t *buf, uint32_t siz)
 {
-  uint32_t i;
-  SPI_ASSERT();
-  SPI_TRANSMIT(CMD_READ_DATA_BYTES);
-  SPI_TRANSMIT(addr >> 16);
-  SPI_TRANSMIT(addr >>  8);
-  SPI_TRANSMIT(addr >>  0);
-  for (i = 0; i < siz; i++) {
-    buf[i] = SPI_TRANSMIT(0);
-  }
-  SPI_DEASSERT();
+  const uint8_t header[HEADER_BYTES] = HEADER(CMD_READ_DATA_BYTES, addr);
+  CS_ASSERT();
+  HEADER_TRANSMIT(header);
+  payload_receive(buf, siz);
+  CS_DEASSERT();
 }
 
 /**
@@ -213,16 +359,11 @@ void m25p16_read_data_bytes(uint32_t addr, uint8_t *buf, uint32_t siz)
  */
 void m25p16_page_program(uint32_t addr, uint8_t *buf, uint32_t siz)
 {
-  uint32_t i;
-  SPI_ASSERT();
-  SPI_TRANSMIT(CMD_PAGE_PROGRAM);
-  SPI_TRANSMIT(addr >> 16);
-  SPI_TRANSMIT(addr >>  8);
-  SPI_TRANSMIT(addr >>  0);
-  for (i = 0; i < siz; i++) {
-    SPI_TRANSMIT(buf[i]);
-  }
-  SPI_DEASSERT();
+  const uint8_t header[HEADER_BYTES] = HEADER(CMD_PAGE_PROGRAM, addr);
+  CS_ASSERT();
+  HEADER_TRANSMIT(header);
+  payload_send(buf, siz);
+  CS_DEASSERT();
 }
 
 /**
@@ -245,12 +386,10 @@ void m25p16_page_program(uint32_t addr, uint8_t *buf, uint32_t siz)
  */
 void m25p16_sector_erase(uint32_t addr)
 {
-  SPI_ASSERT();
-  SPI_TRANSMIT(CMD_SECTOR_ERASE);
-  SPI_TRANSMIT(addr >> 16);
-  SPI_TRANSMIT(addr >>  8);
-  SPI_TRANSMIT(addr >>  0);
-  SPI_DEASSERT();
+  const uint8_t header[HEADER_BYTES] = HEADER(CMD_SECTOR_ERASE, addr);
+  CS_ASSERT();
+  HEADER_TRANSMIT(header);
+  CS_DEASSERT();
 }
 
 /**
@@ -273,9 +412,9 @@ void m25p16_sector_erase(uint32_t addr)
  */
 void m25p16_bulk_erase(void)
 {
-  SPI_ASSERT();
-  SPI_TRANSMIT(CMD_BULK_ERASE);
-  SPI_DEASSERT();
+  CS_ASSERT();
+  COMMAND(CMD_BULK_ERASE);
+  CS_DEASSERT();
 }
 
 /**
@@ -300,9 +439,9 @@ void m25p16_bulk_erase(void)
  */
 void m25p16_deep_power_down(void)
 {
-  SPI_ASSERT();
-  SPI_TRANSMIT(CMD_DEEP_POWER_DOWN);
-  SPI_DEASSERT();
+  CS_ASSERT();
+  COMMAND(CMD_DEEP_POWER_DOWN);
+  CS_DEASSERT();
 }
 
 /**
@@ -321,8 +460,8 @@ void m25p16_deep_power_down(void)
  */
 void m25p16_release_from_deep_power_down(void)
 {
-  SPI_ASSERT();
-  SPI_TRANSMIT(CMD_RELEASE_FROM_DEEP_POWER_DOWN);
-  SPI_DEASSERT();
+  CS_ASSERT();
+  COMMAND(CMD_RELEASE_FROM_DEEP_POWER_DOWN);
+  CS_DEASSERT();
 }
 
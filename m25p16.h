@@ -42,6 +42,16 @@
 #define M25P16_SECTOR_COUNT     (32)
 #define M25P16_SECTOR_BYTE_SIZE (65536)
 
+#define M25P16_PAGE_PROGRAM_TIME_TYP_US (640)
+#define M25P16_SECTOR_ERASE_TIME_TYP_MS (600)
+#define M25P16_BULK_ERASE_TIME_TYP_MS   (13000)
+#define M25P16_PAGE_PROGRAM_TIME_MAX_US (5000)
+#define M25P16_SECTOR_ERASE_TIME_MAX_MS (3000)
+#define M25P16_BULK_ERASE_TIME_MAX_MS   (40000)
+
+#define M25P16_DEEP_POWER_DOWN_TIME_MAX_US (3)
+#define M25P16_RELEASE_TIME_MAX_US         (30)
+
 typedef struct {
   uint8_t manufacturer;
   uint8_t memory_type;
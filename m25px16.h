@@ -41,6 +41,20 @@
 #define M25PX16_PAGE_BYTE_SIZE   (256)
 #define M25PX16_SECTOR_COUNT     (32)
 #define M25PX16_SECTOR_BYTE_SIZE (65536)
+#define M25PX16_SUBSECTOR_COUNT     (512)
+#define M25PX16_SUBSECTOR_BYTE_SIZE (4096)
+
+#define M25PX16_PAGE_PROGRAM_TIME_TYP_US    (800)
+#define M25PX16_SUBSECTOR_ERASE_TIME_TYP_MS (70)
+#define M25PX16_SECTOR_ERASE_TIME_TYP_MS    (600)
+#define M25PX16_BULK_ERASE_TIME_TYP_MS      (15000)
+#define M25PX16_PAGE_PROGRAM_TIME_MAX_US    (5000)
+#define M25PX16_SUBSECTOR_ERASE_TIME_MAX_MS (150)
+#define M25PX16_SECTOR_ERASE_TIME_MAX_MS    (3000)
+#define M25PX16_BULK_ERASE_TIME_MAX_MS      (80000)
+
+#define M25PX16_DEEP_POWER_DOWN_TIME_MAX_US (3)
+#define M25PX16_RELEASE_TIME_MAX_US         (30)
 
 typedef struct {
   uint8_t manufacturer;
@@ -60,6 +74,15 @@ typedef struct {
  */
 #define M25PX16_SREG_WRITE_PROTECT(SREG)         ((SREG) & (1 << 7))
 
+/**
+ * @brief Top/Bottom.
+ * @details
+ * The top/bottom bit is non-volatile.
+ * It selects whether the area defined by the block protect bits starts from the top (0)
+ * or from the bottom (1) of the memory.
+ */
+#define M25PX16_SREG_TOP_BOTTOM(SREG)            ((SREG) & (1 << 5))
+
 /**
  * @brief Block Protect 2.
  * @details
@@ -143,6 +166,7 @@ void m25px16_write_lock_register(uint32_t addr, uint8_t lock_register);
 void m25px16_read_lock_register(uint32_t addr, uint8_t *lock_register);
 void m25px16_read_data_bytes(uint32_t addr, uint8_t *buf, uint32_t siz);
 void m25px16_page_program(uint32_t addr, uint8_t *buf, uint32_t siz);
+void m25px16_subsector_erase(uint32_t addr);
 void m25px16_sector_erase(uint32_t addr);
 void m25px16_bulk_erase(void);
 void m25px16_deep_power_down(void);
@@ -0,0 +1,52 @@
+/**
+ * @file bench_hook.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef BENCH_HOOK_H
+#define BENCH_HOOK_H
+
+/*
+ * Instrumentation hooks of the drivers for the benchmark.
+ * They feed the counters of flash_bench.c. Give it to the drivers with
+ * -DM25P16_HOOK_HEADER="<bench_hook.h>" -DM25PX16_HOOK_HEADER="<bench_hook.h>"
+ * and link flash_bench.c; the other host programs build without both.
+ */
+
+#include "flash_bench.h"
+
+#define M25P16_HOOK_COMMAND(CMD)    flash_bench_command(CMD)
+#define M25P16_HOOK_STATUS(SREG)    flash_bench_status(SREG)
+#define M25PX16_HOOK_COMMAND(CMD)   flash_bench_command(CMD)
+#define M25PX16_HOOK_STATUS(SREG)   flash_bench_status(SREG)
+
+#endif
@@ -0,0 +1,178 @@
+/**
+ * @file flash_async_test.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+/*
+ * Test of one thread driving the asynchronous queues of two simulated chips.
+ *
+ * Build from the top directory, or run tools/flash_dev_test.sh:
+ *
+ *   cc -std=c99 -O2 -I. -Itools -include tools/sim_port.h \
+ *     -o async_test tools/flash_async_test.c flash_async.c \
+ *     tools/flash_sim_dev.c tools/flash_sim.c flash_bus.c flash_m25px16.c \
+ *     m25px16.c
+ *
+ * It checks the data on the chips, the completions and the overlap of the
+ * cycles of the two chips. It exits with 0 on success.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "flash_dev.h"
+#include "flash_async.h"
+#include "flash_sim.h"
+#include "flash_sim_dev.h"
+
+#define SPI_KHZ         (20000)
+#define ADDR            (0x10000)
+#define LENGTH          (16384)
+
+static unsigned char data[2][LENGTH];
+static unsigned char back[2][LENGTH];
+static int done_count;
+static int fail_count;
+
+/**
+ * @brief Report a check.
+ *
+ * @param name The name of the check.
+ * @param ok The result.
+ *
+ * @return 0 if it passed, 1 otherwise.
+ */
+static int check(const char *name, int ok)
+{
+  printf("%-32s %s\n", name, ok ? "ok" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+/**
+ * @brief Count the completions.
+ *
+ * @param op The completed operation.
+ * @param result 0 for success, !0 for failure.
+ */
+static void completed(flash_async_op_t *op, int result)
+{
+  (void)op;
+  done_count++;
+  if (result != 0) {
+    fail_count++;
+  }
+}
+
+/**
+ * @brief Set up an operation.
+ *
+ * @param op The operation.
+ * @param type The type.
+ * @param addr The address or the sector number.
+ * @param buf The buffer.
+ * @param siz The size.
+ */
+static void setup(flash_async_op_t *op, int type, unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  memset(op, 0, sizeof(*op));
+  op->type = type;
+  op->addr = addr;
+  op->buf = buf;
+  op->siz = siz;
+  op->callback = completed;
+}
+
+int main(void)
+{
+  flash_dev_t dev[2];
+  flash_async_t ctx[2];
+  flash_async_op_t op[2][3];
+  flash_sim_stats_t s[2];
+  unsigned int i;
+  unsigned int n;
+  int submitted = 1;
+  char name[64];
+  int fail = 0;
+
+  for (i = 0; i < LENGTH; i++) {
+    data[0][i] = (unsigned char)((i * 2654435761u) >> 13);
+    data[1][i] = (unsigned char)((i * 40503u) >> 7);
+  }
+  for (n = 0; n < 2; n++) {
+    if ((flash_sim_dev_init(&dev[n], n, SPI_KHZ) != 0)
+        || (flash_async_init(&ctx[n], &dev[n]) != 0)) {
+      return check("init", 0);
+    }
+  }
+
+  /*
+   * The operations of a queue run in their order,
+   * so the read sees the erase and the program.
+   */
+  for (n = 0; n < 2; n++) {
+    setup(&op[n][0], FLASH_ASYNC_SECTOR_ERASE, ADDR / 65536, 0, 0);
+    setup(&op[n][1], FLASH_ASYNC_PROGRAM, ADDR, data[n], LENGTH);
+    setup(&op[n][2], FLASH_ASYNC_READ, ADDR, back[n], LENGTH);
+    for (i = 0; i < 3; i++) {
+      submitted = submitted && (flash_async_submit(&ctx[n], &op[n][i]) == 0);
+    }
+  }
+  fail += check("submit", submitted);
+
+  /*
+   * One loop drives both chips and sleeps until the earlier of them.
+   */
+  for (;;) {
+    unsigned int d0 = flash_async_run(&ctx[0]);
+    unsigned int d1 = flash_async_run(&ctx[1]);
+    if ((d0 == FLASH_ASYNC_IDLE) && (d1 == FLASH_ASYNC_IDLE)) {
+      break;
+    }
+    flash_sim_delay_us((d0 < d1) ? d0 : d1);
+  }
+  fail += check("completed", (done_count == 6) && (fail_count == 0));
+
+  for (n = 0; n < 2; n++) {
+    flash_sim_chip(n);
+    snprintf(name, sizeof(name), "chip %u", n);
+    fail += check(name, (memcmp(flash_sim_memory() + ADDR, data[n], LENGTH) == 0)
+        && (memcmp(back[n], data[n], LENGTH) == 0));
+    flash_sim_stats(&s[n]);
+  }
+
+  /*
+   * The cycles of the two chips overlap in the time.
+   */
+  snprintf(name, sizeof(name), "overlap %.2f", (double)(s[0].busy_ns + s[1].busy_ns) / s[0].time_ns);
+  fail += check(name, s[0].busy_ns + s[1].busy_ns > s[0].time_ns * 3 / 2);
+
+  return fail ? 1 : 0;
+}
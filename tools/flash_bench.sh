@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# Build the benchmark for both backends and compare them on the simulated chips.
+# Run it from the top directory. The results go to bench.json.
+# Extra compiler flags can be given with BENCH_CFLAGS, e.g.
+# BENCH_CFLAGS=-DSPI_FRAME_BITS=32 for the wide SPI frames.
+#
+
+set -e
+
+CC=${CC:-cc}
+CFLAGS="-std=c99 -O2 -Wall -Wextra -I. -Itools -include tools/sim_port.h ${BENCH_CFLAGS}"
+HOOKS="-DM25P16_HOOK_HEADER=<bench_hook.h> -DM25PX16_HOOK_HEADER=<bench_hook.h>"
+COMMON="tools/flash_bench_main.c tools/flash_sim.c flash_bench.c flash_bus.c"
+
+$CC $CFLAGS $HOOKS -o bench_m25p16 $COMMON flash_m25p16.c m25p16.c
+$CC $CFLAGS $HOOKS -o bench_m25px16 $COMMON flash_m25px16.c m25px16.c
+
+{
+  echo "["
+  ./bench_m25p16 m25p16/m25p16 m25p16
+  echo ","
+  ./bench_m25p16 m25p16/m25px16 m25px16
+  echo ","
+  ./bench_m25px16 m25px16/m25px16 m25px16
+  echo "]"
+} > bench.json
+
+printf "%-16s %-8s %12s %10s %8s %8s %6s %6s %6s\n" \
+  backend/chip workload time_us bus_bytes commands programs sse se be
+./bench_m25p16 m25p16/m25p16 m25p16 -t
+./bench_m25p16 m25p16/m25px16 m25px16 -t
+./bench_m25px16 m25px16/m25px16 m25px16 -t
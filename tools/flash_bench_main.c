@@ -0,0 +1,122 @@
+/**
+ * @file flash_bench_main.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+/*
+ * Benchmark of a flash backend on a simulated chip.
+ *
+ * Build one program per backend from the top directory, e.g.
+ *
+ *   cc -std=c99 -O2 -I. -Itools -include tools/sim_port.h \
+ *     -DM25PX16_HOOK_HEADER="<bench_hook.h>" -o bench_m25px16 tools/flash_bench_main.c tools/flash_sim.c \
+ *     flash_bench.c flash_bus.c flash_m25px16.c m25px16.c
+ *
+ * and the same with flash_m25p16.c and m25p16.c, or run tools/flash_bench.sh
+ * to build and compare all combinations.
+ *
+ * Usage: bench_<backend> <label> <m25p16|m25px16> [-t] [-k spi_khz]
+ *
+ * It writes the results in JSON, or a table with -t.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash.h"
+#include "flash_bench.h"
+#include "flash_sim.h"
+
+#define SPI_KHZ_DEFAULT (20000)
+
+/**
+ * @brief Output function of the report.
+ *
+ * @param s The text.
+ * @param arg The stream.
+ */
+static void put(const char *s, void *arg)
+{
+  fputs(s, (FILE *)arg);
+}
+
+int main(int argc, char **argv)
+{
+  flash_bench_result_t r[FLASH_BENCH_COUNT];
+  unsigned int khz = SPI_KHZ_DEFAULT;
+  int table = 0;
+  int model;
+  int i;
+
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <label> <m25p16|m25px16> [-t] [-k spi_khz]\n", argv[0]);
+    return 1;
+  }
+  if (strcmp(argv[2], "m25p16") == 0) {
+    model = FLASH_SIM_M25P16;
+  } else if (strcmp(argv[2], "m25px16") == 0) {
+    model = FLASH_SIM_M25PX16;
+  } else {
+    fprintf(stderr, "unknown chip: %s\n", argv[2]);
+    return 1;
+  }
+  for (i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0) {
+      table = 1;
+    } else if ((strcmp(argv[i], "-k") == 0) && (i + 1 < argc)) {
+      khz = strtoul(argv[++i], 0, 0);
+    }
+  }
+
+  if ((flash_sim_init(model, khz) != 0) || (flash_init() != 0)) {
+    fprintf(stderr, "init failed\n");
+    return 1;
+  }
+  for (i = 0; i < FLASH_BENCH_COUNT; i++) {
+    if (flash_bench_run(i, &r[i]) != 0) {
+      fprintf(stderr, "%s: %s failed\n", argv[1], flash_bench_name(i));
+      return 1;
+    }
+  }
+
+  if (!table) {
+    flash_bench_json(argv[1], r, put, stdout);
+    return 0;
+  }
+  for (i = 0; i < FLASH_BENCH_COUNT; i++) {
+    printf("%-16s %-8s %12lu %10lu %8lu %8lu %6lu %6lu %6lu\n",
+        argv[1], flash_bench_name(i), r[i].time_us, r[i].bus_bytes,
+        r[i].commands, r[i].programs,
+        r[i].subsector_erases, r[i].sector_erases, r[i].bulk_erases);
+  }
+  return 0;
+}
@@ -0,0 +1,25 @@
+#!/bin/sh
+#
+# Build and run the tests of the flash layers on the simulated chips.
+# Run it from the top directory.
+#
+
+set -e
+
+CC=${CC:-cc}
+CFLAGS="-std=c99 -O2 -Wall -I. -Itools -include tools/sim_port.h"
+COMMON="tools/flash_sim_dev.c tools/flash_sim.c flash_bus.c flash_m25px16.c m25px16.c"
+
+$CC $CFLAGS -o stripe_test tools/flash_stripe_test.c flash_stripe.c $COMMON
+$CC $CFLAGS -o mirror_test tools/flash_mirror_test.c flash_mirror.c flash_lock.c $COMMON
+$CC $CFLAGS -o ecc_test tools/flash_ecc_test.c flash_ecc.c $COMMON
+$CC $CFLAGS -o uffd_test tools/flash_uffd_test.c tools/flash_uffd.c $COMMON -lpthread
+$CC $CFLAGS -o fs_test tools/flash_fs_test.c flash_fs.c flash_util.c $COMMON
+$CC $CFLAGS -o async_test tools/flash_async_test.c flash_async.c $COMMON
+
+./stripe_test
+./mirror_test
+./ecc_test
+./uffd_test
+./fs_test
+./async_test
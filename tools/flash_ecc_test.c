@@ -0,0 +1,301 @@
+/**
+ * @file flash_ecc_test.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+/*
+ * Test of the ECC layer on a simulated chip.
+ *
+ * Build from the top directory, or run tools/flash_dev_test.sh:
+ *
+ *   cc -std=c99 -O2 -I. -Itools -include tools/sim_port.h \
+ *     -o ecc_test tools/flash_ecc_test.c flash_ecc.c tools/flash_sim.c \
+ *     flash_bus.c flash_m25px16.c m25px16.c
+ *
+ * It checks the correction of every single-bit error of a page, the
+ * detection of double-bit errors and of errors in the code, the errors
+ * injected on the chip, a program over a page with a corrected error,
+ * and the roll-over of the parity generations. It exits with 0 on success.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "flash.h"
+#include "flash_ecc.h"
+#include "flash_sim.h"
+
+#define SPI_KHZ         (20000)
+#define PAGE_BYTES      (FLASH_ECC_DATA_BYTES)
+#define BITS            (PAGE_BYTES * 8)
+#define CODE_BITS       (22)
+#define ROUNDS          (12)
+
+static unsigned char data[PAGE_BYTES];
+static unsigned char work[PAGE_BYTES];
+static unsigned char back[PAGE_BYTES];
+
+/**
+ * @brief Report a check.
+ *
+ * @param name The name of the check.
+ * @param ok The result.
+ *
+ * @return 0 if it passed, 1 otherwise.
+ */
+static int check(const char *name, int ok)
+{
+  printf("%-32s %s\n", name, ok ? "ok" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+/**
+ * @brief Test pattern of a page.
+ *
+ * @param buf The destination of a page.
+ * @param page The page number.
+ * @param gen The generation of the data.
+ */
+static void pattern(unsigned char *buf, unsigned int page, unsigned int gen)
+{
+  unsigned int i;
+  for (i = 0; i < PAGE_BYTES; i++) {
+    buf[i] = (unsigned char)((i * 31) ^ (page * 7) ^ (gen * 13) ^ (i >> 3));
+  }
+}
+
+/**
+ * @brief Clear a bit on the chip behind the ECC layer.
+ *
+ * @param addr The byte address.
+ * @param bit The bit number, which has to be 1 on the chip.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int flip(unsigned int addr, unsigned int bit)
+{
+  unsigned char b;
+  if ((flash_read(addr, &b, 1) != 0) || !(b & (1 << bit))) {
+    return -1;
+  }
+  b &= ~(1 << bit);
+  return flash_program(addr, &b, 1);
+}
+
+/**
+ * @brief Find a bit which is 1 in a byte.
+ *
+ * @param b The byte, which is not 0.
+ *
+ * @return The bit number.
+ */
+static unsigned int one(unsigned char b)
+{
+  unsigned int bit = 0;
+  while (!(b & (1 << bit))) {
+    bit++;
+  }
+  return bit;
+}
+
+int main(void)
+{
+  unsigned char code[FLASH_ECC_CODE_BYTES];
+  unsigned char calc[FLASH_ECC_CODE_BYTES];
+  unsigned char bad[FLASH_ECC_CODE_BYTES];
+  flash_ecc_stats_t stats;
+  unsigned int page;
+  unsigned int i;
+  unsigned int j;
+  int ok;
+  int fail = 0;
+
+  pattern(data, 0, 0);
+  flash_ecc_calculate(data, code);
+
+  memset(work, 0xFF, PAGE_BYTES);
+  flash_ecc_calculate(work, calc);
+  fail += check("erased code", (calc[0] == 0xFF) && (calc[1] == 0xFF) && (calc[2] == 0xFF));
+
+  ok = 1;
+  for (i = 0; i < BITS; i++) {
+    memcpy(work, data, PAGE_BYTES);
+    work[i / 8] ^= 1 << (i % 8);
+    flash_ecc_calculate(work, calc);
+    if ((flash_ecc_correct(work, code, calc) != 1) || (memcmp(work, data, PAGE_BYTES) != 0)) {
+      ok = 0;
+    }
+  }
+  fail += check("single-bit errors", ok);
+
+  ok = 1;
+  for (i = 0; i < BITS; i++) {
+    j = (i * 577 + 1) % BITS;
+    if (j == i) {
+      continue;
+    }
+    memcpy(work, data, PAGE_BYTES);
+    work[i / 8] ^= 1 << (i % 8);
+    work[j / 8] ^= 1 << (j % 8);
+    flash_ecc_calculate(work, calc);
+    if (flash_ecc_correct(work, code, calc) != -1) {
+      ok = 0;
+    }
+  }
+  fail += check("double-bit errors", ok);
+
+  /*
+   * The code has 16 line parities in the first two bytes and 6 column
+   * parities in the upper bits of the third byte.
+   */
+  ok = 1;
+  for (i = 0; i < CODE_BITS; i++) {
+    j = (i < 16) ? i : (i + 2);
+    memcpy(bad, code, FLASH_ECC_CODE_BYTES);
+    bad[j / 8] ^= 1 << (j % 8);
+    memcpy(work, data, PAGE_BYTES);
+    if ((flash_ecc_correct(work, bad, code) != 2) || (memcmp(work, data, PAGE_BYTES) != 0)) {
+      ok = 0;
+    }
+  }
+  fail += check("code errors", ok);
+
+  if ((flash_sim_init(FLASH_SIM_M25PX16, SPI_KHZ) != 0)
+      || (flash_init() != 0) || (flash_ecc_init() != 0)) {
+    return check("init", 0);
+  }
+
+  ok = 1;
+  for (page = 0; page < 64; page++) {
+    pattern(data, page, 0);
+    if (flash_ecc_page_write(page, data, PAGE_BYTES) != 0) {
+      ok = 0;
+    }
+  }
+  for (page = 0; page < 64; page++) {
+    pattern(data, page, 0);
+    if ((flash_ecc_page_read(page, back, PAGE_BYTES) != 0) || (memcmp(back, data, PAGE_BYTES) != 0)) {
+      ok = 0;
+    }
+  }
+  fail += check("write and read", ok);
+
+  ok = 1;
+  for (page = 0; page < 64; page++) {
+    pattern(data, page, 0);
+    for (i = (page * 5) % PAGE_BYTES; data[i] == 0; i = (i + 1) % PAGE_BYTES) {
+    }
+    if ((flip(page * PAGE_BYTES + i, one(data[i])) != 0)
+        || (flash_ecc_read(page * PAGE_BYTES, back, PAGE_BYTES) != 0)
+        || (memcmp(back, data, PAGE_BYTES) != 0)
+        || (flash_ecc_page_check(page, back) != 1)) {
+      ok = 0;
+    }
+  }
+  fail += check("errors on the chip", ok);
+
+  pattern(data, 3, 0);
+  i = (3 * 5 + 100) % PAGE_BYTES;
+  fail += check("double error on the chip",
+      (flip(3 * PAGE_BYTES + i, one(data[i])) == 0)
+      && (flash_ecc_read(3 * PAGE_BYTES, back, PAGE_BYTES) != 0));
+
+  /*
+   * A bit error in the first half, then a program of the second half.
+   * The new code has to come from the corrected data.
+   */
+  page = 100;
+  pattern(data, page, 1);
+  memset(data + PAGE_BYTES / 2, 0xFF, PAGE_BYTES / 2);
+  ok = (flash_ecc_program(page * PAGE_BYTES, data, PAGE_BYTES / 2) == 0)
+    && (data[10] != 0) && (flip(page * PAGE_BYTES + 10, one(data[10])) == 0)
+    && (flash_ecc_page_check(page, back) == 1);
+  pattern(work, page, 1);
+  memcpy(data + PAGE_BYTES / 2, work + PAGE_BYTES / 2, PAGE_BYTES / 2);
+  ok = ok && (flash_ecc_program(page * PAGE_BYTES + PAGE_BYTES / 2, data + PAGE_BYTES / 2, PAGE_BYTES / 2) == 0)
+    && (flash_ecc_page_check(page, back) == 1) && (memcmp(back, data, PAGE_BYTES) == 0);
+  fail += check("program over a corrected page", ok);
+
+  ok = (flash_ecc_subsector_erase(0) == 0);
+  for (page = 0; page < 16; page++) {
+    memset(data, 0xFF, PAGE_BYTES);
+    if ((flash_ecc_page_read(page, back, PAGE_BYTES) != 0) || (memcmp(back, data, PAGE_BYTES) != 0)) {
+      ok = 0;
+    }
+  }
+  memset(data, 0xFF, PAGE_BYTES);
+  for (i = 0; i < PAGE_BYTES; i += 8) {
+    data[i] = (unsigned char)i;
+    if ((flash_ecc_program(5 * PAGE_BYTES + i, data + i, 1) != 0)
+        || (flash_ecc_page_read(5, back, PAGE_BYTES) != 0)
+        || (memcmp(back, data, PAGE_BYTES) != 0)) {
+      ok = 0;
+    }
+  }
+  fail += check("partial programs", ok);
+
+  /*
+   * Every erase of the sector writes a new generation, so the rounds go
+   * over all the generations of its parity subsector more than once.
+   */
+  ok = 1;
+  for (i = 0; i < ROUNDS; i++) {
+    if (flash_ecc_sector_erase(1) != 0) {
+      ok = 0;
+    }
+    for (page = 256; page < 256 + 40; page++) {
+      pattern(data, page, i);
+      if (flash_ecc_page_write(page, data, PAGE_BYTES) != 0) {
+        ok = 0;
+      }
+    }
+  }
+  flash_ecc_stats(&stats);
+  fail += check("generation roll-over", ok && (stats.generations >= ROUNDS));
+
+  ok = (flash_ecc_init() == 0);
+  for (page = 256; page < 256 + 40; page++) {
+    pattern(data, page, ROUNDS - 1);
+    if ((flash_ecc_page_read(page, back, PAGE_BYTES) != 0) || (memcmp(back, data, PAGE_BYTES) != 0)) {
+      ok = 0;
+    }
+  }
+  for (page = 16; page < 64; page++) {
+    pattern(data, page, 0);
+    if ((flash_ecc_page_read(page, back, PAGE_BYTES) != 0) || (memcmp(back, data, PAGE_BYTES) != 0)) {
+      ok = 0;
+    }
+  }
+  fail += check("generations after init", ok);
+
+  return fail ? 1 : 0;
+}
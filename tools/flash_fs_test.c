@@ -0,0 +1,389 @@
+/**
+ * @file flash_fs_test.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+/*
+ * Test of the file system on a simulated chip.
+ *
+ * Build from the top directory, or run tools/flash_dev_test.sh:
+ *
+ *   cc -std=c99 -O2 -I. -Itools -include tools/sim_port.h \
+ *     -o fs_test tools/flash_fs_test.c flash_fs.c flash_util.c \
+ *     tools/flash_sim.c flash_bus.c flash_m25px16.c m25px16.c
+ *
+ * It checks the files, the directories and the seeks, the compaction and
+ * the moves of the metadata, and the state after a power loss between any
+ * two program or erase cycles of an append, a rename and the commits
+ * around a move of the metadata. It exits with 0 on success.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "flash.h"
+#include "flash_fs.h"
+#include "flash_sim.h"
+
+#define SPI_KHZ         (20000)
+#define FIRST           (64)
+#define COUNT           (256)
+#define BLOCK_BYTES     (4096)
+#define PAGE_BYTES      (256)
+#define CHIP_BYTES      (2 * 1024 * 1024)
+#define FILES           (20)
+
+static unsigned char pre[CHIP_BYTES];
+static unsigned char buf[1000];
+
+/**
+ * @brief Report a check.
+ *
+ * @param name The name of the check.
+ * @param ok The result.
+ *
+ * @return 0 if it passed, 1 otherwise.
+ */
+static int check(const char *name, int ok)
+{
+  printf("%-32s %s\n", name, ok ? "ok" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+/**
+ * @brief Get a byte of the contents of a file.
+ *
+ * @param i The byte position.
+ * @param seed The seed of the file.
+ */
+static unsigned char pattern(unsigned int i, unsigned int seed)
+{
+  return (unsigned char)(i * 31 + seed * 7 + (i >> 8));
+}
+
+/**
+ * @brief Write a file with the pattern.
+ * @details
+ * The writes have varied sizes, so they cross the blocks at varied places.
+ *
+ * @param name The path.
+ * @param mode FLASH_FS_WRITE or FLASH_FS_APPEND.
+ * @param from The position of the first byte.
+ * @param siz The number of bytes.
+ * @param seed The seed of the file.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int put(const char *name, int mode, unsigned int from, unsigned int siz, unsigned int seed)
+{
+  flash_fs_file_t f;
+  unsigned int i, j, n;
+  int r = 0;
+
+  if (flash_fs_open(&f, name, mode) != 0) {
+    return -1;
+  }
+  for (i = from; (r == 0) && (i < from + siz); i += n) {
+    n = sizeof(buf) - (i % 300);
+    if (n > from + siz - i) {
+      n = from + siz - i;
+    }
+    for (j = 0; j < n; j++) {
+      buf[j] = pattern(i + j, seed);
+    }
+    r = flash_fs_write(&f, buf, n);
+  }
+  if (flash_fs_close(&f) != 0) {
+    r = -1;
+  }
+  return r;
+}
+
+/**
+ * @brief Check a file has the pattern.
+ *
+ * @param name The path.
+ * @param siz The number of bytes.
+ * @param seed The seed of the file.
+ *
+ * @return 1 if the file has the bytes.
+ */
+static int has(const char *name, unsigned int siz, unsigned int seed)
+{
+  flash_fs_file_t f;
+  unsigned int pos = 0;
+  int ok = 1;
+  int n, i;
+
+  if (flash_fs_open(&f, name, FLASH_FS_READ) != 0) {
+    return 0;
+  }
+  while (ok && ((n = flash_fs_read(&f, buf, sizeof(buf))) > 0)) {
+    for (i = 0; i < n; i++) {
+      ok &= (buf[i] == pattern(pos + i, seed));
+    }
+    pos += n;
+  }
+  flash_fs_close(&f);
+  return ok && (n == 0) && (pos == siz);
+}
+
+/**
+ * @brief Get a 32-bit little endian value from the chip.
+ *
+ * @param addr The byte address in the file system.
+ */
+static unsigned long peek32(unsigned int addr)
+{
+  const unsigned char *p = flash_sim_memory() + FIRST * BLOCK_BYTES + addr;
+  return p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/**
+ * @brief Find the metadata on the chip.
+ * @details
+ * It reads the anchor block with the higher revision and the newer
+ * block of the metadata pair it points to.
+ *
+ * @param pair The first block of the metadata pair.
+ *
+ * @return The revision of the metadata.
+ */
+static unsigned long meta(unsigned int *pair)
+{
+  unsigned long rev[2];
+  unsigned int a, b;
+  unsigned int i;
+
+  for (i = 0; i < 2; i++) {
+    rev[i] = (peek32(i * BLOCK_BYTES) == 0x41534654UL) ? peek32(i * BLOCK_BYTES + 4) : 0;
+  }
+  a = (rev[1] > rev[0]) ? 1 : 0;
+  *pair = peek32(a * BLOCK_BYTES + 16);
+  b = peek32(a * BLOCK_BYTES + 20);
+  rev[0] = peek32(*pair * BLOCK_BYTES + 4);
+  rev[1] = (peek32(b * BLOCK_BYTES) == 0x31534654UL) ? peek32(b * BLOCK_BYTES + 4) : 0;
+  return (rev[1] > rev[0]) ? rev[1] : rev[0];
+}
+
+/**
+ * @brief Write the saved contents back to the chip.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int restore(void)
+{
+  const unsigned char *m = flash_sim_memory();
+  unsigned int s, a, i;
+
+  for (s = 0; s < CHIP_BYTES / BLOCK_BYTES; s++) {
+    if (memcmp(m + s * BLOCK_BYTES, pre + s * BLOCK_BYTES, BLOCK_BYTES) == 0) {
+      continue;
+    }
+    if (flash_subsector_erase(s) != 0) {
+      return -1;
+    }
+    for (a = s * BLOCK_BYTES; a < (s + 1) * BLOCK_BYTES; a += PAGE_BYTES) {
+      for (i = 0; (i < PAGE_BYTES) && (pre[a + i] == 0xFF); i++) {
+      }
+      if ((i < PAGE_BYTES) && (flash_program(a, pre + a, PAGE_BYTES) != 0)) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Run the updates the power loss test cuts.
+ *
+ * @return 0 if all of them succeeded.
+ */
+static int updates(void)
+{
+  int r;
+  int i;
+
+  r = put("pl", FLASH_FS_APPEND, BLOCK_BYTES + 100, 2 * BLOCK_BYTES, 11);
+  r |= flash_fs_rename("pl", "pl2");
+  for (i = 0; i < 40; i++) {
+    r |= flash_fs_mkdir("d");
+    r |= flash_fs_remove("d");
+  }
+  return r;
+}
+
+/**
+ * @brief Get the number of program and erase cycles so far.
+ */
+static unsigned long cycles(void)
+{
+  flash_sim_stats_t stats;
+  flash_sim_stats(&stats);
+  return stats.page_programs + stats.subsector_erases + stats.sector_erases + stats.bulk_erases;
+}
+
+int main(void)
+{
+  flash_fs_file_t f;
+  flash_fs_stat_t st;
+  unsigned char b[16];
+  unsigned int clip = BLOCK_BYTES * 37 + 123;
+  unsigned int pos, pair, last, moves;
+  unsigned long start, n, k, olds, news;
+  char name[8];
+  int ok;
+  int i, j;
+  int fail = 0;
+
+  if ((flash_sim_init(FLASH_SIM_M25PX16, SPI_KHZ) != 0) || (flash_init() != 0)) {
+    return check("init", 0);
+  }
+  fail += check("mount blank", flash_fs_mount(FIRST, COUNT) != 0);
+  fail += check("format", flash_fs_format(FIRST, COUNT) == 0);
+  fail += check("mkdir", (flash_fs_mkdir("cal") == 0) && (flash_fs_mkdir("cal") != 0)
+      && (flash_fs_mkdir("x/y") != 0));
+  fail += check("write", (put("cal/adc.bin", FLASH_FS_WRITE, 0, 1000, 1) == 0)
+      && (put("clip.raw", FLASH_FS_WRITE, 0, clip, 2) == 0)
+      && (put("empty", FLASH_FS_WRITE, 0, 0, 3) == 0));
+  fail += check("read", has("cal/adc.bin", 1000, 1) && has("clip.raw", clip, 2) && has("empty", 0, 3));
+
+  ok = (flash_fs_open(&f, "clip.raw", FLASH_FS_READ) == 0);
+  for (pos = 0; ok && (pos + sizeof(b) < clip); pos += BLOCK_BYTES / 3 + 17) {
+    ok = (flash_fs_seek(&f, pos) == 0) && (flash_fs_read(&f, b, sizeof(b)) == (int)sizeof(b));
+    for (i = 0; ok && (i < (int)sizeof(b)); i++) {
+      ok = (b[i] == pattern(pos + i, 2));
+    }
+  }
+  fail += check("seek", ok && (flash_fs_seek(&f, clip + 1) != 0) && (flash_fs_close(&f) == 0));
+
+  fail += check("append", (put("cal/adc.bin", FLASH_FS_APPEND, 1000, 5000, 1) == 0)
+      && has("cal/adc.bin", 6000, 1)
+      && (put("clip.raw", FLASH_FS_APPEND, clip, BLOCK_BYTES * 3, 2) == 0));
+  clip += BLOCK_BYTES * 3;
+  fail += check("append read", has("clip.raw", clip, 2));
+
+  for (pos = 0, i = 0; flash_fs_dir("", &pos, &st) == 0; i++) {
+  }
+  for (pos = 0, j = 0; flash_fs_dir("cal", &pos, &st) == 0; j++) {
+  }
+  fail += check("dir", (i == 3) && (j == 1) && (flash_fs_remove("cal") != 0));
+  fail += check("rename", (flash_fs_rename("cal/adc.bin", "cal/adc2.bin") == 0)
+      && has("cal/adc2.bin", 6000, 1) && (flash_fs_stat("cal/adc.bin", &st) != 0));
+  fail += check("remount", (flash_fs_mount(FIRST, COUNT) == 0)
+      && has("cal/adc2.bin", 6000, 1) && has("clip.raw", clip, 2));
+
+  /*
+   * Overwrite the files and commit many times, so the metadata is
+   * compacted and moves over the region.
+   */
+  ok = 1;
+  for (i = 0; ok && (i < 300); i++) {
+    sprintf(name, "f%d", i % FILES);
+    ok = (put(name, FLASH_FS_WRITE, 0, (i * 397) % (3 * BLOCK_BYTES), i) == 0);
+  }
+  meta(&last);
+  moves = 0;
+  for (i = 0; ok && (i < 2000); i++) {
+    ok = (flash_fs_mkdir("d") == 0) && (flash_fs_remove("d") == 0);
+    meta(&pair);
+    if (pair != last) {
+      moves++;
+      last = pair;
+    }
+  }
+  fail += check("commits", ok);
+  fail += check("metadata moves", moves >= 2);
+  ok = (flash_fs_mount(FIRST, COUNT) == 0);
+  for (i = 300 - FILES; ok && (i < 300); i++) {
+    sprintf(name, "f%d", i % FILES);
+    ok = has(name, (i * 397) % (3 * BLOCK_BYTES), i);
+  }
+  fail += check("files after moves", ok && has("clip.raw", clip, 2));
+
+  ok = (flash_fs_open(&f, "fill", FLASH_FS_WRITE) == 0);
+  memset(buf, 0x5A, PAGE_BYTES);
+  for (pos = 0; ok && (flash_fs_write(&f, buf, PAGE_BYTES) == 0); pos += PAGE_BYTES) {
+  }
+  fail += check("full", ok && (flash_fs_close(&f) == 0) && (flash_fs_remove("fill") == 0)
+      && (pos > COUNT / 2 * BLOCK_BYTES));
+  fail += check("write after full", (put("after", FLASH_FS_WRITE, 0, 2 * BLOCK_BYTES, 9) == 0)
+      && has("after", 2 * BLOCK_BYTES, 9));
+
+  memset(buf, 0, 100);
+  fail += check("uncommitted", (flash_fs_open(&f, "after", FLASH_FS_WRITE) == 0)
+      && (flash_fs_write(&f, buf, 100) == 0)
+      && (flash_fs_mount(FIRST, COUNT) == 0) && has("after", 2 * BLOCK_BYTES, 9));
+
+  /*
+   * Cut the power after each program or erase cycle of the updates.
+   * The next compaction moves the metadata.
+   */
+  ok = (put("pl", FLASH_FS_WRITE, 0, BLOCK_BYTES + 100, 11) == 0);
+  for (i = 0; ok && ((meta(&pair) % FLASH_FS_META_MOVES) != FLASH_FS_META_MOVES - 1); i++) {
+    ok = (flash_fs_mkdir("d") == 0) && (flash_fs_remove("d") == 0);
+  }
+  memcpy(pre, flash_sim_memory(), CHIP_BYTES);
+  meta(&last);
+  start = cycles();
+  ok = ok && (updates() == 0);
+  n = cycles() - start;
+  meta(&pair);
+  fail += check("updates move the metadata", ok && (pair != last));
+
+  olds = 0;
+  news = 0;
+  for (k = 1; ok && (k < n); k++) {
+    ok = (restore() == 0) && (flash_fs_mount(FIRST, COUNT) == 0);
+    flash_sim_power_cut(k);
+    updates();
+    flash_sim_power_cut(0);
+    ok = ok && (flash_fs_mount(FIRST, COUNT) == 0);
+    if (ok && has("pl", BLOCK_BYTES + 100, 11)) {
+      olds++;
+    } else if (ok && (has("pl", 3 * BLOCK_BYTES + 100, 11) || has("pl2", 3 * BLOCK_BYTES + 100, 11))) {
+      news++;
+    } else {
+      ok = 0;
+    }
+    ok = ok && has("clip.raw", clip, 2) && has("after", 2 * BLOCK_BYTES, 9)
+      && (put("post", FLASH_FS_WRITE, 0, BLOCK_BYTES + 5, k) == 0)
+      && has("post", BLOCK_BYTES + 5, k) && (flash_fs_remove("post") == 0);
+    if (!ok) {
+      printf("power loss after %lu of %lu cycles\n", k, n);
+    }
+  }
+  fail += check("power loss", ok && (olds != 0) && (news != 0));
+
+  return fail ? 1 : 0;
+}
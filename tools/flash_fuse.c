@@ -0,0 +1,591 @@
+/**
+ * @file flash_fuse.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+/*
+ * FUSE file system for the raw flash.
+ *
+ * It needs libfuse 3 with its development files and pkg-config, e.g. the
+ * libfuse3-dev package on Debian or fuse3-devel on Fedora, and the fuse
+ * kernel module to mount. No other tool or script builds it.
+ *
+ * Build from the top directory with the port header of the board, e.g.
+ *
+ *   cc -std=c99 -O2 -I. -Itools -include <port.h> \
+ *     -o flash_fuse tools/flash_fuse.c flash_patch.c flash_bus.c \
+ *     flash_m25px16.c m25px16.c `pkg-config fuse3 --cflags --libs`
+ *
+ * or against the simulated chip with
+ *
+ *   cc -std=c99 -O2 -I. -Itools -include tools/sim_port.h -DFLASH_FUSE_SIM \
+ *     -o flash_fuse_sim tools/flash_fuse.c tools/flash_sim.c flash_patch.c \
+ *     flash_bus.c flash_m25px16.c m25px16.c \
+ *     `pkg-config fuse3 --cflags --libs`
+ *
+ * Usage: flash_fuse <mountpoint> [fuse options]
+ *        flash_fuse_sim <m25p16|m25px16> <mountpoint> [fuse options]
+ *
+ * The mount point has these files:
+ *
+ *   raw.bin        The whole flash.
+ *   sectorNN.bin   A sector.
+ *   stats          Counters of the file system and the flash layer.
+ *
+ * The files have a fixed size, and truncation is ignored like on a block
+ * device, so dd, cmp and rsync --inplace work on them.
+ *
+ * The writes are collected in a buffer of one erase unit, which is a
+ * subsector or a sector if the flash has no subsector erase. The buffer
+ * is written back when a write goes to another unit, and on flush, fsync
+ * and unmount. The unit is erased only if some bit goes from 0 to 1.
+ * Otherwise only the changed spans of the dirty pages are programmed.
+ */
+
+#define _GNU_SOURCE
+#define FUSE_USE_VERSION 31
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fuse.h>
+#if !defined(FUSE_MAJOR_VERSION) || (FUSE_MAJOR_VERSION < 3)
+#error "flash_fuse needs libfuse 3, see the build notes at the top of the file."
+#endif
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "flash.h"
+#include "flash_patch.h"
+#ifdef FLASH_FUSE_SIM
+#include "flash_sim.h"
+#endif
+
+#define NAME_RAW    "raw.bin"
+#define NAME_STATS  "stats"
+#define STATS_BYTES (512)
+#define UNIT_NONE   (~0u)
+
+typedef struct {
+  unsigned long reads;
+  unsigned long read_bytes;
+  unsigned long writes;
+  unsigned long write_bytes;
+  unsigned long write_backs;
+  unsigned long page_patches;
+  unsigned long page_writes;
+  unsigned long erases;
+} stats_t;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static flash_info_t info;
+static unsigned int flash_bytes;
+static unsigned int unit_bytes;
+static stats_t stats;
+
+/*
+ * The buffered erase unit.
+ * curr is the contents of the flash and data is the contents with the writes.
+ */
+static unsigned int unit = UNIT_NONE;
+static unsigned char *curr;
+static unsigned char *data;
+static unsigned char *dirty;
+
+/**
+ * @brief Find the flash range of a file.
+ *
+ * @param path The path of the file.
+ * @param addr The start address.
+ * @param siz The number of bytes.
+ *
+ * @retval 0 Success.
+ * @retval !0 Not a flash file.
+ */
+static int lookup(const char *path, unsigned int *addr, unsigned int *siz)
+{
+  unsigned int sector;
+  char name[32];
+
+  if (strcmp(path, "/" NAME_RAW) == 0) {
+    *addr = 0;
+    *siz = flash_bytes;
+    return 0;
+  }
+  if ((sscanf(path, "/sector%u.bin", &sector) == 1) && (sector < info.sector_count)) {
+    snprintf(name, sizeof(name), "/sector%02u.bin", sector);
+  } else {
+    return -1;
+  }
+  if (strcmp(path, name) == 0) {
+    *addr = sector * info.sector_bytes;
+    *siz = info.sector_bytes;
+    return 0;
+  }
+  return -1;
+}
+
+/**
+ * @brief Make the contents of the stats file.
+ *
+ * @param buf The buffer of STATS_BYTES.
+ *
+ * @return The number of bytes.
+ */
+static unsigned int stats_text(char *buf)
+{
+  int n = snprintf(buf, STATS_BYTES,
+      "reads %lu\n"
+      "read_bytes %lu\n"
+      "writes %lu\n"
+      "write_bytes %lu\n"
+      "write_backs %lu\n"
+      "page_patches %lu\n"
+      "page_writes %lu\n"
+      "erases %lu\n"
+      "erase_unit_bytes %u\n"
+      "flash_accesses %u\n",
+      stats.reads, stats.read_bytes, stats.writes, stats.write_bytes,
+      stats.write_backs, stats.page_patches, stats.page_writes, stats.erases,
+      unit_bytes, flash_access_count());
+  return (n < 0) ? 0 : ((n < STATS_BYTES) ? n : STATS_BYTES - 1);
+}
+
+/**
+ * @brief Erase the buffered unit.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int unit_erase(void)
+{
+  stats.erases++;
+  if (info.subsector_count != 0) {
+    return flash_subsector_erase(unit);
+  }
+  return flash_sector_erase(unit);
+}
+
+/**
+ * @brief Write back the buffered unit.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int unit_write_back(void)
+{
+  unsigned int pages = unit_bytes / info.page_bytes;
+  unsigned int page = unit * pages;
+  unsigned int i, j;
+  int erase = 0;
+
+  if (unit == UNIT_NONE) {
+    return 0;
+  }
+  for (i = 0; (i < pages) && !dirty[i]; i++) {
+  }
+  if (i == pages) {
+    return 0;
+  }
+  for (i = 0; (i < unit_bytes) && !erase; i++) {
+    erase = dirty[i / info.page_bytes] && (~curr[i] & data[i]);
+  }
+
+  if (erase) {
+    if (unit_erase() != 0) {
+      return -1;
+    }
+    memset(curr, 0xFF, unit_bytes);
+    for (i = 0; i < pages; i++) {
+      unsigned char *p = data + i * info.page_bytes;
+      for (j = 0; (j < info.page_bytes) && (p[j] == 0xFF); j++) {
+      }
+      dirty[i] = (j < info.page_bytes);
+    }
+  }
+
+  for (i = 0; i < pages; i++) {
+    unsigned char *p = data + i * info.page_bytes;
+    if (!dirty[i]) {
+      continue;
+    }
+    if (erase) {
+      stats.page_writes++;
+      if (flash_page_write(page + i, p, info.page_bytes) != 0) {
+        return -1;
+      }
+    } else {
+      stats.page_patches++;
+      if (flash_page_patch_with(page + i, p, curr + i * info.page_bytes, info.page_bytes) != 0) {
+        return -1;
+      }
+    }
+    memcpy(curr + i * info.page_bytes, p, info.page_bytes);
+    dirty[i] = 0;
+  }
+  stats.write_backs++;
+  return 0;
+}
+
+/**
+ * @brief Buffer an erase unit.
+ * @details
+ * The buffered unit is written back first if it is another one.
+ *
+ * @param n The erase unit number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int unit_load(unsigned int n)
+{
+  if (unit == n) {
+    return 0;
+  }
+  if (unit_write_back() != 0) {
+    return -1;
+  }
+  unit = UNIT_NONE;
+  if (flash_read(n * unit_bytes, curr, unit_bytes) != 0) {
+    return -1;
+  }
+  memcpy(data, curr, unit_bytes);
+  memset(dirty, 0, unit_bytes / info.page_bytes);
+  unit = n;
+  return 0;
+}
+
+/**
+ * @brief Get the attributes of a file.
+ * @details
+ * The size of stats is the length of its current text.
+ *
+ * @return 0 or a negative errno.
+ */
+static int fs_getattr(const char *path, struct stat *st, struct fuse_file_info *fi)
+{
+  char text[STATS_BYTES];
+  unsigned int addr, siz;
+  int r = 0;
+
+  (void)fi;
+  memset(st, 0, sizeof(*st));
+  pthread_mutex_lock(&mutex);
+  if (strcmp(path, "/") == 0) {
+    st->st_mode = S_IFDIR | 0755;
+    st->st_nlink = 2;
+  } else if (strcmp(path, "/" NAME_STATS) == 0) {
+    st->st_mode = S_IFREG | 0444;
+    st->st_nlink = 1;
+    st->st_size = stats_text(text);
+  } else if (lookup(path, &addr, &siz) == 0) {
+    st->st_mode = S_IFREG | 0644;
+    st->st_nlink = 1;
+    st->st_size = siz;
+  } else {
+    r = -ENOENT;
+  }
+  pthread_mutex_unlock(&mutex);
+  return r;
+}
+
+/**
+ * @brief List the root directory.
+ *
+ * @return 0 or a negative errno.
+ */
+static int fs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+    off_t off, struct fuse_file_info *fi, enum fuse_readdir_flags flags)
+{
+  char name[32];
+  unsigned int i;
+
+  (void)off;
+  (void)fi;
+  (void)flags;
+  if (strcmp(path, "/") != 0) {
+    return -ENOENT;
+  }
+  filler(buf, ".", 0, 0, 0);
+  filler(buf, "..", 0, 0, 0);
+  filler(buf, NAME_RAW, 0, 0, 0);
+  filler(buf, NAME_STATS, 0, 0, 0);
+  for (i = 0; i < info.sector_count; i++) {
+    snprintf(name, sizeof(name), "sector%02u.bin", i);
+    filler(buf, name, 0, 0, 0);
+  }
+  return 0;
+}
+
+/**
+ * @brief Open a file.
+ * @details
+ * stats is read only and bypasses the page cache, so every read
+ * gets the current counters.
+ *
+ * @return 0 or a negative errno.
+ */
+static int fs_open(const char *path, struct fuse_file_info *fi)
+{
+  unsigned int addr, siz;
+
+  if (strcmp(path, "/" NAME_STATS) == 0) {
+    if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+      return -EACCES;
+    }
+    fi->direct_io = 1;
+    return 0;
+  }
+  if (lookup(path, &addr, &siz) != 0) {
+    return -ENOENT;
+  }
+  return 0;
+}
+
+/**
+ * @brief Read a file.
+ * @details
+ * The bytes of the buffered unit are taken from the buffer.
+ *
+ * @return The number of bytes or a negative errno.
+ */
+static int fs_read(const char *path, char *buf, size_t size, off_t off, struct fuse_file_info *fi)
+{
+  char text[STATS_BYTES];
+  unsigned int addr, siz, n, lo, hi;
+  int r;
+
+  (void)fi;
+  pthread_mutex_lock(&mutex);
+  if (strcmp(path, "/" NAME_STATS) == 0) {
+    n = stats_text(text);
+    r = 0;
+    if ((unsigned long long)off < n) {
+      r = ((n - (unsigned int)off) < size) ? (n - (unsigned int)off) : size;
+      memcpy(buf, text + off, r);
+    }
+    goto out;
+  }
+  if (lookup(path, &addr, &siz) != 0) {
+    r = -ENOENT;
+    goto out;
+  }
+  if ((unsigned long long)off >= siz) {
+    r = 0;
+    goto out;
+  }
+  n = ((siz - (unsigned int)off) < size) ? (siz - (unsigned int)off) : size;
+  addr += off;
+  if (flash_read(addr, (unsigned char *)buf, n) != 0) {
+    r = -EIO;
+    goto out;
+  }
+  if (unit != UNIT_NONE) {
+    /* The buffered writes are newer than the flash. */
+    lo = (addr > unit * unit_bytes) ? addr : unit * unit_bytes;
+    hi = ((addr + n) < (unit + 1) * unit_bytes) ? (addr + n) : (unit + 1) * unit_bytes;
+    if (lo < hi) {
+      memcpy(buf + (lo - addr), data + (lo - unit * unit_bytes), hi - lo);
+    }
+  }
+  stats.reads++;
+  stats.read_bytes += n;
+  r = n;
+out:
+  pthread_mutex_unlock(&mutex);
+  return r;
+}
+
+/**
+ * @brief Write a file.
+ * @details
+ * The bytes go to the unit buffer, which is written back first
+ * when the write moves to another unit.
+ * A protected sector ends the write.
+ *
+ * @return The number of bytes or a negative errno.
+ */
+static int fs_write(const char *path, const char *buf, size_t size, off_t off, struct fuse_file_info *fi)
+{
+  unsigned int addr, siz, n, done, offset, len, i;
+  int r;
+
+  (void)fi;
+  pthread_mutex_lock(&mutex);
+  if (lookup(path, &addr, &siz) != 0) {
+    r = -EACCES;
+    goto out;
+  }
+  if ((unsigned long long)off >= siz) {
+    r = (size == 0) ? 0 : -ENOSPC;
+    goto out;
+  }
+  n = ((siz - (unsigned int)off) < size) ? (siz - (unsigned int)off) : size;
+  addr += off;
+  for (done = 0; done < n; done += len) {
+    if (flash_sector_protected((addr + done) / info.sector_bytes) != 0) {
+      r = done ? (int)done : -EPERM;
+      goto out;
+    }
+    if (unit_load((addr + done) / unit_bytes) != 0) {
+      r = done ? (int)done : -EIO;
+      goto out;
+    }
+    offset = (addr + done) % unit_bytes;
+    len = ((unit_bytes - offset) < (n - done)) ? (unit_bytes - offset) : (n - done);
+    memcpy(data + offset, buf + done, len);
+    for (i = offset / info.page_bytes; i <= (offset + len - 1) / info.page_bytes; i++) {
+      dirty[i] = 1;
+    }
+  }
+  stats.writes++;
+  stats.write_bytes += n;
+  r = n;
+out:
+  pthread_mutex_unlock(&mutex);
+  return r;
+}
+
+/**
+ * @brief Truncate a file.
+ * @details
+ * The files have a fixed size, so it does nothing.
+ *
+ * @return 0 or a negative errno.
+ */
+static int fs_truncate(const char *path, off_t size, struct fuse_file_info *fi)
+{
+  unsigned int addr, siz;
+
+  (void)size;
+  (void)fi;
+  return (lookup(path, &addr, &siz) == 0) ? 0 : -EACCES;
+}
+
+/**
+ * @brief Write back the unit buffer on close.
+ *
+ * @return 0 or a negative errno.
+ */
+static int fs_flush(const char *path, struct fuse_file_info *fi)
+{
+  int r;
+
+  (void)path;
+  (void)fi;
+  pthread_mutex_lock(&mutex);
+  r = (unit_write_back() == 0) ? 0 : -EIO;
+  pthread_mutex_unlock(&mutex);
+  return r;
+}
+
+/**
+ * @brief Write back the unit buffer.
+ *
+ * @return 0 or a negative errno.
+ */
+static int fs_fsync(const char *path, int datasync, struct fuse_file_info *fi)
+{
+  (void)datasync;
+  return fs_flush(path, fi);
+}
+
+/**
+ * @brief Write back the unit buffer on unmount.
+ */
+static void fs_destroy(void *private_data)
+{
+  (void)private_data;
+  pthread_mutex_lock(&mutex);
+  if (unit_write_back() != 0) {
+    fprintf(stderr, "write back failed\n");
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * @brief The operations of the file system.
+ */
+static const struct fuse_operations operations = {
+  .getattr  = fs_getattr,
+  .readdir  = fs_readdir,
+  .open     = fs_open,
+  .read     = fs_read,
+  .write    = fs_write,
+  .truncate = fs_truncate,
+  .flush    = fs_flush,
+  .fsync    = fs_fsync,
+  .destroy  = fs_destroy,
+};
+
+int main(int argc, char **argv)
+{
+#ifdef FLASH_FUSE_SIM
+  int model;
+
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <m25p16|m25px16> <mountpoint> [fuse options]\n", argv[0]);
+    return 1;
+  }
+  if (strcmp(argv[1], "m25p16") == 0) {
+    model = FLASH_SIM_M25P16;
+  } else if (strcmp(argv[1], "m25px16") == 0) {
+    model = FLASH_SIM_M25PX16;
+  } else {
+    fprintf(stderr, "unknown chip: %s\n", argv[1]);
+    return 1;
+  }
+  if (flash_sim_init(model, 20000) != 0) {
+    fprintf(stderr, "init failed\n");
+    return 1;
+  }
+  argv[1] = argv[0];
+  argc--;
+  argv++;
+#endif
+
+  if ((flash_init() != 0) || (flash_info(&info) != 0)) {
+    fprintf(stderr, "init failed\n");
+    return 1;
+  }
+  flash_bytes = info.sector_count * info.sector_bytes;
+  unit_bytes = (info.subsector_count != 0) ? info.subsector_bytes : info.sector_bytes;
+  curr = malloc(unit_bytes);
+  data = malloc(unit_bytes);
+  dirty = calloc(unit_bytes / info.page_bytes, 1);
+  if ((curr == 0) || (data == 0) || (dirty == 0)) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  return fuse_main(argc, argv, &operations, 0);
+}
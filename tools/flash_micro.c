@@ -0,0 +1,288 @@
+/**
+ * @file flash_micro.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+/*
+ * CPU overhead of the driver and the flash layer with a memcpy transport.
+ *
+ * Build from the top directory:
+ *
+ *   cc -std=c99 -O2 -I. -Itools -include tools/null_port.h \
+ *     -o flash_micro tools/flash_micro.c flash_m25px16.c m25px16.c flash_bus.c
+ *
+ * Add -DNULL_PORT_DISCARD for a null transport.
+ *
+ * For each operation it reports the time per operation and per byte, and
+ * the instructions per operation if the perf counters are available.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "flash.h"
+#include "m25px16.h"
+
+#define RUN_NS  (200000000ULL)
+
+unsigned char null_port_sink[NULL_PORT_BYTES];
+unsigned char null_port_source[NULL_PORT_BYTES];
+unsigned int null_port_pos;
+
+static uint8_t buf[4096];
+static int perf_fd = -1;
+
+/**
+ * @brief A measured operation.
+ */
+typedef struct {
+  const char *name;
+  unsigned int bytes;
+  void (*func)(unsigned int bytes);
+} micro_t;
+
+/**
+ * @brief Driver: read bytes.
+ *
+ * @param bytes The number of bytes.
+ */
+static void read_data_bytes(unsigned int bytes)
+{
+  m25px16_read_data_bytes(0, buf, bytes);
+}
+
+/**
+ * @brief Driver: program bytes in a page.
+ *
+ * @param bytes The number of bytes.
+ */
+static void page_program(unsigned int bytes)
+{
+  m25px16_page_program(0, buf, bytes);
+}
+
+/**
+ * @brief Driver: read the identification.
+ *
+ * @param bytes Not used.
+ */
+static void read_identification(unsigned int bytes)
+{
+  m25px16_identification_t id;
+  (void)bytes;
+  m25px16_read_identification(&id);
+}
+
+/**
+ * @brief Driver: read the status register.
+ *
+ * @param bytes Not used.
+ */
+static void read_status_register(unsigned int bytes)
+{
+  uint8_t sreg;
+  (void)bytes;
+  m25px16_read_status_register(&sreg);
+}
+
+/**
+ * @brief Flash layer: read bytes.
+ *
+ * @param bytes The number of bytes.
+ */
+static void wrap_read(unsigned int bytes)
+{
+  flash_read(0, buf, bytes);
+}
+
+/**
+ * @brief Flash layer: read a page.
+ *
+ * @param bytes The number of bytes.
+ */
+static void wrap_page_read(unsigned int bytes)
+{
+  flash_page_read(0, buf, bytes);
+}
+
+/**
+ * @brief Flash layer: program bytes.
+ *
+ * @param bytes The number of bytes.
+ */
+static void wrap_program(unsigned int bytes)
+{
+  flash_program(0, buf, bytes);
+}
+
+/**
+ * @brief The operations and their sizes.
+ */
+static const micro_t micro[] = {
+  { "m25px16_read_data_bytes", 256, read_data_bytes },
+  { "m25px16_read_data_bytes", 4096, read_data_bytes },
+  { "m25px16_page_program", 256, page_program },
+  { "m25px16_read_identification", 0, read_identification },
+  { "m25px16_read_status_register", 0, read_status_register },
+  { "flash_read", 256, wrap_read },
+  { "flash_read", 4096, wrap_read },
+  { "flash_page_read", 256, wrap_page_read },
+  { "flash_program", 256, wrap_program },
+};
+
+/**
+ * @brief Current time in nanoseconds.
+ */
+static unsigned long long now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Open the instruction counter.
+ * @details
+ * perf_fd stays -1 if the perf counters are not available.
+ */
+static void perf_open(void)
+{
+#ifdef __linux__
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+/**
+ * @brief Start counting the instructions.
+ */
+static void perf_start(void)
+{
+#ifdef __linux__
+  if (perf_fd >= 0) {
+    ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+#endif
+}
+
+/**
+ * @brief Stop counting the instructions.
+ *
+ * @return The number of instructions, or -1 without the counter.
+ */
+static long long perf_stop(void)
+{
+  long long count = -1;
+#ifdef __linux__
+  if (perf_fd >= 0) {
+    ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(perf_fd, &count, sizeof(count)) != sizeof(count)) {
+      count = -1;
+    }
+  }
+#endif
+  return count;
+}
+
+int main(void)
+{
+  unsigned int i;
+
+  flash_init();
+  perf_open();
+  printf("%-30s %6s %10s %8s %12s\n", "operation", "bytes", "ns/op", "ns/byte", "insns/op");
+
+  for (i = 0; i < sizeof(micro) / sizeof(micro[0]); i++) {
+    const micro_t *m = &micro[i];
+    unsigned long long n = 0;
+    unsigned long long t0;
+    unsigned long long t;
+    unsigned long long batch = 1;
+    long long insns;
+    double ns;
+
+    /* Warm up and find a batch of about a millisecond. */
+    for (;;) {
+      unsigned long long k;
+      t0 = now_ns();
+      for (k = 0; k < batch; k++) {
+        m->func(m->bytes);
+      }
+      if (now_ns() - t0 >= 1000000ULL) {
+        break;
+      }
+      batch *= 2;
+    }
+
+    perf_start();
+    t0 = now_ns();
+    do {
+      unsigned long long k;
+      for (k = 0; k < batch; k++) {
+        m->func(m->bytes);
+      }
+      n += batch;
+      t = now_ns() - t0;
+    } while (t < RUN_NS);
+    insns = perf_stop();
+
+    ns = (double)t / n;
+    printf("%-30s %6u %10.1f ", m->name, m->bytes, ns);
+    if (m->bytes) {
+      printf("%8.3f ", ns / m->bytes);
+    } else {
+      printf("%8s ", "-");
+    }
+    if (insns >= 0) {
+      printf("%12.1f\n", (double)insns / n);
+    } else {
+      printf("%12s\n", "-");
+    }
+  }
+  return 0;
+}
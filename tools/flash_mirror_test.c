@@ -0,0 +1,253 @@
+/**
+ * @file flash_mirror_test.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+/*
+ * Test of the mirroring over two simulated chips.
+ *
+ * Build from the top directory, or run tools/flash_dev_test.sh:
+ *
+ *   cc -std=c99 -O2 -I. -Itools -include tools/sim_port.h \
+ *     -o mirror_test tools/flash_mirror_test.c flash_mirror.c flash_lock.c \
+ *     tools/flash_sim_dev.c tools/flash_sim.c flash_bus.c flash_m25px16.c \
+ *     m25px16.c
+ *
+ * It checks the reads from the idle chip during the operations, the
+ * recovery of a sector left different by a power loss on either chip,
+ * the erase of the full journals and the repair. It exits with 0 on success.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "flash_dev.h"
+#include "flash_mirror.h"
+#include "flash_sim.h"
+#include "flash_sim_dev.h"
+
+#define SPI_KHZ         (20000)
+#define SECTOR_BYTES    (65536)
+#define PAGE_BYTES      (256)
+
+static unsigned char data[PAGE_BYTES];
+static unsigned char back[PAGE_BYTES];
+
+/**
+ * @brief Report a check.
+ *
+ * @param name The name of the check.
+ * @param ok The result.
+ *
+ * @return 0 if it passed, 1 otherwise.
+ */
+static int check(const char *name, int ok)
+{
+  printf("%-32s %s\n", name, ok ? "ok" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+/**
+ * @brief Run the mirror until the operation ends on both chips.
+ *
+ * @return The result of the last flash_mirror_busy.
+ */
+static int settle(void)
+{
+  int r;
+  while ((r = flash_mirror_busy()) == 1) {
+    flash_sim_delay_us(100);
+  }
+  return r;
+}
+
+/**
+ * @brief Compare a sector on the two chips.
+ *
+ * @param sector The sector.
+ *
+ * @return 1 if the chips have the same bytes.
+ */
+static int same(unsigned int sector)
+{
+  const unsigned char *a;
+  const unsigned char *b;
+  flash_sim_chip(0);
+  a = flash_sim_memory() + sector * SECTOR_BYTES;
+  flash_sim_chip(1);
+  b = flash_sim_memory() + sector * SECTOR_BYTES;
+  return memcmp(a, b, SECTOR_BYTES) == 0;
+}
+
+/**
+ * @brief Wait for the end of a cycle on a device.
+ *
+ * @param p The device.
+ *
+ * @return The result of the last busy.
+ */
+static int wait(const flash_dev_t *p)
+{
+  int r;
+  while ((r = p->busy(p->arg)) == 1) {
+    flash_sim_delay_us(100);
+  }
+  return r;
+}
+
+/**
+ * @brief Model a power loss.
+ * @details
+ * The simulated chips apply a program or an erase at once,
+ * so the cycle in progress is let end as a restart would.
+ *
+ * @param a The first device.
+ * @param b The second device.
+ */
+static void power_loss(const flash_dev_t *a, const flash_dev_t *b)
+{
+  wait(a);
+  wait(b);
+}
+
+/**
+ * @brief Check a page is erased through the mirror.
+ *
+ * @param addr The byte address of the page.
+ *
+ * @return 1 if the page is erased.
+ */
+static int blank(unsigned int addr)
+{
+  unsigned int i;
+  if (flash_mirror_read(addr, back, PAGE_BYTES) != 0) {
+    return 0;
+  }
+  for (i = 0; (i < PAGE_BYTES) && (back[i] == 0xFF); i++) {
+  }
+  return i == PAGE_BYTES;
+}
+
+int main(void)
+{
+  flash_dev_t a;
+  flash_dev_t b;
+  flash_info_t info;
+  unsigned int i;
+  int busy_seen;
+  int fail = 0;
+
+  for (i = 0; i < PAGE_BYTES; i++) {
+    data[i] = (unsigned char)(i * 7 + 3);
+  }
+  if ((flash_sim_dev_init(&a, 0, SPI_KHZ) != 0)
+      || (flash_sim_dev_init(&b, 1, SPI_KHZ) != 0)
+      || (flash_mirror_init(&a, &b) != 0)) {
+    return check("init", 0);
+  }
+
+  fail += check("program", (flash_mirror_program_start(0x10000, data, PAGE_BYTES) == 0) && (settle() == 0));
+  fail += check("program on both", same(1));
+
+  /*
+   * During the erase the reads go to the chip which is not erased yet,
+   * and then to the chip which has finished.
+   */
+  busy_seen = 0;
+  fail += check("erase start", flash_mirror_sector_erase_start(1) == 0);
+  while (flash_mirror_busy() == 1) {
+    if (a.busy(a.arg) || b.busy(b.arg)) {
+      busy_seen = 1;
+    }
+    if ((flash_mirror_read(0x10000, back, PAGE_BYTES) != 0)
+        || ((memcmp(back, data, PAGE_BYTES) != 0) && (back[0] != 0xFF))) {
+      busy_seen = -1;
+      break;
+    }
+    flash_sim_delay_us(10000);
+  }
+  fail += check("read during erase", busy_seen == 1);
+  fail += check("erase on both", same(1) && (flash_mirror_read(0x10000, back, 1) == 0) && (back[0] == 0xFF));
+
+  /*
+   * A power loss while the first chip programs: the mirror starts again
+   * with the sector of the second chip, which has not changed.
+   */
+  fail += check("program start", flash_mirror_program_start(0x20000, data, PAGE_BYTES) == 0);
+  while (!a.busy(a.arg) && (flash_mirror_busy() == 1)) {
+    flash_sim_delay_us(10);
+  }
+  fail += check("sector differs", !same(2));
+  power_loss(&a, &b);
+  fail += check("restart", flash_mirror_init(&a, &b) == 0);
+  fail += check("undone", same(2) && blank(0x20000));
+
+  /*
+   * A power loss while the second chip erases: the mirror starts again
+   * with the sector of the first chip, which has finished.
+   * The bits the erase has not cleared yet are programmed again.
+   */
+  fail += check("program", (flash_mirror_program_start(0x20000, data, PAGE_BYTES) == 0) && (settle() == 0));
+  fail += check("erase start", flash_mirror_sector_erase_start(2) == 0);
+  while (!(b.busy(b.arg) && blank(0x20000)) && (flash_mirror_busy() == 1)) {
+    flash_sim_delay_us(10);
+  }
+  power_loss(&a, &b);
+  fail += check("cut erase", (b.program_start(b.arg, 0x20000, data, PAGE_BYTES) == 0) && (wait(&b) == 0));
+  fail += check("sector differs", !same(2));
+  fail += check("restart", flash_mirror_init(&a, &b) == 0);
+  fail += check("completed", same(2) && blank(0x20000));
+
+  /*
+   * The journals are erased when they are full, and still work after it.
+   */
+  for (i = 0; (i <= SECTOR_BYTES / 8) && (flash_mirror_program_start(0x30000 + i % SECTOR_BYTES, data, 1) == 0); i++) {
+  }
+  fail += check("journal full", (i == SECTOR_BYTES / 8 + 1) && (settle() == 0) && same(3));
+  fail += check("program start", flash_mirror_program_start(0x40000, data, PAGE_BYTES) == 0);
+  while (!a.busy(a.arg) && (flash_mirror_busy() == 1)) {
+    flash_sim_delay_us(10);
+  }
+  power_loss(&a, &b);
+  fail += check("restart", flash_mirror_init(&a, &b) == 0);
+  fail += check("undone", same(4) && blank(0x40000));
+
+  /*
+   * The repair of a sector the caller knows to be different.
+   */
+  fail += check("differ", (b.program_start(b.arg, 0x50000, data, PAGE_BYTES) == 0) && (wait(&b) == 0) && !same(5));
+  fail += check("repair", flash_mirror_repair(5, 0) == 0);
+  fail += check("repaired", same(5) && blank(0x50000));
+  fail += check("one sector less", (flash_mirror_dev.info(0, &info) == 0)
+      && (info.sector_count == 31) && (info.page_count == 31 * SECTOR_BYTES / PAGE_BYTES));
+
+  return fail ? 1 : 0;
+}
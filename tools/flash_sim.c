@@ -0,0 +1,412 @@
+/**
+ * @file flash_sim.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "m25p16.h"
+#include "m25px16.h"
+#include "flash_sim.h"
+
+#define SIM_BYTES       (M25PX16_SECTOR_COUNT * M25PX16_SECTOR_BYTE_SIZE)
+#define SIM_SECTORS     (M25PX16_SECTOR_COUNT)
+#define SIM_PAGE_BYTES  (M25PX16_PAGE_BYTE_SIZE)
+
+#define SREG_WIP        (1 << 0)
+#define SREG_WEL        (1 << 1)
+#define SREG_BP         (7 << 2)
+#define SREG_TB         (1 << 5)
+#define SREG_SRWD       (1 << 7)
+
+#define CMD_NONE        (-1)
+
+typedef struct {
+  int model;
+  unsigned long long byte_ns;
+  unsigned long long busy_until;
+  int cmd;
+  unsigned int count;
+  unsigned long addr;
+  unsigned char data;
+  unsigned char sreg;
+  int power_down;
+  unsigned long cut;
+  int off;
+  unsigned char lock[SIM_SECTORS];
+  unsigned char page[SIM_PAGE_BYTES];
+  unsigned char written[SIM_PAGE_BYTES];
+  unsigned char mem[SIM_BYTES];
+  flash_sim_stats_t stats;
+} sim_t;
+
+static sim_t chips[FLASH_SIM_CHIP_MAX];
+static sim_t *sim = &chips[0];
+
+/**
+ * @brief Let the time pass on all chips.
+ * @details
+ * The chips share the clock, so a cycle on one chip goes on
+ * while the others are talked to.
+ *
+ * @param ns The time.
+ */
+static void elapse(unsigned long long ns)
+{
+  unsigned int i;
+  for (i = 0; i < FLASH_SIM_CHIP_MAX; i++) {
+    chips[i].stats.time_ns += ns;
+  }
+}
+
+/**
+ * @brief Check whether a write cycle is in progress.
+ */
+static int busy(void)
+{
+  return sim->stats.time_ns < sim->busy_until;
+}
+
+/**
+ * @brief Start a program or erase cycle.
+ *
+ * @param ns The duration.
+ */
+static void cycle(unsigned long long ns)
+{
+  sim->busy_until = sim->stats.time_ns + ns;
+  sim->stats.busy_ns += ns;
+  sim->sreg &= ~SREG_WEL;
+}
+
+/**
+ * @brief Check whether the sector is protected.
+ *
+ * @param sector The sector.
+ */
+static int protected(unsigned int sector)
+{
+  unsigned int bp = (sim->sreg & SREG_BP) >> 2;
+  unsigned int n;
+
+  if ((sim->model == FLASH_SIM_M25PX16) && (sim->lock[sector] & 1)) {
+    return 1;
+  }
+  if (bp == 0) {
+    return 0;
+  }
+  n = (bp >= 6) ? SIM_SECTORS : (1u << (bp - 1));
+  if ((sim->model == FLASH_SIM_M25PX16) && (sim->sreg & SREG_TB)) {
+    return sector < n;
+  }
+  return sector >= SIM_SECTORS - n;
+}
+
+/**
+ * @brief Execute a write instruction at the end of it.
+ */
+static void execute(void)
+{
+  unsigned int sector = (sim->addr / M25PX16_SECTOR_BYTE_SIZE) % SIM_SECTORS;
+  int px = (sim->model == FLASH_SIM_M25PX16);
+  int wel = (sim->sreg & SREG_WEL) != 0;
+  unsigned int i;
+
+  switch (sim->cmd) {
+    case 0x06:
+      sim->sreg |= SREG_WEL;
+      break;
+    case 0x04:
+      sim->sreg &= ~SREG_WEL;
+      break;
+    case 0x01:
+      if (wel && (sim->count >= 2)) {
+        unsigned char mask = SREG_SRWD | SREG_BP | (px ? SREG_TB : 0);
+        sim->sreg = (sim->sreg & ~mask) | (sim->data & mask);
+        sim->sreg &= ~SREG_WEL;
+      }
+      break;
+    case 0xE5:
+      if (px && wel && (sim->count >= 5)) {
+        if (!(sim->lock[sector] & 2)) {
+          sim->lock[sector] = sim->data & 3;
+        }
+        sim->sreg &= ~SREG_WEL;
+      }
+      break;
+    case 0x02:
+      if (wel && (sim->count >= 5) && !protected(sector)) {
+        unsigned long base = (sim->addr % SIM_BYTES) & ~(unsigned long)(SIM_PAGE_BYTES - 1);
+        for (i = 0; i < SIM_PAGE_BYTES; i++) {
+          if (sim->written[i]) {
+            sim->mem[base + i] &= sim->page[i];
+          }
+        }
+        sim->stats.page_programs++;
+        cycle(px ? M25PX16_PAGE_PROGRAM_TIME_TYP_US * 1000ULL : M25P16_PAGE_PROGRAM_TIME_TYP_US * 1000ULL);
+      }
+      break;
+    case 0x20:
+      if (px && wel && (sim->count == 4) && !protected(sector)) {
+        unsigned long base = (sim->addr % SIM_BYTES) & ~(unsigned long)(M25PX16_SUBSECTOR_BYTE_SIZE - 1);
+        memset(sim->mem + base, 0xFF, M25PX16_SUBSECTOR_BYTE_SIZE);
+        sim->stats.subsector_erases++;
+        cycle(M25PX16_SUBSECTOR_ERASE_TIME_TYP_MS * 1000000ULL);
+      }
+      break;
+    case 0xD8:
+      if (wel && (sim->count == 4) && !protected(sector)) {
+        memset(sim->mem + sector * M25PX16_SECTOR_BYTE_SIZE, 0xFF, M25PX16_SECTOR_BYTE_SIZE);
+        sim->stats.sector_erases++;
+        cycle(M25PX16_SECTOR_ERASE_TIME_TYP_MS * 1000000ULL);
+      }
+      break;
+    case 0xC7:
+      if (wel && (sim->count == 1)) {
+        for (i = 0; i < SIM_SECTORS; i++) {
+          if (protected(i)) {
+            return;
+          }
+        }
+        memset(sim->mem, 0xFF, SIM_BYTES);
+        sim->stats.bulk_erases++;
+        cycle(px ? M25PX16_BULK_ERASE_TIME_TYP_MS * 1000000ULL : M25P16_BULK_ERASE_TIME_TYP_MS * 1000000ULL);
+      }
+      break;
+    case 0xB9:
+      if (sim->count == 1) {
+        sim->power_down = 1;
+      }
+      break;
+    case 0xAB:
+      sim->power_down = 0;
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief Initialize the simulated chip.
+ *
+ * @param model FLASH_SIM_M25P16 or FLASH_SIM_M25PX16.
+ * @param spi_khz The SPI clock in kHz.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sim_init(int model, unsigned int spi_khz)
+{
+  if (((model != FLASH_SIM_M25P16) && (model != FLASH_SIM_M25PX16)) || (spi_khz == 0)) {
+    return -1;
+  }
+  memset(sim, 0, sizeof(*sim));
+  memset(sim->mem, 0xFF, sizeof(sim->mem));
+  sim->model = model;
+  sim->byte_ns = 8000000ULL / spi_khz;
+  sim->cmd = CMD_NONE;
+  return 0;
+}
+
+/**
+ * @brief Pick the chip for the other functions.
+ *
+ * @param n The chip number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sim_chip(unsigned int n)
+{
+  if (FLASH_SIM_CHIP_MAX <= n) {
+    return -1;
+  }
+  sim = &chips[n];
+  return 0;
+}
+
+/**
+ * @brief Drive the chip select low.
+ */
+void flash_sim_select(void)
+{
+  sim->stats.selects++;
+  sim->cmd = CMD_NONE;
+  sim->count = 0;
+  sim->addr = 0;
+  memset(sim->written, 0, sizeof(sim->written));
+}
+
+/**
+ * @brief Drive the chip select high.
+ */
+void flash_sim_deselect(void)
+{
+  unsigned long long until = sim->busy_until;
+
+  if ((sim->cmd != CMD_NONE) && !sim->off) {
+    execute();
+    if ((sim->busy_until != until) && (sim->cut != 0) && (--sim->cut == 0)) {
+      sim->off = 1;
+    }
+  }
+  sim->cmd = CMD_NONE;
+}
+
+/**
+ * @brief Transfer a byte.
+ * @details
+ * Only RDSR is accepted during a write cycle and only RDP in the
+ * deep power-down mode, like the real chips.
+ *
+ * @param c The byte to the chip.
+ *
+ * @return The byte from the chip.
+ */
+unsigned char flash_sim_transfer(unsigned char c)
+{
+  unsigned int n = sim->count++;
+  int px = (sim->model == FLASH_SIM_M25PX16);
+
+  elapse(sim->byte_ns);
+  sim->stats.bus_bytes++;
+
+  if (n == 0) {
+    sim->cmd = c;
+    if (sim->power_down && (c != 0xAB)) {
+      sim->cmd = CMD_NONE;
+    } else if (busy() && (c != 0x05)) {
+      sim->cmd = CMD_NONE;
+    } else if (c == 0x05) {
+      sim->stats.polls++;
+    }
+    return 0xFF;
+  }
+  if (sim->cmd == CMD_NONE) {
+    return 0xFF;
+  }
+
+  switch (sim->cmd) {
+    case 0x05:
+      return sim->sreg | (busy() ? SREG_WIP : 0);
+    case 0x9F:
+      switch (n) {
+        case 1: return 0x20;
+        case 2: return px ? 0x71 : 0x20;
+        case 3: return 0x15;
+        case 4: return 0x10;
+        default: return 0x00;
+      }
+    case 0x01:
+      if (n == 1) {
+        sim->data = c;
+      }
+      return 0xFF;
+    default:
+      break;
+  }
+
+  if (n <= 3) {
+    sim->addr = (sim->addr << 8) | c;
+    return 0xFF;
+  }
+
+  switch (sim->cmd) {
+    case 0x03:
+      return sim->mem[(sim->addr + (n - 4)) % SIM_BYTES];
+    case 0xE8:
+      return px ? sim->lock[(sim->addr / M25PX16_SECTOR_BYTE_SIZE) % SIM_SECTORS] : 0xFF;
+    case 0xE5:
+      if (n == 4) {
+        sim->data = c;
+      }
+      return 0xFF;
+    case 0x02:
+      {
+        unsigned int pos = (sim->addr + (n - 4)) % SIM_PAGE_BYTES;
+        sim->page[pos] = c;
+        sim->written[pos] = 1;
+      }
+      return 0xFF;
+    default:
+      return 0xFF;
+  }
+}
+
+/**
+ * @brief Cut the power of the picked chip.
+ * @details
+ * The instructions are ignored after the cut, while the memory
+ * array can still be read. With 0 the power comes back: the chip starts
+ * again with no cycle in progress and the write enable latch reset.
+ *
+ * @param count The number of program and erase cycles before the cut, or 0.
+ */
+void flash_sim_power_cut(unsigned long count)
+{
+  sim->cut = count;
+  if (count == 0) {
+    sim->off = 0;
+    sim->busy_until = 0;
+    sim->power_down = 0;
+    sim->sreg &= ~SREG_WEL;
+  }
+}
+
+/**
+ * @brief Let the simulated time pass.
+ *
+ * @param us The time in microseconds.
+ */
+void flash_sim_delay_us(unsigned int us)
+{
+  elapse(us * 1000ULL);
+}
+
+/**
+ * @brief Get the statistics.
+ *
+ * @param p The destination.
+ */
+void flash_sim_stats(flash_sim_stats_t *p)
+{
+  *p = sim->stats;
+}
+
+/**
+ * @brief Get the memory array.
+ *
+ * @return The memory array.
+ */
+const unsigned char *flash_sim_memory(void)
+{
+  return sim->mem;
+}
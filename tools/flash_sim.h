@@ -0,0 +1,149 @@
+/**
+ * @file flash_sim.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_SIM_H
+#define FLASH_SIM_H
+
+/**
+ * @brief Simulated chips.
+ */
+#define FLASH_SIM_M25P16    (0)
+#define FLASH_SIM_M25PX16   (1)
+
+/**
+ * @brief Number of simulated chips.
+ * @details
+ * The chips share the clock and have their own state.
+ * The functions work on the chip picked by flash_sim_chip, chip 0 at first.
+ */
+#define FLASH_SIM_CHIP_MAX  (4)
+
+/**
+ * @brief Statistics of the simulated chip.
+ */
+typedef struct {
+  unsigned long long time_ns;   /**< Simulated time. */
+  unsigned long long busy_ns;   /**< Time of the program and erase cycles. */
+  unsigned long bus_bytes;      /**< Bytes on the SPI bus. */
+  unsigned long selects;        /**< Chip select assertions. */
+  unsigned long polls;          /**< Status register reads. */
+  unsigned long page_programs;
+  unsigned long subsector_erases;
+  unsigned long sector_erases;
+  unsigned long bulk_erases;
+} flash_sim_stats_t;
+
+/**
+ * @brief Initialize the simulated chip.
+ * @details
+ * The memory array is erased and all protections are cleared.
+ * The program and erase cycles take the typical times of the datasheet.
+ *
+ * @param model FLASH_SIM_M25P16 or FLASH_SIM_M25PX16.
+ * @param spi_khz The SPI clock in kHz.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sim_init(int model, unsigned int spi_khz);
+
+/**
+ * @brief Pick the chip for the other functions.
+ * @details
+ * It works as a chip select decoder in front of the chips.
+ *
+ * @param n The chip number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sim_chip(unsigned int n);
+
+/**
+ * @brief Drive the chip select low.
+ */
+void flash_sim_select(void);
+
+/**
+ * @brief Drive the chip select high.
+ * @details
+ * The program, erase and write instructions are executed here.
+ */
+void flash_sim_deselect(void);
+
+/**
+ * @brief Transfer a byte.
+ *
+ * @param c The byte to the chip.
+ *
+ * @return The byte from the chip.
+ */
+unsigned char flash_sim_transfer(unsigned char c);
+
+/**
+ * @brief Cut the power of the picked chip.
+ * @details
+ * The last program or erase cycle before the cut is done, and the
+ * instructions after it are ignored until the power comes back, while
+ * the memory array can still be read. The program goes on to run, so a
+ * test can cut the power between any two changes of the memory array
+ * and look at what is left.
+ *
+ * @param count The number of program and erase cycles before the cut,
+ * or 0 to bring the power back.
+ */
+void flash_sim_power_cut(unsigned long count);
+
+/**
+ * @brief Let the simulated time pass.
+ *
+ * @param us The time in microseconds.
+ */
+void flash_sim_delay_us(unsigned int us);
+
+/**
+ * @brief Get the statistics.
+ *
+ * @param p The destination.
+ */
+void flash_sim_stats(flash_sim_stats_t *p);
+
+/**
+ * @brief Get the memory array.
+ *
+ * @return The memory array.
+ */
+const unsigned char *flash_sim_memory(void);
+
+#endif
@@ -0,0 +1,237 @@
+/**
+ * @file flash_sim_dev.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#include <string.h>
+#include "m25px16.h"
+#include "flash_sim.h"
+#include "flash_sim_dev.h"
+
+static unsigned int numbers[FLASH_SIM_CHIP_MAX];
+static unsigned int clock_khz[FLASH_SIM_CHIP_MAX];
+static unsigned long long read_end_ns[FLASH_SIM_CHIP_MAX];
+
+/**
+ * @brief Pick the chip of a device.
+ *
+ * @param arg The device argument.
+ */
+static void pick(void *arg)
+{
+  flash_sim_chip(*(const unsigned int *)arg);
+}
+
+/**
+ * @brief Check a cycle is in progress on the picked chip.
+ */
+static int wip(void)
+{
+  uint8_t sreg = 0;
+  m25px16_read_status_register(&sreg);
+  return M25PX16_SREG_WRITE_IN_PROGRESS(sreg) ? 1 : 0;
+}
+
+/**
+ * @brief Simulated device: information.
+ */
+static int dev_info(void *arg, flash_info_t *p)
+{
+  (void)arg;
+  p->page_count = M25PX16_PAGE_COUNT;
+  p->page_bytes = M25PX16_PAGE_BYTE_SIZE;
+  p->sector_count = M25PX16_SECTOR_COUNT;
+  p->sector_bytes = M25PX16_SECTOR_BYTE_SIZE;
+  p->subsector_count = M25PX16_SUBSECTOR_COUNT;
+  p->subsector_bytes = M25PX16_SUBSECTOR_BYTE_SIZE;
+  p->page_program_us = M25PX16_PAGE_PROGRAM_TIME_TYP_US;
+  p->subsector_erase_ms = M25PX16_SUBSECTOR_ERASE_TIME_TYP_MS;
+  p->sector_erase_ms = M25PX16_SECTOR_ERASE_TIME_TYP_MS;
+  p->bulk_erase_ms = M25PX16_BULK_ERASE_TIME_TYP_MS;
+  p->release_us = M25PX16_RELEASE_TIME_MAX_US;
+  p->page_program_max_us = M25PX16_PAGE_PROGRAM_TIME_MAX_US;
+  p->subsector_erase_max_ms = M25PX16_SUBSECTOR_ERASE_TIME_MAX_MS;
+  p->sector_erase_max_ms = M25PX16_SECTOR_ERASE_TIME_MAX_MS;
+  p->bulk_erase_max_ms = M25PX16_BULK_ERASE_TIME_MAX_MS;
+  return 0;
+}
+
+/**
+ * @brief Simulated device: read bytes.
+ */
+static int dev_read(void *arg, unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  if ((M25PX16_PAGE_COUNT * M25PX16_PAGE_BYTE_SIZE < addr + siz) || (addr + siz < addr)) {
+    return -1;
+  }
+  pick(arg);
+  if (wip()) {
+    return -1;
+  }
+  m25px16_read_data_bytes(addr, buf, siz);
+  return 0;
+}
+
+/**
+ * @brief Simulated device: start a read.
+ * @details
+ * It works as a DMA transfer on a bus of the chip's own: the bytes are
+ * copied at once, and the read ends after the time of the READ instruction
+ * at the SPI clock. The polls of dev_read_done let the time pass.
+ */
+static int dev_read_start(void *arg, unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  unsigned int chip = *(const unsigned int *)arg;
+  flash_sim_stats_t stats;
+
+  if ((M25PX16_PAGE_COUNT * M25PX16_PAGE_BYTE_SIZE < addr + siz) || (addr + siz < addr)) {
+    return -1;
+  }
+  pick(arg);
+  if (wip()) {
+    return -1;
+  }
+  memcpy(buf, flash_sim_memory() + addr, siz);
+  flash_sim_stats(&stats);
+  read_end_ns[chip] = stats.time_ns + (4ULL + siz) * 8 * 1000000 / clock_khz[chip];
+  return 0;
+}
+
+/**
+ * @brief Simulated device: check the end of a read.
+ */
+static int dev_read_done(void *arg)
+{
+  unsigned int chip = *(const unsigned int *)arg;
+  flash_sim_stats_t stats;
+
+  pick(arg);
+  flash_sim_stats(&stats);
+  if (stats.time_ns < read_end_ns[chip]) {
+    flash_sim_delay_us(1);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief Simulated device: start to program bytes within a page.
+ */
+static int dev_program_start(void *arg, unsigned int addr, unsigned char *buf, unsigned int siz)
+{
+  if ((M25PX16_PAGE_COUNT * M25PX16_PAGE_BYTE_SIZE <= addr)
+      || (M25PX16_PAGE_BYTE_SIZE < addr % M25PX16_PAGE_BYTE_SIZE + siz)) {
+    return -1;
+  }
+  pick(arg);
+  if (wip()) {
+    return -1;
+  }
+  m25px16_write_enable();
+  m25px16_page_program(addr, buf, siz);
+  return 0;
+}
+
+/**
+ * @brief Simulated device: start to erase a sector.
+ */
+static int dev_sector_erase_start(void *arg, unsigned int sector)
+{
+  if (M25PX16_SECTOR_COUNT <= sector) {
+    return -1;
+  }
+  pick(arg);
+  if (wip()) {
+    return -1;
+  }
+  m25px16_write_enable();
+  m25px16_sector_erase(sector * M25PX16_SECTOR_BYTE_SIZE);
+  return 0;
+}
+
+/**
+ * @brief Simulated device: start to erase a subsector.
+ */
+static int dev_subsector_erase_start(void *arg, unsigned int subsector)
+{
+  if (M25PX16_SUBSECTOR_COUNT <= subsector) {
+    return -1;
+  }
+  pick(arg);
+  if (wip()) {
+    return -1;
+  }
+  m25px16_write_enable();
+  m25px16_subsector_erase(subsector * M25PX16_SUBSECTOR_BYTE_SIZE);
+  return 0;
+}
+
+/**
+ * @brief Simulated device: busy while a cycle is in progress.
+ */
+static int dev_busy(void *arg)
+{
+  pick(arg);
+  return wip();
+}
+
+/**
+ * @brief Make a device of a simulated M25PX16.
+ *
+ * @param dev The device.
+ * @param chip The chip number, less than FLASH_SIM_CHIP_MAX.
+ * @param spi_khz The SPI clock in kHz.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sim_dev_init(flash_dev_t *dev, unsigned int chip, unsigned int spi_khz)
+{
+  if (flash_sim_chip(chip) != 0) {
+    return -1;
+  }
+  if (flash_sim_init(FLASH_SIM_M25PX16, spi_khz) != 0) {
+    return -1;
+  }
+  dev->info = dev_info;
+  dev->read = dev_read;
+  dev->program_start = dev_program_start;
+  dev->sector_erase_start = dev_sector_erase_start;
+  dev->subsector_erase_start = dev_subsector_erase_start;
+  dev->busy = dev_busy;
+  dev->read_start = dev_read_start;
+  dev->read_done = dev_read_done;
+  numbers[chip] = chip;
+  clock_khz[chip] = spi_khz;
+  dev->arg = &numbers[chip];
+  return 0;
+}
@@ -0,0 +1,59 @@
+/**
+ * @file flash_sim_dev.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_SIM_DEV_H
+#define FLASH_SIM_DEV_H
+
+#include "flash_dev.h"
+
+/**
+ * @brief Make a device of a simulated M25PX16.
+ * @details
+ * The chip is initialized with flash_sim_init. The functions of the device
+ * pick the chip with flash_sim_chip and drive it with the M25PX16 driver,
+ * so several devices can be used at once, e.g. for striping or mirroring.
+ * The program and erase functions fail when a cycle is in progress.
+ * read_start works as a DMA transfer on a bus of the chip's own, so the
+ * reads of several devices overlap in the simulated time.
+ *
+ * @param dev The device.
+ * @param chip The chip number, less than FLASH_SIM_CHIP_MAX.
+ * @param spi_khz The SPI clock in kHz.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_sim_dev_init(flash_dev_t *dev, unsigned int chip, unsigned int spi_khz);
+
+#endif
@@ -0,0 +1,207 @@
+/**
+ * @file flash_stripe_test.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+/*
+ * Test of the striping over two simulated chips.
+ *
+ * Build from the top directory, or run tools/flash_dev_test.sh:
+ *
+ *   cc -std=c99 -O2 -I. -Itools -include tools/sim_port.h \
+ *     -o stripe_test tools/flash_stripe_test.c flash_stripe.c \
+ *     tools/flash_sim_dev.c tools/flash_sim.c flash_bus.c flash_m25px16.c \
+ *     m25px16.c
+ *
+ * It checks the data through the striped device, the address mapping on
+ * the chips and the overlap of the program cycles and of the reads.
+ * It exits with 0 on success.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "flash_dev.h"
+#include "flash_sim.h"
+#include "flash_sim_dev.h"
+#include "flash_stripe.h"
+
+#define SPI_KHZ         (20000)
+#define CHIP_BYTES      (2 * 1024 * 1024)
+#define START           (1000)
+#define LENGTH          (200000)
+
+static unsigned char data[LENGTH];
+static unsigned char back[LENGTH];
+
+/**
+ * @brief Report a check.
+ *
+ * @param name The name of the check.
+ * @param ok The result.
+ *
+ * @return 0 if it passed, 1 otherwise.
+ */
+static int check(const char *name, int ok)
+{
+  printf("%-32s %s\n", name, ok ? "ok" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+/**
+ * @brief Simulated time.
+ *
+ * @return The time in nanoseconds.
+ */
+static unsigned long long now(void)
+{
+  flash_sim_stats_t stats;
+  flash_sim_stats(&stats);
+  return stats.time_ns;
+}
+
+/**
+ * @brief Check the bytes on the chips against the mapping of flash_stripe_init.
+ *
+ * @param stripe The stripe size.
+ * @param count The number of chips.
+ *
+ * @return 1 if all bytes are where the mapping puts them.
+ */
+static int mapped(unsigned int stripe, unsigned int count)
+{
+  unsigned int a;
+  for (a = 0; a < 2 * 2 * 65536; a++) {
+    unsigned int k = a / stripe;
+    unsigned int phys = (k / count) * stripe + a % stripe;
+    unsigned char want = ((START <= a) && (a < START + LENGTH)) ? data[a - START] : 0xFF;
+    flash_sim_chip(k % count);
+    if (flash_sim_memory()[phys] != want) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Run the checks with a stripe size.
+ *
+ * @param stripe The stripe size.
+ *
+ * @return The number of the failed checks.
+ */
+static int run(unsigned int stripe)
+{
+  flash_dev_t a;
+  flash_dev_t b;
+  const flash_dev_t *dev[2];
+  flash_sim_stats_t sa;
+  flash_sim_stats_t sb;
+  flash_info_t info;
+  unsigned long long read_ns;
+  unsigned long long serial_ns;
+  char name[64];
+  int ok;
+  int fail = 0;
+
+  dev[0] = &a;
+  dev[1] = &b;
+  if ((flash_sim_dev_init(&a, 0, SPI_KHZ) != 0)
+      || (flash_sim_dev_init(&b, 1, SPI_KHZ) != 0)
+      || (flash_stripe_init(dev, 2, stripe) != 0)) {
+    return check("init", 0);
+  }
+  printf("stripe %u\n", stripe);
+
+  flash_stripe_dev.info(flash_stripe_dev.arg, &info);
+  fail += check("info", (info.sector_bytes == 2 * 65536) && (info.page_count == 2 * 8192));
+
+  fail += check("erase", (flash_stripe_sector_erase(0) == 0) && (flash_stripe_sector_erase(1) == 0));
+  fail += check("program", flash_stripe_program(START, data, LENGTH) == 0);
+  fail += check("read", (flash_stripe_read(START, back, LENGTH) == 0) && (memcmp(back, data, LENGTH) == 0));
+  fail += check("mapping", mapped(stripe, 2));
+
+  /*
+   * Each chip has half of the pages, and they program at the same time.
+   */
+  flash_sim_chip(0);
+  flash_sim_stats(&sa);
+  flash_sim_chip(1);
+  flash_sim_stats(&sb);
+  snprintf(name, sizeof(name), "overlap %.2f", (double)(sa.busy_ns + sb.busy_ns) / sa.time_ns);
+  fail += check(name, (sa.page_programs != 0) && (sb.page_programs != 0)
+      && (sa.busy_ns + sb.busy_ns > sa.time_ns * 3 / 2));
+
+  /*
+   * The reads of the two chips overlap, so they take about half the time
+   * of the reads one after another.
+   */
+  read_ns = now();
+  memset(back, 0, LENGTH);
+  ok = (flash_stripe_read(START, back, LENGTH) == 0) && (memcmp(back, data, LENGTH) == 0);
+  read_ns = now() - read_ns;
+  a.read_start = 0;
+  a.read_done = 0;
+  b.read_start = 0;
+  b.read_done = 0;
+  serial_ns = now();
+  memset(back, 0, LENGTH);
+  ok = ok && (flash_stripe_read(START, back, LENGTH) == 0) && (memcmp(back, data, LENGTH) == 0);
+  serial_ns = now() - serial_ns;
+  snprintf(name, sizeof(name), "read overlap %.2f", (double)serial_ns / read_ns);
+  fail += check(name, ok && (serial_ns * 2 > read_ns * 3));
+
+  if (info.subsector_count != 0) {
+    unsigned int s = info.subsector_bytes;
+    fail += check("subsector erase", flash_stripe_subsector_erase(0) == 0);
+    memset(data, 0xFF, s - START);
+    fail += check("subsector mapping", mapped(stripe, 2));
+  }
+
+  return fail;
+}
+
+int main(void)
+{
+  unsigned int i;
+  int fail = 0;
+
+  for (i = 0; i < LENGTH; i++) {
+    data[i] = (unsigned char)((i * 2654435761u) >> 13);
+  }
+  fail += run(4096);
+  for (i = 0; i < LENGTH; i++) {
+    data[i] = (unsigned char)((i * 2246822519u) >> 11);
+  }
+  fail += run(256);
+
+  return fail ? 1 : 0;
+}
@@ -0,0 +1,294 @@
+/**
+ * @file flash_uffd.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+/*
+ * Linux only. It needs userfaultfd, which may require root or
+ * vm.unprivileged_userfaultfd=1 on kernels before 5.11.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+#include "flash.h"
+#include "flash_uffd.h"
+
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+
+/**
+ * @brief Read a block and place it in the mapping.
+ *
+ * @param p The mapping.
+ * @param block The block number.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int fill(flash_uffd_t *p, unsigned int block)
+{
+  struct uffdio_copy copy;
+
+  if (p->present[block]) {
+    return 0;
+  }
+  if (flash_read(block * p->block_bytes, p->staging, p->block_bytes) != 0) {
+    return -1;
+  }
+  copy.dst = (unsigned long)(p->base + block * p->block_bytes);
+  copy.src = (unsigned long)p->staging;
+  copy.len = p->block_bytes;
+  copy.mode = 0;
+  copy.copy = 0;
+  /*
+   * The block can be touched as soon as it is copied,
+   * so account for it first.
+   */
+  p->present[block] = 1;
+  p->blocks++;
+  if ((ioctl(p->uffd, UFFDIO_COPY, &copy) != 0) && (errno != EEXIST)) {
+    p->present[block] = 0;
+    p->blocks--;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Handle a page fault.
+ *
+ * @param p The mapping.
+ * @param addr The fault address.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int fault(flash_uffd_t *p, unsigned long addr)
+{
+  unsigned int block = (addr - (unsigned long)p->base) / p->block_bytes;
+  unsigned int count = p->size / p->block_bytes;
+  unsigned int i;
+
+  p->faults++;
+  if (fill(p, block) != 0) {
+    return -1;
+  }
+  /*
+   * The next fault of a sequential reader is after the blocks read ahead,
+   * so the last of them is the one to continue from.
+   */
+  i = 1;
+  if (block == p->last_block + 1) {
+    for (; (i <= p->readahead) && (block + i < count); i++) {
+      if (fill(p, block + i) != 0) {
+        return -1;
+      }
+    }
+  }
+  p->last_block = block + i - 1;
+  return 0;
+}
+
+/**
+ * @brief Fault handler thread.
+ *
+ * @param arg The mapping.
+ */
+static void *handler(void *arg)
+{
+  flash_uffd_t *p = arg;
+  struct pollfd fds[2];
+  struct uffd_msg msg;
+
+  fds[0].fd = p->uffd;
+  fds[0].events = POLLIN;
+  fds[1].fd = p->stop[0];
+  fds[1].events = POLLIN;
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (fds[1].revents) {
+      break;
+    }
+    if (read(p->uffd, &msg, sizeof(msg)) != sizeof(msg)) {
+      continue;
+    }
+    if (msg.event != UFFD_EVENT_PAGEFAULT) {
+      continue;
+    }
+    if (fault(p, msg.arg.pagefault.address) != 0) {
+      /*
+       * The faulting thread would wait forever. Give it a zero filled
+       * block and leave the error for the owner of the mapping.
+       */
+      struct uffdio_zeropage zero;
+      unsigned long page = msg.arg.pagefault.address & ~(unsigned long)(p->block_bytes - 1);
+      p->error = 1;
+      zero.range.start = page;
+      zero.range.len = p->block_bytes;
+      zero.mode = 0;
+      ioctl(p->uffd, UFFDIO_ZEROPAGE, &zero);
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Map the flash into the process.
+ *
+ * @param p The mapping.
+ * @param readahead The number of blocks read ahead on sequential faults.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_uffd_open(flash_uffd_t *p, unsigned int readahead)
+{
+  struct uffdio_api api;
+  struct uffdio_register reg;
+  flash_info_t info;
+  long page;
+
+  memset(p, 0, sizeof(*p));
+  p->uffd = -1;
+  p->stop[0] = -1;
+  p->stop[1] = -1;
+  if (flash_info(&info) != 0) {
+    return -1;
+  }
+  /*
+   * The kernel places whole host pages, so a block is one of them when
+   * they are larger, e.g. 16KB or 64KB on arm64.
+   */
+  page = sysconf(_SC_PAGESIZE);
+  if ((page <= 0) || (page & (page - 1))) {
+    return -1;
+  }
+  p->block_bytes = (FLASH_UFFD_BLOCK_BYTES < page) ? (unsigned int)page : FLASH_UFFD_BLOCK_BYTES;
+  if ((info.sector_count * info.sector_bytes) % p->block_bytes) {
+    return -1;
+  }
+  p->size = info.sector_count * info.sector_bytes;
+  p->readahead = readahead;
+  p->last_block = ~0u - 1;
+  p->present = calloc(p->size / p->block_bytes, 1);
+  p->staging = malloc(p->block_bytes);
+  if ((p->present == 0) || (p->staging == 0)) {
+    goto error;
+  }
+
+  p->base = mmap(0, p->size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p->base == MAP_FAILED) {
+    p->base = 0;
+    goto error;
+  }
+
+  p->uffd = syscall(__NR_userfaultfd, O_CLOEXEC | UFFD_USER_MODE_ONLY);
+  if (p->uffd < 0) {
+    p->uffd = syscall(__NR_userfaultfd, O_CLOEXEC);
+  }
+  if (p->uffd < 0) {
+    goto error;
+  }
+  api.api = UFFD_API;
+  api.features = 0;
+  if (ioctl(p->uffd, UFFDIO_API, &api) != 0) {
+    goto error;
+  }
+  reg.range.start = (unsigned long)p->base;
+  reg.range.len = p->size;
+  reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+  if (ioctl(p->uffd, UFFDIO_REGISTER, &reg) != 0) {
+    goto error;
+  }
+
+  if (pipe(p->stop) != 0) {
+    goto error;
+  }
+  if (pthread_create(&p->thread, 0, handler, p) != 0) {
+    goto error;
+  }
+  return 0;
+
+error:
+  if (p->stop[0] >= 0) {
+    close(p->stop[0]);
+    close(p->stop[1]);
+  }
+  if (p->uffd >= 0) {
+    close(p->uffd);
+  }
+  if (p->base) {
+    munmap(p->base, p->size);
+  }
+  free(p->present);
+  free(p->staging);
+  memset(p, 0, sizeof(*p));
+  return -1;
+}
+
+/**
+ * @brief Unmap the flash.
+ *
+ * @param p The mapping.
+ */
+void flash_uffd_close(flash_uffd_t *p)
+{
+  if (p->base == 0) {
+    return;
+  }
+  if (write(p->stop[1], "", 1) == 1) {
+    pthread_join(p->thread, 0);
+  }
+  close(p->stop[0]);
+  close(p->stop[1]);
+  close(p->uffd);
+  munmap(p->base, p->size);
+  free(p->present);
+  free(p->staging);
+  memset(p, 0, sizeof(*p));
+}
@@ -0,0 +1,98 @@
+/**
+ * @file flash_uffd.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef FLASH_UFFD_H
+#define FLASH_UFFD_H
+
+#include <pthread.h>
+
+/**
+ * @brief Smallest size of the block faulted in at once.
+ * @details
+ * The block is the host page when it is larger, e.g. 16KB or 64KB on arm64,
+ * as the kernel places whole pages. It is in block_bytes of the mapping.
+ */
+#define FLASH_UFFD_BLOCK_BYTES  (4096)
+
+/**
+ * @brief Demand paged view of the flash.
+ * @details
+ * faults, blocks and present are updated by the handler thread.
+ * present has an entry for each block of block_bytes.
+ * error is set when a block could not be read. The block is zero filled then.
+ */
+typedef struct {
+  unsigned char *base;
+  unsigned int size;
+  unsigned int block_bytes;
+  unsigned int readahead;
+  int uffd;
+  int stop[2];
+  pthread_t thread;
+  unsigned int last_block;
+  unsigned char *present;
+  unsigned char *staging;
+  unsigned long faults;
+  unsigned long blocks;
+  int error;
+} flash_uffd_t;
+
+/**
+ * @brief Map the flash into the process.
+ * @details
+ * It reserves a virtual range of the size of the flash. A block is read
+ * with flash_read on the first touch of it by a handler thread.
+ * On a fault in the block after the previous one, or after the last
+ * block read ahead, the following blocks up to readahead are read as well.
+ * A block is streamed by one READ command of the flash layer.
+ * The drivers have no FAST_READ, so the SPI clock is limited to the one of READ.
+ * The flash layer must be initialized, and built with
+ * FLASH_CONFIG_THREAD_SAFE if the process uses it from other threads.
+ *
+ * @param p The mapping.
+ * @param readahead The number of blocks read ahead on sequential faults.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+int flash_uffd_open(flash_uffd_t *p, unsigned int readahead);
+
+/**
+ * @brief Unmap the flash.
+ *
+ * @param p The mapping.
+ */
+void flash_uffd_close(flash_uffd_t *p);
+
+#endif
@@ -0,0 +1,146 @@
+/**
+ * @file flash_uffd_test.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+/*
+ * Test of the demand paged view of a simulated chip.
+ *
+ * Build from the top directory, or run tools/flash_dev_test.sh:
+ *
+ *   cc -std=c99 -O2 -I. -Itools -include tools/sim_port.h \
+ *     -o uffd_test tools/flash_uffd_test.c tools/flash_uffd.c \
+ *     tools/flash_sim.c flash_bus.c flash_m25px16.c m25px16.c -lpthread
+ *
+ * It checks the contents of the mapping, the number of faults of a
+ * sequential scan with readahead, and a scan in reverse order, which
+ * reads nothing ahead. It exits with 0 on success, and also when the
+ * host does not allow userfaultfd.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "flash.h"
+#include "flash_sim.h"
+#include "flash_uffd.h"
+
+#define SPI_KHZ         (20000)
+#define READAHEAD       (4)
+#define PATTERN_BYTES   (65536)
+
+static unsigned char pattern[PATTERN_BYTES];
+
+/**
+ * @brief Report a check.
+ *
+ * @param name The name of the check.
+ * @param ok The result.
+ *
+ * @return 0 if it passed, 1 otherwise.
+ */
+static int check(const char *name, int ok)
+{
+  printf("%-32s %s\n", name, ok ? "ok" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+/**
+ * @brief Touch every block of a mapping once.
+ *
+ * @param p The mapping.
+ * @param reverse Touch them from the last one.
+ *
+ * @return A sum of the bytes touched.
+ */
+static unsigned long scan(flash_uffd_t *p, int reverse)
+{
+  volatile unsigned char *base = p->base;
+  unsigned int count = p->size / p->block_bytes;
+  unsigned long sum = 0;
+  unsigned int i;
+
+  for (i = 0; i < count; i++) {
+    sum += base[(reverse ? (count - 1 - i) : i) * p->block_bytes];
+  }
+  return sum;
+}
+
+int main(void)
+{
+  flash_uffd_t u;
+  unsigned int count;
+  unsigned int i;
+  int fail = 0;
+
+  for (i = 0; i < PATTERN_BYTES; i++) {
+    pattern[i] = (unsigned char)((i * 7) ^ (i >> 8));
+  }
+  if ((flash_sim_init(FLASH_SIM_M25PX16, SPI_KHZ) != 0) || (flash_init() != 0)) {
+    return check("init", 0);
+  }
+  for (i = 0; i < PATTERN_BYTES; i += 256) {
+    if (flash_page_write((3 * PATTERN_BYTES + i) / 256, pattern + i, 256) != 0) {
+      return check("program", 0);
+    }
+  }
+
+  if (flash_uffd_open(&u, READAHEAD) != 0) {
+    if ((errno == EPERM) || (errno == ENOSYS) || (errno == EACCES)) {
+      printf("%-32s %s\n", "open", "skipped, no userfaultfd");
+      return 0;
+    }
+    return check("open", 0);
+  }
+  count = u.size / u.block_bytes;
+
+  /*
+   * The first fault reads one block. Each later fault of the scan reads
+   * its block and READAHEAD blocks after it.
+   */
+  scan(&u, 0);
+  fail += check("sequential faults", u.faults == 1 + (count - 1 + READAHEAD) / (READAHEAD + 1));
+  fail += check("sequential blocks", u.blocks == count);
+  fail += check("contents", (memcmp(u.base + 3 * PATTERN_BYTES, pattern, PATTERN_BYTES) == 0)
+      && (memcmp(u.base, flash_sim_memory(), u.size) == 0));
+  fail += check("no error", u.error == 0);
+  flash_uffd_close(&u);
+
+  if (flash_uffd_open(&u, READAHEAD) != 0) {
+    return check("open again", 0);
+  }
+  scan(&u, 1);
+  fail += check("reverse faults", (u.faults == count) && (u.blocks == count));
+  flash_uffd_close(&u);
+
+  return fail ? 1 : 0;
+}
@@ -0,0 +1,312 @@
+/**
+ * @file flash_xfer_pty.c
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+/*
+ * Transfer of an image with flash_xfer over a pty pair.
+ *
+ * The program opens a pty pair and forks. The child is the target on the
+ * simulated chip at one end, and the parent is the host at the other end.
+ * When the target has programmed the image it compares the chip with the
+ * image, and the exit code of the program tells the result.
+ *
+ * Build from the top directory, or run tools/flash_xfer_pty.sh:
+ *
+ *   cc -std=c99 -O2 -I. -Itools -include tools/sim_port.h \
+ *     -o xfer_pty tools/flash_xfer_pty.c flash_xfer.c flash_util.c tools/flash_sim.c \
+ *     flash_bus.c flash_m25px16.c m25px16.c -lutil
+ *
+ * Usage: xfer_pty <image> [-a addr] [-r] [-e n]
+ *
+ * -a gives the page aligned byte address, -r enables the run length encoding
+ * and -e corrupts one in n bytes from the host to exercise the retransmission.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "flash.h"
+#include "flash_sim.h"
+#include "flash_xfer.h"
+
+#define SPI_KHZ         (20000)
+#define IMAGE_MAX       (2 * 1024 * 1024)
+
+typedef struct {
+  int fd;
+  int hangup;
+  unsigned int error_rate;
+  unsigned int seed;
+  unsigned long corrupted;
+} port_t;
+
+static unsigned char image[IMAGE_MAX];
+
+/**
+ * @brief Get a byte from the pty without blocking.
+ *
+ * @param arg The port.
+ *
+ * @return The byte, or -1 when no byte is available.
+ */
+static int port_get(void *arg)
+{
+  port_t *p = (port_t *)arg;
+  struct pollfd pfd;
+  unsigned char c;
+
+  pfd.fd = p->fd;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, 0) <= 0) {
+    return -1;
+  }
+  if (read(p->fd, &c, 1) != 1) {
+    p->hangup = 1;
+    return -1;
+  }
+  return c;
+}
+
+/**
+ * @brief Put a byte to the pty.
+ * @details
+ * With an error rate, some bytes are corrupted on the way.
+ *
+ * @param c The byte.
+ * @param arg The port.
+ */
+static void port_put(int c, void *arg)
+{
+  port_t *p = (port_t *)arg;
+  unsigned char b = (unsigned char)c;
+
+  if (p->error_rate != 0) {
+    p->seed = p->seed * 1103515245u + 12345u;
+    if ((p->seed >> 16) % p->error_rate == 0) {
+      b ^= 0x55;
+      p->corrupted++;
+    }
+  }
+  while (write(p->fd, &b, 1) != 1) {
+    if ((errno != EINTR) && (errno != EAGAIN)) {
+      p->hangup = 1;
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Put a pty in the raw mode.
+ *
+ * @param fd The pty.
+ */
+static void raw(int fd)
+{
+  struct termios t;
+  tcgetattr(fd, &t);
+  cfmakeraw(&t);
+  tcsetattr(fd, TCSANOW, &t);
+}
+
+/**
+ * @brief Current time in microseconds.
+ */
+static unsigned int now_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned int)(ts.tv_sec * 1000000u + ts.tv_nsec / 1000);
+}
+
+/**
+ * @brief Run the target until the host hangs up.
+ *
+ * @param fd The pty of the target.
+ * @param siz The size of the image.
+ * @param addr The byte address of the image.
+ *
+ * @return The exit code, 0 if the chip has the image.
+ */
+static int target(int fd, unsigned int siz, unsigned int addr)
+{
+  static flash_xfer_target_t t;
+  flash_xfer_io_t io;
+  port_t port;
+  int code = 2;
+  int r;
+
+  memset(&port, 0, sizeof(port));
+  port.fd = fd;
+  io.get = port_get;
+  io.put = port_put;
+  io.arg = &port;
+
+  if ((flash_sim_init(FLASH_SIM_M25PX16, SPI_KHZ) != 0)
+      || (flash_init() != 0)
+      || (flash_xfer_target_init(&t, &io) != 0)) {
+    return 2;
+  }
+  /*
+   * The target keeps answering after the end,
+   * in case the host sends the end frame again.
+   */
+  while (!port.hangup) {
+    r = flash_xfer_target_poll(&t);
+    if (r == FLASH_XFER_ERROR) {
+      return 2;
+    }
+    if ((r == FLASH_XFER_DONE) && (code == 2)) {
+      code = (memcmp(flash_sim_memory() + addr, image, siz) == 0) ? 0 : 1;
+    }
+  }
+  return code;
+}
+
+/**
+ * @brief Run the host to the end of the transfer.
+ *
+ * @param fd The pty of the host.
+ * @param siz The size of the image.
+ * @param addr The byte address of the image.
+ * @param rle Use the run length encoding.
+ * @param error_rate Corrupt one in error_rate bytes, or 0.
+ *
+ * @retval 0 Success.
+ * @retval !0 Failure.
+ */
+static int host(int fd, unsigned int siz, unsigned int addr, int rle, unsigned int error_rate)
+{
+  static flash_xfer_host_t h;
+  flash_xfer_io_t io;
+  port_t port;
+  unsigned int start = now_us();
+  int r;
+
+  memset(&port, 0, sizeof(port));
+  port.fd = fd;
+  port.error_rate = error_rate;
+  port.seed = 1;
+  io.get = port_get;
+  io.put = port_put;
+  io.arg = &port;
+
+  if (flash_xfer_host_init(&h, &io, image, siz, addr, rle) != 0) {
+    return -1;
+  }
+  do {
+    r = flash_xfer_host_poll(&h, now_us());
+  } while ((r == FLASH_XFER_RUNNING) && !port.hangup);
+
+  printf("%u bytes at 0x%06x in %u ms, %lu bytes corrupted: %s\n",
+      siz, addr, (now_us() - start) / 1000, port.corrupted,
+      (r == FLASH_XFER_DONE) ? "done" : "error");
+  return (r == FLASH_XFER_DONE) ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned int addr = 0;
+  unsigned int error_rate = 0;
+  unsigned int siz;
+  int rle = 0;
+  int master;
+  int slave;
+  int status;
+  pid_t pid;
+  FILE *fp;
+  int r;
+  int i;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <image> [-a addr] [-r] [-e n]\n", argv[0]);
+    return 2;
+  }
+  for (i = 2; i < argc; i++) {
+    if ((strcmp(argv[i], "-a") == 0) && (i + 1 < argc)) {
+      addr = strtoul(argv[++i], 0, 0);
+    } else if (strcmp(argv[i], "-r") == 0) {
+      rle = 1;
+    } else if ((strcmp(argv[i], "-e") == 0) && (i + 1 < argc)) {
+      error_rate = strtoul(argv[++i], 0, 0);
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  fp = fopen(argv[1], "rb");
+  if (fp == 0) {
+    perror(argv[1]);
+    return 2;
+  }
+  siz = fread(image, 1, sizeof(image), fp);
+  fclose(fp);
+  if ((siz == 0) || (IMAGE_MAX - addr < siz)) {
+    fprintf(stderr, "bad image size or address\n");
+    return 2;
+  }
+
+  if (openpty(&master, &slave, 0, 0, 0) != 0) {
+    perror("openpty");
+    return 2;
+  }
+  raw(master);
+  raw(slave);
+
+  pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return 2;
+  }
+  if (pid == 0) {
+    close(master);
+    _exit(target(slave, siz, addr));
+  }
+  close(slave);
+  r = host(master, siz, addr, rle, error_rate);
+  close(master);
+  if (waitpid(pid, &status, 0) != pid) {
+    return 2;
+  }
+  r = (r == 0) && WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+  printf("chip %s the image\n", (r == 0) ? "has" : "does not have");
+  return r;
+}
@@ -0,0 +1,24 @@
+#!/bin/sh
+#
+# Run flash_xfer end to end over a pty pair with the simulated chip.
+# Run it from the top directory.
+#
+
+set -e
+
+CC=${CC:-cc}
+CFLAGS="-std=c99 -O2 -Wall -I. -Itools -include tools/sim_port.h"
+
+$CC $CFLAGS -o xfer_pty tools/flash_xfer_pty.c flash_xfer.c flash_util.c tools/flash_sim.c \
+  flash_bus.c flash_m25px16.c m25px16.c -lutil
+
+# Random data, a run of 0xFF and a run of 0x00.
+{
+  head -c 100000 /dev/urandom
+  head -c 50000 /dev/zero | tr '\000' '\377'
+  head -c 30000 /dev/zero
+} > xfer_pty.bin
+
+./xfer_pty xfer_pty.bin
+./xfer_pty xfer_pty.bin -a 0x10000 -r
+./xfer_pty xfer_pty.bin -r -e 5000
@@ -0,0 +1,71 @@
+/**
+ * @file null_port.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef NULL_PORT_H
+#define NULL_PORT_H
+
+/*
+ * Porting macros for the CPU overhead microbenchmarks.
+ * The SPI bus is a memcpy transport: the bytes sent go to a sink buffer
+ * and the bytes received come from a source buffer of zeros, so every
+ * status poll sees the chip ready. With NULL_PORT_DISCARD the bytes sent
+ * are discarded and zeros are received. Give it to the compiler with -include.
+ */
+
+#define NULL_PORT_BYTES (8192)
+
+extern unsigned char null_port_sink[NULL_PORT_BYTES];
+extern unsigned char null_port_source[NULL_PORT_BYTES];
+extern unsigned int null_port_pos;
+
+#ifdef NULL_PORT_DISCARD
+static inline unsigned char null_port_discard(unsigned char d)
+{
+  (void)d;
+  return 0;
+}
+#define SPI_TRANSMIT(D)     null_port_discard(D)
+#else
+#define SPI_TRANSMIT(D) \
+  (null_port_sink[null_port_pos % NULL_PORT_BYTES] = (D), \
+   null_port_source[null_port_pos++ % NULL_PORT_BYTES])
+#endif
+
+#define SPI_INIT()
+#define SPI_ASSERT()        (null_port_pos = 0)
+#define SPI_DEASSERT()
+
+#define FLASH_DELAY_US(US)
+
+#endif
@@ -0,0 +1,87 @@
+/**
+ * @file sim_port.h
+ * @author Shinichiro Nakamura
+ */
+
+/*
+ * ===============================================================
+ *  BlueBoot - Blackfin SPI Flash Writer & Blackfin Boot Loader
+ * ===============================================================
+ * Copyright (c) 2013 Shinichiro Nakamura
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ * ===============================================================
+ */
+
+#ifndef SIM_PORT_H
+#define SIM_PORT_H
+
+/*
+ * Porting macros for the host programs.
+ * The drivers talk to the simulated chip. Give it to the compiler with
+ * -include. The benchmark adds the instrumentation hooks of bench_hook.h.
+ */
+
+#include "flash_sim.h"
+
+#define SPI_INIT()
+#define SPI_ASSERT()                flash_sim_select()
+#define SPI_TRANSMIT(D)             flash_sim_transfer(D)
+#define SPI_DEASSERT()              flash_sim_deselect()
+#define SPI_TRANSMIT16(D)           sim_port_transmit((D), 2)
+#define SPI_TRANSMIT32(D)           sim_port_transmit((D), 4)
+
+#define FLASH_DELAY_US(US)          flash_sim_delay_us(US)
+
+#define FLASH_BENCH_CLOCK_US()      sim_port_clock_us()
+#define FLASH_BENCH_BUS_BYTES()     sim_port_bus_bytes()
+
+/*
+ * A wide frame goes out as its bytes, the most significant byte first,
+ * as a controller with the wide frames puts it on the bus.
+ * Build with -DSPI_FRAME_BITS=16 or 32 to use them.
+ */
+static inline unsigned long sim_port_transmit(unsigned long d, int bytes)
+{
+  unsigned long r = 0;
+  int i;
+  for (i = bytes - 1; i >= 0; i--) {
+    r = (r << 8) | flash_sim_transfer((unsigned char)(d >> (8 * i)));
+  }
+  return r;
+}
+
+static inline unsigned long sim_port_clock_us(void)
+{
+  flash_sim_stats_t stats;
+  flash_sim_stats(&stats);
+  return stats.time_ns / 1000;
+}
+
+static inline unsigned long sim_port_bus_bytes(void)
+{
+  flash_sim_stats_t stats;
+  flash_sim_stats(&stats);
+  return stats.bus_bytes;
+}
+
+#endif